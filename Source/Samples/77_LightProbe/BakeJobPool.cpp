@@ -0,0 +1,277 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#include "BakeJobPool.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+BakeJobPool::BakeJobPool(unsigned numThreads)
+    : nextWorker_(0)
+    , nextSubmit_(0)
+    , numQueued_(0)
+    , numIdle_(0)
+    , numPending_(0)
+    , exiting_(false)
+    , completed_(NULL)
+{
+    if (numThreads == 0)
+    {
+        numThreads = Max(GetNumLogicalCPUs(), 1u);
+    }
+
+    // every deque exists before the first thread looks for work
+    for ( unsigned i = 0; i < numThreads; ++i )
+    {
+        workers_.Push(new Worker());
+    }
+
+    for ( unsigned i = 0; i < numThreads; ++i )
+    {
+        SharedPtr<HelperThread<BakeJobPool> > thread(new HelperThread<BakeJobPool>(this, &BakeJobPool::WorkerProcess, false));
+        thread->Start();
+        threads_.Push(thread);
+    }
+}
+
+BakeJobPool::~BakeJobPool()
+{
+    // queued jobs are dropped, running ones finish first
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        exiting_ = true;
+    }
+    workCond_.notify_all();
+
+    threads_.Clear();
+
+    for ( unsigned i = 0; i < workers_.Size(); ++i )
+    {
+        delete workers_[i];
+    }
+    workers_.Clear();
+}
+
+void BakeJobPool::Submit(BakeJob *job)
+{
+    Submit(job, nextSubmit_++ % workers_.Size());
+}
+
+void BakeJobPool::Submit(BakeJob *job, unsigned threadIndex)
+{
+    ++numPending_;
+    Push(job, threadIndex);
+
+    WakeIdle();
+}
+
+void BakeJobPool::Complete(BakeJob *job)
+{
+    BakeJob *head = completed_.load();
+
+    do
+    {
+        job->nextCompleted_ = head;
+    }
+    while (!completed_.compare_exchange_weak(head, job));
+}
+
+unsigned BakeJobPool::ProcessCompleted()
+{
+    // the list is newest first
+    PODVector<BakeJob*> jobs;
+
+    for ( BakeJob *job = completed_.exchange(NULL); job; job = job->nextCompleted_ )
+    {
+        jobs.Push(job);
+    }
+
+    for ( unsigned i = jobs.Size(); i-- > 0; )
+    {
+        jobs[i]->nextCompleted_ = NULL;
+        jobs[i]->JobDone();
+    }
+
+    return jobs.Size();
+}
+
+void BakeJobPool::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+
+    while (numPending_.load() > 0)
+    {
+        idleCond_.wait(lock);
+    }
+}
+
+void BakeJobPool::Cancel(BakeJob *job)
+{
+    WaitIdle();
+
+    // nothing runs now to add to the list, put back all but the job
+    PODVector<BakeJob*> jobs;
+
+    for ( BakeJob *completed = completed_.exchange(NULL); completed; completed = completed->nextCompleted_ )
+    {
+        if (completed != job)
+        {
+            jobs.Push(completed);
+        }
+    }
+
+    for ( unsigned i = jobs.Size(); i-- > 0; )
+    {
+        Complete(jobs[i]);
+    }
+}
+
+long long BakeJobPool::GetBusyUSec() const
+{
+    long long busyUSec = 0;
+
+    for ( unsigned i = 0; i < workers_.Size(); ++i )
+    {
+        busyUSec += workers_[i]->busyUSec_;
+    }
+
+    return busyUSec;
+}
+
+void BakeJobPool::ResetBusyUSec()
+{
+    for ( unsigned i = 0; i < workers_.Size(); ++i )
+    {
+        workers_[i]->busyUSec_ = 0;
+    }
+}
+
+void BakeJobPool::WorkerProcess(void *data)
+{
+    BakeJobPool *pool = (BakeJobPool*)data;
+    const unsigned threadIndex = pool->nextWorker_++;
+    Worker &worker = *pool->workers_[threadIndex];
+    HiresTimer timer;
+
+    while (!pool->exiting_)
+    {
+        BakeJob *job = pool->Take(threadIndex);
+
+        if (job == NULL)
+        {
+            // counted in as idle before checking the queued count, a job
+            // pushed in between either shows up in it or its submitter sees
+            // us and notifies once we are waiting
+            std::unique_lock<std::mutex> lock(pool->sleepMutex_);
+            ++pool->numIdle_;
+
+            while (pool->numQueued_.load() == 0 && !pool->exiting_)
+            {
+                pool->workCond_.wait(lock);
+            }
+
+            --pool->numIdle_;
+            continue;
+        }
+
+        timer.Reset();
+        job->RunJob(pool, threadIndex);
+        worker.busyUSec_ += timer.GetUSec(false);
+
+        // jobs a job submits were counted before it got here
+        if (--pool->numPending_ == 0)
+        {
+            std::lock_guard<std::mutex> lock(pool->sleepMutex_);
+            pool->idleCond_.notify_all();
+        }
+    }
+}
+
+void BakeJobPool::Push(BakeJob *job, unsigned threadIndex)
+{
+    Worker &worker = *workers_[threadIndex];
+    MutexLock lock(worker.mutex_);
+
+    worker.jobs_.Push(job);
+    ++numQueued_;
+}
+
+BakeJob* BakeJobPool::Take(unsigned threadIndex)
+{
+    // newest of its own
+    {
+        Worker &worker = *workers_[threadIndex];
+        MutexLock lock(worker.mutex_);
+
+        if (worker.head_ < worker.jobs_.Size())
+        {
+            BakeJob *job = worker.jobs_.Back();
+            worker.jobs_.Pop();
+            --numQueued_;
+
+            if (worker.head_ == worker.jobs_.Size())
+            {
+                worker.jobs_.Clear();
+                worker.head_ = 0;
+            }
+            return job;
+        }
+    }
+
+    // oldest of the others
+    for ( unsigned i = 1; i < workers_.Size(); ++i )
+    {
+        Worker &victim = *workers_[(threadIndex + i) % workers_.Size()];
+        MutexLock lock(victim.mutex_);
+
+        if (victim.head_ < victim.jobs_.Size())
+        {
+            BakeJob *job = victim.jobs_[victim.head_++];
+            --numQueued_;
+
+            if (victim.head_ == victim.jobs_.Size())
+            {
+                victim.jobs_.Clear();
+                victim.head_ = 0;
+            }
+            return job;
+        }
+    }
+
+    return NULL;
+}
+
+void BakeJobPool::WakeIdle()
+{
+    // which thread takes the job doesn't matter. taking the lock first means
+    // a sleeper counted in has reached its wait and can't miss the notify
+    if (numIdle_.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        workCond_.notify_one();
+    }
+}
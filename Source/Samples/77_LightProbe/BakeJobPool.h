@@ -0,0 +1,129 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Core/HelperThread.h>
+#include <Urho3D/Core/Mutex.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+using namespace Urho3D;
+
+class BakeJobPool;
+
+//=============================================================================
+//=============================================================================
+class BakeJob
+{
+    friend class BakeJobPool;
+public:
+    BakeJob() : nextCompleted_(NULL) {}
+    virtual ~BakeJob() {}
+
+    // runs on a pool thread, threadIndex is for BakeJobPool::Submit()
+    virtual void RunJob(BakeJobPool *pool, unsigned threadIndex) = 0;
+
+    // back on the thread calling BakeJobPool::ProcessCompleted()
+    virtual void JobDone() {}
+
+private:
+    BakeJob *nextCompleted_;
+};
+
+//=============================================================================
+// fixed set of bake threads, created once and kept asleep when there is no
+// work. every thread has its own job deque: it takes its newest job first and
+// steals the oldest of another thread's when its own is empty, so jobs that
+// fan out more jobs stay on the same thread unless others are idle.
+//
+// jobs are not freed by the pool. a job that is done hands itself to
+// Complete() and comes back out of ProcessCompleted(), through a lock-free list
+//=============================================================================
+class BakeJobPool : public RefCounted
+{
+public:
+    // 0 threads uses the logical cpu count
+    BakeJobPool(unsigned numThreads = 0);
+    virtual ~BakeJobPool();
+
+    unsigned GetNumThreads() const { return workers_.Size(); }
+
+    // queues a job, spread over the threads
+    void Submit(BakeJob *job);
+    // queues a job from inside RunJob() on the thread running it
+    void Submit(BakeJob *job, unsigned threadIndex);
+
+    // marks a job as done, from any thread
+    void Complete(BakeJob *job);
+    // calls JobDone() on every job completed since the last call, in
+    // completion order, returns the count
+    unsigned ProcessCompleted();
+
+    // blocks until no job is queued or running
+    void WaitIdle();
+    // for a job destroyed while in flight: waits for the pool to go idle and
+    // forgets the job's completion
+    void Cancel(BakeJob *job);
+
+    // time the threads spent running jobs, updated as each job finishes
+    long long GetBusyUSec() const;
+    void ResetBusyUSec();
+
+protected:
+    struct Worker
+    {
+        Worker() : head_(0), busyUSec_(0) {}
+
+        Mutex mutex_;
+        PODVector<BakeJob*> jobs_;
+        unsigned head_;
+        std::atomic<long long> busyUSec_;
+    };
+
+    void WorkerProcess(void *data);
+    void Push(BakeJob *job, unsigned threadIndex);
+    BakeJob* Take(unsigned threadIndex);
+    void WakeIdle();
+
+protected:
+    PODVector<Worker*> workers_;
+    Vector<SharedPtr<HelperThread<BakeJobPool> > > threads_;
+
+    std::atomic<unsigned> nextWorker_;
+    std::atomic<unsigned> nextSubmit_;
+    std::atomic<unsigned> numQueued_;
+    std::atomic<unsigned> numIdle_;
+    std::atomic<unsigned> numPending_;
+    std::atomic<bool> exiting_;
+
+    // sleeping threads and WaitIdle() recheck the counts above under it
+    std::mutex sleepMutex_;
+    std::condition_variable workCond_;
+    std::condition_variable idleCond_;
+
+    std::atomic<BakeJob*> completed_;
+};
@@ -0,0 +1,54 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/RefCounted.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Scene;
+class Vector3;
+}
+
+struct CubeCaptureSettings;
+struct SHCubeFaces;
+
+//=============================================================================
+// alternative to rendering probe faces with the engine renderer. a backend
+// renders the whole cube synchronously, on the main thread, straight into
+// the readback buffer; CubeCapture uses the gpu when no backend is set
+//=============================================================================
+class CaptureBackend : public RefCounted
+{
+public:
+    virtual ~CaptureBackend() {}
+
+    // a bake brackets its captures with these. the scene is static in
+    // between, so a backend may keep what it gathered from it
+    virtual void BeginBake() {}
+    virtual void EndBake() {}
+
+    // faces are already allocated for the face size and format to capture
+    virtual bool CaptureCube(Scene *scene, const Vector3 &position, const CubeCaptureSettings &settings, SHCubeFaces &faces) = 0;
+};
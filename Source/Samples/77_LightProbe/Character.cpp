@@ -23,7 +23,6 @@
 #include <Urho3D/Core/Context.h>
 #include <Urho3D/Graphics/AnimationController.h>
 #include <Urho3D/Graphics/AnimatedModel.h>
-#include <Urho3D/Graphics/Material.h>
 #include <Urho3D/IO/MemoryBuffer.h>
 #include <Urho3D/Physics/PhysicsEvents.h>
 #include <Urho3D/Physics/PhysicsWorld.h>
@@ -46,10 +45,7 @@ Character::Character(Context* context) :
     onGround_(false),
     okToJump_(true),
     inAirTimer_(0.0f),
-    jumpStarted_(false),
-    updateLightProbeIndex_(true),
-    minDistToProbe_(15.0f),
-    probeIndex_(-1)
+    jumpStarted_(false)
 {
     // Only the physics update event is needed: unsubscribe from the rest for optimization
     SetUpdateEventMask(USE_FIXEDUPDATE);
@@ -73,19 +69,6 @@ void Character::DelayedStart()
     // Component has been inserted into its scene node. Subscribe to events now
     SubscribeToEvent(GetNode(), E_NODECOLLISION, URHO3D_HANDLER(Character, HandleNodeCollision));
 
-    if (updateLightProbeIndex_)
-    {
-        AnimatedModel *amodel = node_->GetComponent<AnimatedModel>(true);
-        charMaterial_ = amodel->GetMaterial();
-
-        // the index order is the same as how LightProbeCreator got the order
-        GetScene()->GetChildrenWithComponent(lightProbeNodeList_, "LightProbe", true);
-
-        if (lightProbeNodeList_.Size() == 0)
-        {
-            updateLightProbeIndex_ = false;
-        }
-    }
 }
 
 void Character::FixedUpdate(float timeStep)
@@ -188,46 +171,6 @@ void Character::FixedUpdate(float timeStep)
 
     // Reset grounded flag for next frame
     onGround_ = false;
-
-    UpdateLPIndex();
-}
-
-void Character::UpdateLPIndex()
-{
-    if (updateLightProbeIndex_)
-    {
-        // half sec. wait timer
-        if (timerLPUpdateIndex_.GetMSec(false) > 500)
-        {
-            float maxdist = minDistToProbe_;
-            Vector3 pos = node_->GetWorldPosition();
-            int idx = -1;
-
-            for ( int i = 0; i < (int)lightProbeNodeList_.Size(); ++i )
-            {
-                float dist = (lightProbeNodeList_[i]->GetWorldPosition() - pos).Length();
-
-                if (dist < maxdist)
-                {
-                    maxdist = dist;
-                    idx = i;
-                }
-            }
-
-            // change to a new index and/or disable it
-            if (idx != probeIndex_)
-            {
-                probeIndex_ = idx;
-
-                // change vars
-                Vector3 probePos = (probeIndex_ > -1)?lightProbeNodeList_[probeIndex_]->GetWorldPosition():Vector3::ZERO;
-                charMaterial_->SetShaderParameter("ProbePosition", probePos);
-                charMaterial_->SetShaderParameter("ProbeIndex", (float)probeIndex_);
-            }
-
-            timerLPUpdateIndex_.Reset();
-        }
-    }
 }
 
 void Character::HandleNodeCollision(StringHash eventType, VariantMap& eventData)
@@ -26,10 +26,6 @@
 #include <Urho3D/Scene/LogicComponent.h>
 
 using namespace Urho3D;
-namespace Urho3D
-{
-class Material;
-}
 
 //=============================================================================
 //=============================================================================
@@ -71,7 +67,6 @@ public:
 private:
     /// Handle physics collision event.
     void HandleNodeCollision(StringHash eventType, VariantMap& eventData);
-    void UpdateLPIndex();
 
     /// Grounded flag for movement.
     bool onGround_;
@@ -81,11 +76,4 @@ private:
     /// In air timer. Due to possible physics inaccuracy, character can be off ground for max. 1/10 second and still be allowed to move.
     float inAirTimer_;
 
-    // light probe
-    bool updateLightProbeIndex_;
-    float minDistToProbe_;
-    PODVector<Node*> lightProbeNodeList_;
-    int probeIndex_;
-    WeakPtr<Material> charMaterial_;
-    Timer timerLPUpdateIndex_;
 };
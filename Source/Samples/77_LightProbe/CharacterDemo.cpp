@@ -54,6 +54,12 @@
 #include "CharacterDemo.h"
 #include "Character.h"
 #include "LightProbeCreator.h"
+#include "SoftwareCaptureBackend.h"
+#include "ProbeLighting.h"
+#include "CaptureViewMask.h"
+#include "SHProbeLayout.h"
+#include "SHProbeSet.h"
+#include "SHIrradianceVolume.h"
 #include "CollisionLayer.h"
 
 #include <Urho3D/DebugNew.h>
@@ -63,6 +69,22 @@ const float CAMERA_MIN_DIST = 1.0f;
 const float CAMERA_INITIAL_DIST = 5.0f;
 const float CAMERA_MAX_DIST = 20.0f;
 
+// written by LightProbeCreator next to SHprobeData.png
+const char* PROBE_SET_NAME = "LightProbe/Textures/SHprobeData.shps";
+const char* PROBE_VOLUME_NAME = "LightProbe/Textures/SHprobeData.shvol";
+
+// the probes are several units apart, finer cells only grow the checked in
+// volume (1 unit: ~530 KB, 3 units: ~35 KB)
+const float PROBE_VOLUME_CELL_SIZE = 3.0f;
+
+// without a volume, the character's coeffs are blended on the cpu and sent as
+// shader params, so its pixels fetch nothing from the probe table
+const bool UPLOAD_SH_COEFFS = true;
+
+// bakes the probes with the software backend, then again on the gpu, and logs
+// the largest coeff difference between the two. the gpu bake is the one saved
+const bool COMPARE_CAPTURE_BACKENDS = false;
+
 //=============================================================================
 //=============================================================================
 URHO3D_DEFINE_APPLICATION_MAIN(CharacterDemo)
@@ -74,7 +96,8 @@ CharacterDemo::CharacterDemo(Context* context)
     , firstPerson_(false)
     , drawDebug_(false)
     , cameraMode_(false)
-    , generateLightProbes_(false)
+    , generateLightProbes_(COMPARE_CAPTURE_BACKENDS)
+    , compareBaking_(false)
 {
     Character::RegisterObject(context);
 }
@@ -101,8 +124,22 @@ void CharacterDemo::Start()
     // init lp creator - this needs to be created before a scene is parsed, otherwise, LightProbe component is unknown
     CreateLightProbeCreator();
 
+    // lights the dynamic drawables from the probes
+    context_->RegisterSubsystem(new ProbeLighting(context_));
+
     CreateInstructions();
 
+    // open the baked probe set while the scene loads
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+    if (!generateLightProbes_ && cache->Exists(PROBE_SET_NAME))
+    {
+        cache->BackgroundLoadResource<SHProbeSet>(PROBE_SET_NAME);
+    }
+    if (!generateLightProbes_ && cache->Exists(PROBE_VOLUME_NAME))
+    {
+        cache->BackgroundLoadResource<SHIrradianceVolume>(PROBE_VOLUME_NAME);
+    }
+
     CreateScene();
 
     if (!generateLightProbes_)
@@ -144,6 +181,13 @@ void CharacterDemo::CreateScene()
         LightProbeCreator *lightProbeCreator = GetSubsystem<LightProbeCreator>();
         lightProbeCreator->Init(scene_, "Data/LightProbe");
         lightProbeCreator->SetOutputFilename(GetSubsystem<FileSystem>()->GetProgramDir() + "Data/LightProbe/Textures/SHprobeData.png");
+        lightProbeCreator->SetVolumeCellSize(PROBE_VOLUME_CELL_SIZE);
+
+        if (COMPARE_CAPTURE_BACKENDS)
+        {
+            lightProbeCreator->SetCaptureBackend(new SoftwareCaptureBackend(context_));
+            compareBaking_ = true;
+        }
 
         // start the timer and go
         hrTimer_.Reset();
@@ -172,12 +216,66 @@ void CharacterDemo::CreateCharacter()
     object->SetMaterial(1, c1Mat);
     object->SetMaterial(2, c2Mat);
 
+    // the player isn't part of the baked lighting
+    object->SetViewMask(ViewMask_Dynamic);
+
+    // probe positions and table slots come from the probe set when there is one
+    SHProbeSet *probeSet = cache->Exists(PROBE_SET_NAME) ? cache->GetResource<SHProbeSet>(PROBE_SET_NAME) : NULL;
+    SHIrradianceVolume *volume = cache->Exists(PROBE_VOLUME_NAME) ? cache->GetResource<SHIrradianceVolume>(PROBE_VOLUME_NAME) : NULL;
+    bool useVolume = false;
+
+    // without a probe set, fall back to the scene order, which must be the
+    // same as how LightProbeCreator got the order
+    ProbeLighting *probeLighting = GetSubsystem<ProbeLighting>();
+    probeLighting->SetUploadSHCoeffs(UPLOAD_SH_COEFFS);
+
+    if (probeSet)
+    {
+        probeLighting->SetProbeSet(probeSet);
+    }
+    else
+    {
+        PODVector<Node*> lightProbeNodeList;
+        scene_->GetChildrenWithComponent(lightProbeNodeList, "LightProbe", true);
+
+        PODVector<Vector3> positions(lightProbeNodeList.Size());
+        for ( unsigned i = 0; i < lightProbeNodeList.Size(); ++i )
+        {
+            positions[i] = lightProbeNodeList[i]->GetWorldPosition();
+        }
+
+        probeLighting->SetProbePositions(positions);
+    }
+
     // set shader texture width param
     Texture* texture = c1Mat->GetTexture(TU_ENVIRONMENT);
     if (texture)
     {
         c1Mat->SetShaderParameter("TextureSize", (float)texture->GetWidth());
         c2Mat->SetShaderParameter("TextureSize", (float)texture->GetWidth());
+
+        // match the shader variant to the baked sh layout
+        SHProbeLayout layout;
+        if (layout.LoadForTexture(context_, texture->GetName()))
+        {
+            String defines = layout.GetShaderDefines();
+
+            // light every pixel from the volume when the gpu takes 3d textures,
+            // else blend the probes around the character when the set has
+            // tetrahedra, on the cpu with uniforms or per pixel from the table
+            if (volume && volume->ApplyToMaterial(c1Mat) && volume->ApplyToMaterial(c2Mat))
+            {
+                defines += "SH_VOLUME ";
+                useVolume = true;
+            }
+            else
+            {
+                defines += probeLighting->GetShaderDefines();
+            }
+
+            c1Mat->SetPixelShaderDefines(defines);
+            c2Mat->SetPixelShaderDefines(defines);
+        }
     }
 
     object->SetCastShadows(true);
@@ -199,6 +297,13 @@ void CharacterDemo::CreateCharacter()
 
     // character
     character_ = objectNode->CreateComponent<Character>();
+
+    // the volume needs no probe assignment, the materials are clones already
+    if (!useVolume)
+    {
+        probeLighting->AddDrawable(object, false);
+    }
+
     Vector3 euAngle = spawnNode->GetRotation().EulerAngles();
     character_->controls_.yaw_ = euAngle.y_;
 }
@@ -268,13 +373,25 @@ void CharacterDemo::HandleLPStatusEvent(StringHash eventType, VariantMap& eventD
     unsigned totalCnt = eventData[P_TOTAL].GetUInt();
     unsigned completeCnt = eventData[P_COMPLETED].GetUInt();
 
-    if (totalCnt == completeCnt)
+    if (totalCnt == completeCnt && compareBaking_)
+    {
+        // the creator is still in its completion, the gpu bake starts next frame
+        compareBaking_ = false;
+        StoreCompareCoeffs();
+        SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(CharacterDemo, HandleCompareBake));
+    }
+    else if (totalCnt == completeCnt)
     {
         float elapsed = (float)((long)hrTimer_.GetUSec(false))/1000.0f;
         char buff[30];
         sprintf(buff, "%.2f", elapsed);
         instructionText_->SetText("light probes build: " + String(buff) + " msec.");
 
+        if (compareCoeffs_.Size())
+        {
+            CompareBackendCoeffs();
+        }
+
         // init remainding
         CreateCharacter();
 
@@ -288,6 +405,84 @@ void CharacterDemo::HandleLPStatusEvent(StringHash eventType, VariantMap& eventD
     }
 }
 
+void CharacterDemo::HandleCompareBake(StringHash eventType, VariantMap& eventData)
+{
+    UnsubscribeFromEvent(E_UPDATE);
+
+    LightProbeCreator *lightProbeCreator = GetSubsystem<LightProbeCreator>();
+    lightProbeCreator->SetCaptureBackend(NULL);
+
+    hrTimer_.Reset();
+    lightProbeCreator->GenerateLightProbes();
+}
+
+void CharacterDemo::StoreCompareCoeffs()
+{
+    PODVector<Node*> lightProbeNodeList;
+    scene_->GetChildrenWithComponent(lightProbeNodeList, "LightProbe", true);
+
+    for ( unsigned i = 0; i < lightProbeNodeList.Size(); ++i )
+    {
+        LightProbe *lightProbe = lightProbeNodeList[i]->GetComponent<LightProbe>();
+        compareCoeffs_[lightProbe->GetProbeID()] = lightProbe->GetCoeffVec();
+    }
+}
+
+void CharacterDemo::CompareBackendCoeffs()
+{
+    PODVector<Node*> lightProbeNodeList;
+    scene_->GetChildrenWithComponent(lightProbeNodeList, "LightProbe", true);
+
+    float maxDelta = 0.0f;
+    float sumDelta = 0.0f;
+    unsigned numCoeffs = 0;
+    unsigned maxProbeID = 0;
+    unsigned maxCoeff = 0;
+    float maxL00 = 0.0f;
+
+    for ( unsigned i = 0; i < lightProbeNodeList.Size(); ++i )
+    {
+        LightProbe *lightProbe = lightProbeNodeList[i]->GetComponent<LightProbe>();
+        const PODVector<Vector3> &gpuCoeffs = lightProbe->GetCoeffVec();
+
+        HashMap<unsigned, PODVector<Vector3> >::ConstIterator it = compareCoeffs_.Find(lightProbe->GetProbeID());
+        if (it == compareCoeffs_.End() || it->second_.Size() != gpuCoeffs.Size())
+            continue;
+
+        // the deltas are also given relative to the brightest gpu L00
+        if (gpuCoeffs.Size())
+        {
+            maxL00 = Max(maxL00, Max(Abs(gpuCoeffs[0].x_), Max(Abs(gpuCoeffs[0].y_), Abs(gpuCoeffs[0].z_))));
+        }
+
+        // largest channel difference of each coeff
+        for ( unsigned j = 0; j < gpuCoeffs.Size(); ++j )
+        {
+            const Vector3 delta = (gpuCoeffs[j] - it->second_[j]).Abs();
+            const float channelDelta = Max(delta.x_, Max(delta.y_, delta.z_));
+
+            sumDelta += channelDelta;
+            ++numCoeffs;
+
+            if (channelDelta > maxDelta)
+            {
+                maxDelta = channelDelta;
+                maxProbeID = lightProbe->GetProbeID();
+                maxCoeff = j;
+            }
+        }
+    }
+
+    const float meanDelta = numCoeffs ? sumDelta / (float)numCoeffs : 0.0f;
+    const float toPercent = maxL00 > 0.0f ? 100.0f / maxL00 : 0.0f;
+    const String result = ToString("software vs gpu capture: max coeff delta %.4f (%.1f%% of L00, probe %u coeff %u), mean %.4f (%.1f%%) over %u coeffs",
+                                   maxDelta, maxDelta * toPercent, maxProbeID, maxCoeff, meanDelta, meanDelta * toPercent, numCoeffs);
+    URHO3D_LOGINFO(result);
+    instructionText_->SetText(instructionText_->GetText() + "\n" + result);
+
+    compareCoeffs_.Clear();
+}
+
 void CharacterDemo::HandleUpdate(StringHash eventType, VariantMap& eventData)
 {
     using namespace Update;
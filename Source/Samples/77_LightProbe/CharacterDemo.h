@@ -63,6 +63,9 @@ protected:
     void SubscribeToEvents();
     /// Handle application update. Set controls to character.
     void HandleLPStatusEvent(StringHash eventType, VariantMap& eventData);
+    void HandleCompareBake(StringHash eventType, VariantMap& eventData);
+    void StoreCompareCoeffs();
+    void CompareBackendCoeffs();
     void HandleUpdate(StringHash eventType, VariantMap& eventData);
     void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
     void MoveCamera(float timeStep);
@@ -75,6 +78,9 @@ protected:
 
     WeakPtr<Text> instructionText_;
     bool generateLightProbes_;
+    // software bake of the backend comparison, by probe id
+    bool compareBaking_;
+    HashMap<unsigned, PODVector<Vector3> > compareCoeffs_;
     HiresTimer hrTimer_;
     bool cameraMode_;
     bool drawDebug_;
@@ -22,40 +22,51 @@
 
 #include <Urho3D/Core/Context.h>
 #include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/Profiler.h>
 #include <Urho3D/Graphics/Graphics.h>
 #include <Urho3D/Graphics/Renderer.h>
 #include <Urho3D/Graphics/RenderSurface.h>
 #include <Urho3D/Graphics/Viewport.h>
 #include <Urho3D/Graphics/Camera.h>
-#include <Urho3D/Graphics/Texture2D.h>
+#include <Urho3D/Graphics/RenderPath.h>
 #include <Urho3D/Graphics/TextureCube.h>
+#include <Urho3D/Resource/Image.h>
 #include <Urho3D/Scene/Scene.h>
 #include <Urho3D/Scene/SceneEvents.h>
 #include <Urho3D/Resource/XMLFile.h>
 #include <Urho3D/IO/FileSystem.h>
 #include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Log.h>
 
 #include "CubeCapture.h"
 
 #include <Urho3D/DebugNew.h>
-//=============================================================================
-//=============================================================================
-#define FIXED_IMAGE_SIZE    32
-
 //=============================================================================
 // adapted from EditorCubeCapture.as
 //=============================================================================
 CubeCapture::CubeCapture(Context* context)
     : Component(context)
-    , imgSize_(FIXED_IMAGE_SIZE)
     , updateCycle_(0)
     , finished_(false)
+    , failed_(false)
+    , hdr_(false)
+    , readbackTarget_(NULL)
+    , leaseWaitUSec_(0)
+    , captureUSec_(0)
+    , readbackUSec_(0)
+    , readbackBytes_(0)
+    , lease_(NULL)
     , dumpOutputFiles_(false)
 {
 }
 
 CubeCapture::~CubeCapture()
 {
+    if (lease_)
+    {
+        capturePool_->Release(lease_);
+        lease_ = NULL;
+    }
 }
 
 void CubeCapture::RegisterObject(Context* context)
@@ -78,41 +89,83 @@ String CubeCapture::GetTextureCubeName()
 
 void CubeCapture::Start()
 {
-    camNode_ = GetScene()->CreateChild("RenderCamera");
-    camera_ = camNode_->GetOrCreateComponent<Camera>();
-    camera_->SetFov(90.0f);
-    camera_->SetNearClip(0.0001f);
-    camera_->SetAspectRatio(1.0f);
-    camNode_->SetWorldPosition(node_->GetWorldPosition());
-
-    viewport_ = new Viewport(context_, GetScene(), camera_);
-    viewport_->SetRenderPath(GetSubsystem<Renderer>()->GetViewport(0)->GetRenderPath());
-
-    // Construct render surface 
-    renderImage_ = new Texture2D(context_);
-    renderImage_->SetSize(imgSize_, imgSize_, Graphics::GetRGBAFormat(), TEXTURE_RENDERTARGET);
-    
-    renderSurface_ = renderImage_->GetRenderSurface();
-    renderSurface_->SetViewport(0, viewport_);
-    renderSurface_->SetUpdateMode(SURFACE_UPDATEALWAYS);
+    updateCycle_ = 0;
+    leaseWaitUSec_ = 0;
+    captureUSec_ = 0;
+    readbackUSec_ = 0;
+    readbackBytes_ = 0;
+    timer_.Reset();
+
+    if (backend_ == NULL)
+    {
+        if (capturePool_ == NULL)
+        {
+            capturePool_ = new CubeCapturePool(context_);
+        }
 
-    // textureCube
-    textureCube_ = new TextureCube(context_);
+        // without a free lease the capture waits for one in HandlePreRender
+        AcquireLease();
+    }
 
     SubscribeToEvent(E_BEGINFRAME, URHO3D_HANDLER(CubeCapture, HandlePreRender));
     SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(CubeCapture, HandlePostRender));
 }
 
+bool CubeCapture::AcquireLease()
+{
+    URHO3D_PROFILE(AcquireCaptureLease);
+
+    // all six faces render into one cube target in the same frame
+    const unsigned format = hdr_ ? Graphics::GetRGBAFloat16Format() : Graphics::GetRGBAFormat();
+
+    lease_ = capturePool_->Acquire(GetScene(), settings_.faceSize_, format);
+    if (lease_ == NULL)
+        return false;
+
+    leaseWaitUSec_ = (unsigned)timer_.GetUSec(true);
+
+    lease_->camNode_->SetWorldPosition(node_->GetWorldPosition());
+
+    RenderPath *renderPath = NULL;
+    if (!settings_.renderPathName_.Empty())
+    {
+        renderPath = capturePool_->GetRenderPath(settings_.renderPathName_);
+    }
+    if (renderPath == NULL)
+    {
+        renderPath = GetSubsystem<Renderer>()->GetViewport(0)->GetRenderPath();
+    }
+
+    for ( unsigned i = 0; i < MAX_CUBEMAP_FACES; ++i )
+    {
+        Camera *camera = lease_->cameras_[i];
+        camera->SetFarClip(settings_.maxFarClip_);
+        camera->SetViewMask(settings_.viewMask_);
+        camera->SetLodBias(settings_.lodBias_);
+        camera->SetViewOverrideFlags(settings_.drawShadows_ ? VO_NONE : VO_DISABLE_SHADOWS);
+
+        lease_->viewports_[i]->SetRenderPath(renderPath);
+
+        // rendered once, in the next frame
+        lease_->textureCube_->GetRenderSurface((CubeMapFace)i)->QueueUpdate();
+    }
+
+    return true;
+}
+
 void CubeCapture::Stop()
 {
-    camNode_->Remove();
-    camNode_ = NULL;
-    viewport_ = NULL;
-    renderSurface_ = NULL;
+    // stop rendering the faces and hand the resources to the next capture
+    if (lease_)
+    {
+        capturePool_->Release(lease_);
+        lease_ = NULL;
+    }
     finished_ = true;
     
-    // generate output file
-    if (dumpOutputFiles_)
+    // generate output file, the xml lists the png faces which hdr captures
+    // don't write
+    if (dumpOutputFiles_ && !hdr_)
     {
         WriteXML();
     }
@@ -121,35 +174,108 @@ void CubeCapture::Stop()
     UnsubscribeFromEvent(E_ENDFRAME);
 }
 
+void CubeCapture::CaptureWithBackend()
+{
+    URHO3D_PROFILE(CaptureWithBackend);
+
+    // the backend renders straight into the readback target
+    leaseWaitUSec_ = (unsigned)timer_.GetUSec(true);
+
+    if (readbackTarget_ == NULL)
+    {
+        URHO3D_LOGERROR("CubeCapture: a capture backend needs a readback target");
+        failed_ = true;
+        return;
+    }
+
+    if (!backend_->CaptureCube(GetScene(), node_->GetWorldPosition(), settings_, *readbackTarget_))
+    {
+        URHO3D_LOGERROR("CubeCapture: capture backend failed");
+        failed_ = true;
+        return;
+    }
+
+    captureUSec_ = (unsigned)timer_.GetUSec(false);
+    readbackBytes_ = readbackTarget_->GetFaceBytes() * MAX_CUBEMAP_FACES;
+
+    // generate output file, png can only hold ldr faces
+    if (dumpOutputFiles_ && !hdr_)
+    {
+        for ( unsigned i = 0; i < MAX_CUBEMAP_FACES; ++i )
+        {
+            SharedPtr<Image> image(new Image(context_));
+            image->SetSize(settings_.faceSize_, settings_.faceSize_, 4);
+            image->SetData(&readbackTarget_->data_[i][0]);
+            image->SavePNG(GetFaceImagePath((CubeMapFace)i));
+        }
+    }
+}
+
 void CubeCapture::HandlePreRender(StringHash eventType, VariantMap& eventData)
 {
-    if (camNode_)
+    // backends render the whole cube right away
+    if (backend_)
     {
-        if (updateCycle_ < MAX_CUBEMAP_FACES)
+        CaptureWithBackend();
+        Stop();
+        return;
+    }
+
+    if (lease_ == NULL && !AcquireLease())
+        return;
+
+    // Start() can be called mid frame, only a frame that began after the
+    // update was queued is guaranteed to render the faces
+    if (updateCycle_ == 0)
+    {
+        updateCycle_ = 1;
+    }
+}
+
+void CubeCapture::HandlePostRender(StringHash eventType, VariantMap& eventData)
+{
+    if (lease_ == NULL || updateCycle_ == 0)
+        return;
+
+    URHO3D_PROFILE(ReadbackCubeFaces);
+
+    TextureCube *textureCube = lease_->textureCube_;
+
+    // one readback per face, directly into the projection's buffer
+    if (readbackTarget_)
+    {
+        if (readbackTarget_->faceSize_ == settings_.faceSize_ && readbackTarget_->format_ == (hdr_ ? SHFace_RGBA16F : SHFace_RGBA8))
         {
-            camNode_->SetWorldRotation(RotationOf(CubeMapFace(updateCycle_)));
+            HiresTimer readbackTimer;
+
+            for ( unsigned i = 0; i < MAX_CUBEMAP_FACES; ++i )
+            {
+                textureCube->GetData((CubeMapFace)i, 0, &readbackTarget_->data_[i][0]);
+            }
+
+            readbackUSec_ = (unsigned)readbackTimer.GetUSec(false);
+            readbackBytes_ = readbackTarget_->GetFaceBytes() * MAX_CUBEMAP_FACES;
         }
         else
         {
-            Stop();
+            URHO3D_LOGERROR("CubeCapture: readback target doesn't match the capture size or format");
+            failed_ = true;
         }
     }
-}
 
-void CubeCapture::HandlePostRender(StringHash eventType, VariantMap& eventData)
-{
-    CubeMapFace face = CubeMapFace(updateCycle_);
-    textureCube_->SetData(face, renderImage_->GetImage(), false);
+    captureUSec_ = (unsigned)timer_.GetUSec(false);
 
-    // generate output file
-    if (dumpOutputFiles_)
+    // generate output file, png can only hold ldr faces
+    if (dumpOutputFiles_ && !hdr_)
     {
-        String path = fullpath_ + "/" + basepath_ + "/" + filename_ + "_" + GetFaceName(face) + ".png";
-        textureCube_->GetImage(face)->SavePNG(path);
+        for ( unsigned i = 0; i < MAX_CUBEMAP_FACES; ++i )
+        {
+            CubeMapFace face = CubeMapFace(i);
+            textureCube->GetImage(face)->SavePNG(GetFaceImagePath(face));
+        }
     }
 
-    // post increment, opposed to how it's pre-incremented in the EditorCubeCapture.as
-    ++updateCycle_;
+    Stop();
 }
 
 void CubeCapture::WriteXML()
@@ -175,7 +301,12 @@ void CubeCapture::WriteXML()
     file->Save(*outfile, "    ");
 }
 
-String CubeCapture::GetFaceName(CubeMapFace face) const
+String CubeCapture::GetFaceImagePath(CubeMapFace face) const
+{
+    return fullpath_ + "/" + basepath_ + "/" + filename_ + "_" + GetFaceName(face) + ".png";
+}
+
+String CubeCapture::GetFaceName(CubeMapFace face)
 {
     switch (face)
     {
@@ -189,7 +320,7 @@ String CubeCapture::GetFaceName(CubeMapFace face) const
     return "PosX";
 }
 
-Quaternion CubeCapture::RotationOf(CubeMapFace face) const
+Quaternion CubeCapture::RotationOf(CubeMapFace face)
 {
     switch (face)
     {
@@ -22,19 +22,46 @@
 
 #pragma once
 #include <Urho3D/Scene/Component.h>
+#include <Urho3D/Core/Timer.h>
 #include <Urho3D/Graphics/TextureCube.h>
 
+#include "SHFaceDecoder.h"
+#include "CubeCapturePool.h"
+#include "CaptureViewMask.h"
+#include "CaptureBackend.h"
+
 namespace Urho3D
 {
 class Scene;
-class Camera;
 class Viewport;
-class Texture2D;
-class RenderSurface;
 }
 
 using namespace Urho3D;
 
+//=============================================================================
+// how probe faces are rendered. the capture path skips post effects and
+// refraction, faces are tiny so a lower lod is fine
+//=============================================================================
+struct CubeCaptureSettings
+{
+    CubeCaptureSettings()
+        : renderPathName_("LightProbe/RenderPaths/Capture.xml")
+        , viewMask_(ViewMask_Capture)
+        , drawShadows_(true)
+        , lodBias_(0.5f)
+        , maxFarClip_(300.0f)
+        , faceSize_(32)
+    {
+    }
+
+    String renderPathName_;     // empty uses the main viewport's path
+    unsigned viewMask_;
+    bool drawShadows_;
+    float lodBias_;
+    float maxFarClip_;
+    int faceSize_;              // texels per cube face edge
+};
+
 //=============================================================================
 //=============================================================================
 class CubeCapture : public Component
@@ -50,37 +77,78 @@ public:
     void SetFilePath(const String &filename, const String &basepath, const String &fullpath);
     void Start();
     bool IsFinished() const                         { return finished_; }
+    // finished without filling the readback target
+    bool IsFailed() const                           { return failed_; }
 
-    SharedPtr<TextureCube> GetTextureCube() const   { return textureCube_; }
+    // the target is only valid while the capture holds its lease
+    TextureCube* GetTextureCube() const             { return lease_ ? lease_->textureCube_.Get() : NULL; }
     String GetTextureCubeName();
 
+    int GetFaceSize() const                         { return settings_.faceSize_; }
+
+    // faces are read back from the render target straight into this buffer,
+    // which must be allocated for the face size and hdr format
+    void SetReadbackTarget(SHCubeFaces *faces)      { readbackTarget_ = faces; }
+
+    // capture into a half float target so bright sources don't clip
+    void SetHDR(bool hdr)                           { hdr_ = hdr; }
+    bool GetHDR() const                             { return hdr_; }
+
     void SetDumpOutputFiles(bool dump)              { dumpOutputFiles_ = dump; }
     bool GetDumpOutputFiles() const                 { return dumpOutputFiles_; }
 
+    // captures lease their cameras and render target from a shared pool;
+    // one is made for this capture if none is set
+    void SetCapturePool(CubeCapturePool *pool)      { capturePool_ = pool; }
+
+    // renders the faces without the engine renderer, e.g. in headless mode
+    void SetBackend(CaptureBackend *backend)        { backend_ = backend; }
+
+    void SetSettings(const CubeCaptureSettings &settings) { settings_ = settings; }
+    const CubeCaptureSettings& GetSettings() const  { return settings_; }
+
+    // timings of a finished capture: waiting for a lease, then rendering and
+    // reading back the faces, the readback itself included
+    unsigned GetLeaseWaitUSec() const               { return leaseWaitUSec_; }
+    unsigned GetCaptureUSec() const                 { return captureUSec_; }
+    unsigned GetReadbackUSec() const                { return readbackUSec_; }
+    unsigned GetReadbackBytes() const               { return readbackBytes_; }
+
+    static String GetFaceName(CubeMapFace face);
+    static Quaternion RotationOf(CubeMapFace face);
+
 protected:
     void Stop();
+    bool AcquireLease();
+    void CaptureWithBackend();
     void HandlePreRender(StringHash eventType, VariantMap& eventData);
     void HandlePostRender(StringHash eventType, VariantMap& eventData);
     void WriteXML();
-    String GetFaceName(CubeMapFace face) const;
-    Quaternion RotationOf(CubeMapFace face) const;
+    String GetFaceImagePath(CubeMapFace face) const;
 
 protected:
     String                  filename_;
     String                  fullpath_;
     String                  basepath_;
 
-    WeakPtr<Node>           camNode_;
-    SharedPtr<Camera>       camera_;
-    SharedPtr<Viewport>     viewport_;
-    SharedPtr<Texture2D>    renderImage_;
-    WeakPtr<RenderSurface>  renderSurface_;
-    SharedPtr<TextureCube>  textureCube_;
+    SharedPtr<CubeCapturePool> capturePool_;
+    CubeCaptureLease        *lease_;
+    CubeCaptureSettings     settings_;
+    SharedPtr<CaptureBackend> backend_;
 
     int                     updateCycle_;
-    int                     imgSize_;
     String                  imagePath_;
     bool                    finished_;
+    bool                    failed_;
+    bool                    hdr_;
+    SHCubeFaces             *readbackTarget_;
+
+    // stats
+    HiresTimer              timer_;
+    unsigned                leaseWaitUSec_;
+    unsigned                captureUSec_;
+    unsigned                readbackUSec_;
+    unsigned                readbackBytes_;
 
     // dbg
     bool                    dumpOutputFiles_;
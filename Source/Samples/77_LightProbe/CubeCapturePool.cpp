@@ -0,0 +1,206 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/Camera.h>
+#include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/Graphics/RenderPath.h>
+#include <Urho3D/Graphics/RenderSurface.h>
+#include <Urho3D/Graphics/TextureCube.h>
+#include <Urho3D/Graphics/Viewport.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "CubeCapturePool.h"
+#include "CubeCapture.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+#define DEFAULT_MEMORY_BUDGET   (16 * 1024 * 1024)
+
+//=============================================================================
+//=============================================================================
+CubeCapturePool::CubeCapturePool(Context *context)
+    : context_(context)
+    , memoryBudget_(DEFAULT_MEMORY_BUDGET)
+    , memoryUse_(0)
+{
+}
+
+CubeCapturePool::~CubeCapturePool()
+{
+    while (leases_.Size())
+    {
+        DestroyLease(leases_.Size() - 1);
+    }
+}
+
+CubeCaptureLease* CubeCapturePool::Acquire(Scene *scene, int faceSize, unsigned format)
+{
+    // reuse an idle lease that matches
+    for ( unsigned i = 0; i < leases_.Size(); ++i )
+    {
+        CubeCaptureLease *lease = leases_[i];
+
+        if (!lease->inUse_ && lease->scene_.Get() == scene && lease->faceSize_ == faceSize && lease->format_ == format)
+        {
+            lease->inUse_ = true;
+            return lease;
+        }
+    }
+
+    // make room by dropping idle leases that don't match
+    const unsigned leaseMemory = GetLeaseMemory(faceSize, format);
+
+    for ( unsigned i = leases_.Size(); i-- > 0 && memoryUse_ + leaseMemory > memoryBudget_; )
+    {
+        if (!leases_[i]->inUse_)
+        {
+            DestroyLease(i);
+        }
+    }
+
+    if (leases_.Size() && memoryUse_ + leaseMemory > memoryBudget_)
+        return NULL;
+
+    CubeCaptureLease *lease = CreateLease(scene, faceSize, format);
+    lease->inUse_ = true;
+
+    return lease;
+}
+
+void CubeCapturePool::Release(CubeCaptureLease *lease)
+{
+    if (lease == NULL)
+        return;
+
+    // idle surfaces don't render
+    for ( unsigned i = 0; i < MAX_CUBEMAP_FACES; ++i )
+    {
+        lease->textureCube_->GetRenderSurface((CubeMapFace)i)->SetUpdateMode(SURFACE_MANUALUPDATE);
+    }
+
+    lease->inUse_ = false;
+}
+
+void CubeCapturePool::ReleaseIdle()
+{
+    for ( unsigned i = leases_.Size(); i-- > 0; )
+    {
+        if (!leases_[i]->inUse_)
+        {
+            DestroyLease(i);
+        }
+    }
+}
+
+RenderPath* CubeCapturePool::GetRenderPath(const String &name)
+{
+    HashMap<String, SharedPtr<RenderPath> >::Iterator it = renderPaths_.Find(name);
+    if (it != renderPaths_.End())
+        return it->second_;
+
+    // failures are remembered too, so they're only logged once
+    SharedPtr<RenderPath> renderPath;
+    XMLFile *file = context_->GetSubsystem<ResourceCache>()->GetResource<XMLFile>(name);
+
+    if (file)
+    {
+        renderPath = new RenderPath();
+        if (!renderPath->Load(file))
+        {
+            URHO3D_LOGERROR("CubeCapturePool: failed to load render path " + name);
+            renderPath = NULL;
+        }
+    }
+
+    renderPaths_[name] = renderPath;
+    return renderPath;
+}
+
+unsigned CubeCapturePool::GetLeaseMemory(int faceSize, unsigned format)
+{
+    const unsigned texelSize = (format == Graphics::GetRGBAFloat16Format()) ? 8 : 4;
+    const unsigned faceTexels = (unsigned)(faceSize * faceSize);
+
+    return faceTexels * (texelSize * MAX_CUBEMAP_FACES + 4);
+}
+
+CubeCaptureLease* CubeCapturePool::CreateLease(Scene *scene, int faceSize, unsigned format)
+{
+    CubeCaptureLease *lease = new CubeCaptureLease();
+    lease->scene_ = scene;
+    lease->faceSize_ = faceSize;
+    lease->format_ = format;
+    lease->memoryUse_ = GetLeaseMemory(faceSize, format);
+    lease->inUse_ = false;
+
+    lease->textureCube_ = new TextureCube(context_);
+    lease->textureCube_->SetSize(faceSize, format, TEXTURE_RENDERTARGET);
+
+    // local and temporary, so the camera nodes are never saved with the scene
+    lease->camNode_ = scene->CreateChild("RenderCamera", LOCAL);
+    lease->camNode_->SetTemporary(true);
+
+    for ( unsigned i = 0; i < MAX_CUBEMAP_FACES; ++i )
+    {
+        Node *faceNode = lease->camNode_->CreateChild(CubeCapture::GetFaceName((CubeMapFace)i), LOCAL);
+        faceNode->SetRotation(CubeCapture::RotationOf((CubeMapFace)i));
+
+        Camera *camera = faceNode->CreateComponent<Camera>(LOCAL);
+        camera->SetFov(90.0f);
+        camera->SetNearClip(0.0001f);
+        camera->SetAspectRatio(1.0f);
+        lease->cameras_[i] = camera;
+
+        lease->viewports_[i] = new Viewport(context_, scene, camera);
+
+        RenderSurface *surface = lease->textureCube_->GetRenderSurface((CubeMapFace)i);
+        surface->SetViewport(0, lease->viewports_[i]);
+        surface->SetUpdateMode(SURFACE_MANUALUPDATE);
+    }
+
+    leases_.Push(lease);
+    memoryUse_ += lease->memoryUse_;
+
+    return lease;
+}
+
+void CubeCapturePool::DestroyLease(unsigned index)
+{
+    CubeCaptureLease *lease = leases_[index];
+
+    for ( unsigned i = 0; i < MAX_CUBEMAP_FACES; ++i )
+    {
+        lease->textureCube_->GetRenderSurface((CubeMapFace)i)->SetViewport(0, NULL);
+    }
+
+    lease->camNode_->Remove();
+    memoryUse_ -= lease->memoryUse_;
+
+    leases_.Erase(index);
+    delete lease;
+}
@@ -0,0 +1,103 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Graphics/GraphicsDefs.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Camera;
+class Context;
+class Node;
+class RenderPath;
+class Scene;
+class TextureCube;
+class Viewport;
+}
+
+//=============================================================================
+// gpu resources of one cube capture: a cube render target and a camera and
+// viewport per face. idle leases keep their surfaces on manual update, so
+// they don't render
+//=============================================================================
+struct CubeCaptureLease
+{
+    SharedPtr<TextureCube> textureCube_;
+    SharedPtr<Node> camNode_;
+    Camera *cameras_[MAX_CUBEMAP_FACES];
+    SharedPtr<Viewport> viewports_[MAX_CUBEMAP_FACES];
+    WeakPtr<Scene> scene_;
+    int faceSize_;
+    unsigned format_;
+    unsigned memoryUse_;
+    bool inUse_;
+};
+
+//=============================================================================
+// leases capture resources to CubeCapture and recycles them. the number of
+// live render targets is bounded by the vram budget instead of the number of
+// probes being baked; a capture that can't get a lease waits for one
+//=============================================================================
+class CubeCapturePool : public RefCounted
+{
+public:
+    CubeCapturePool(Context *context);
+    virtual ~CubeCapturePool();
+
+    // at least one lease is always allowed, whatever the budget
+    void SetMemoryBudget(unsigned bytes)    { memoryBudget_ = bytes; }
+    unsigned GetMemoryBudget() const        { return memoryBudget_; }
+    unsigned GetMemoryUse() const           { return memoryUse_; }
+    unsigned GetNumLeases() const           { return leases_.Size(); }
+
+    // NULL when the budget is used up by leases in use
+    CubeCaptureLease* Acquire(Scene *scene, int faceSize, unsigned format);
+    void Release(CubeCaptureLease *lease);
+
+    // frees the gpu resources of every lease not in use
+    void ReleaseIdle();
+
+    // capture render paths are loaded once and shared by every lease,
+    // NULL when the file can't be loaded
+    RenderPath* GetRenderPath(const String &name);
+
+    // render target plus its share of depth buffer
+    static unsigned GetLeaseMemory(int faceSize, unsigned format);
+
+protected:
+    CubeCaptureLease* CreateLease(Scene *scene, int faceSize, unsigned format);
+    void DestroyLease(unsigned index);
+
+protected:
+    Context *context_;
+    PODVector<CubeCaptureLease*> leases_;
+    HashMap<String, SharedPtr<RenderPath> > renderPaths_;
+    unsigned memoryBudget_;
+    unsigned memoryUse_;
+};
@@ -0,0 +1,215 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Math/Vector3.h>
+#include <Urho3D/IO/Log.h>
+#include <atomic>
+
+#include "CubeTexelTable.h"
+#include "SHProjection.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+#define MAX_TABLE_SLOTS     16
+
+namespace
+{
+struct TableSlot
+{
+    std::atomic<int>                    faceSize_;
+    std::atomic<const CubeTexelTable*>  table_;
+};
+
+// slots are only written under the lock and published with release stores
+TableSlot tableSlots_[MAX_TABLE_SLOTS];
+unsigned numTableSlots_ = 0;
+Mutex tableLock_;
+
+struct TableSlotCleanup
+{
+    ~TableSlotCleanup()
+    {
+        for ( unsigned i = 0; i < numTableSlots_; ++i )
+        {
+            delete tableSlots_[i].table_.load();
+        }
+    }
+} tableSlotCleanup_;
+
+//=============================================================================
+// face axis mapping, in d3d cube map convention with s to the right and t
+// down: dir = (s, t, n) permuted and signed per face
+//=============================================================================
+enum FacePlane
+{
+    Plane_S,
+    Plane_T,
+    Plane_N
+};
+
+struct FaceMapping
+{
+    FacePlane   plane_[3];
+    float       sign_[3];
+};
+
+const FaceMapping faceMappings_[MAX_CUBEMAP_FACES] =
+{
+    { { Plane_N, Plane_T, Plane_S }, {  1.0f, -1.0f, -1.0f } },  // +x: ( 1, -t, -s)
+    { { Plane_N, Plane_T, Plane_S }, { -1.0f, -1.0f,  1.0f } },  // -x: (-1, -t,  s)
+    { { Plane_S, Plane_N, Plane_T }, {  1.0f,  1.0f,  1.0f } },  // +y: ( s,  1,  t)
+    { { Plane_S, Plane_N, Plane_T }, {  1.0f, -1.0f, -1.0f } },  // -y: ( s, -1, -t)
+    { { Plane_S, Plane_T, Plane_N }, {  1.0f, -1.0f,  1.0f } },  // +z: ( s, -t,  1)
+    { { Plane_S, Plane_T, Plane_N }, { -1.0f, -1.0f, -1.0f } },  // -z: (-s, -t, -1)
+};
+}
+
+//=============================================================================
+//=============================================================================
+const CubeTexelTable* CubeTexelTable::Get(int faceSize)
+{
+    // lock-free path, the table for this size has already been published
+    for ( unsigned i = 0; i < MAX_TABLE_SLOTS; ++i )
+    {
+        const int slotSize = tableSlots_[i].faceSize_.load(std::memory_order_acquire);
+
+        if (slotSize == faceSize)
+            return tableSlots_[i].table_.load(std::memory_order_acquire);
+        if (slotSize == 0)
+            break;
+    }
+
+    MutexLock lock(tableLock_);
+
+    // another thread might have built it while we waited
+    for ( unsigned i = 0; i < numTableSlots_; ++i )
+    {
+        if (tableSlots_[i].faceSize_.load(std::memory_order_relaxed) == faceSize)
+            return tableSlots_[i].table_.load(std::memory_order_relaxed);
+    }
+
+    if (faceSize <= 0 || numTableSlots_ == MAX_TABLE_SLOTS)
+    {
+        URHO3D_LOGERRORF("CubeTexelTable::Get() can't create a table for face size %d", faceSize);
+        return NULL;
+    }
+
+    const CubeTexelTable *table = new CubeTexelTable(faceSize);
+    TableSlot &slot = tableSlots_[numTableSlots_++];
+
+    // table before size, readers match on size
+    slot.table_.store(table, std::memory_order_release);
+    slot.faceSize_.store(faceSize, std::memory_order_release);
+
+    return table;
+}
+
+CubeTexelTable::CubeTexelTable(int faceSize)
+    : faceSize_(faceSize)
+    , texelsPerFace_((unsigned)(faceSize * faceSize))
+{
+    planeS_.Resize(texelsPerFace_);
+    planeT_.Resize(texelsPerFace_);
+    planeN_.Resize(texelsPerFace_);
+    solidAngle_.Resize(texelsPerFace_);
+
+    const float invSize = 1.0f / (float)faceSize;
+
+    for ( int y = 0; y < faceSize; ++y )
+    {
+        // texel edges and center in [-1, 1]
+        const float t0 = 2.0f * (float)y * invSize - 1.0f;
+        const float t1 = 2.0f * (float)(y + 1) * invSize - 1.0f;
+        const float t  = 2.0f * ((float)y + 0.5f) * invSize - 1.0f;
+
+        for ( int x = 0; x < faceSize; ++x )
+        {
+            const float s0 = 2.0f * (float)x * invSize - 1.0f;
+            const float s1 = 2.0f * (float)(x + 1) * invSize - 1.0f;
+            const float s  = 2.0f * ((float)x + 0.5f) * invSize - 1.0f;
+
+            const float invLen = 1.0f / sqrtf(s * s + t * t + 1.0f);
+            const unsigned idx = (unsigned)(y * faceSize + x);
+
+            planeS_[idx] = s * invLen;
+            planeT_[idx] = t * invLen;
+            planeN_[idx] = invLen;
+
+            solidAngle_[idx] = AreaElement(s0, t0) - AreaElement(s0, t1) - AreaElement(s1, t0) + AreaElement(s1, t1);
+        }
+    }
+}
+
+void CubeTexelTable::SetupFaceInput(CubeMapFace face, SHProjectionInput &input) const
+{
+    const FaceMapping &mapping = faceMappings_[face];
+    const float *planes[3] = { planeS_.Buffer(), planeT_.Buffer(), planeN_.Buffer() };
+
+    input.dirX_   = planes[mapping.plane_[0]];
+    input.dirY_   = planes[mapping.plane_[1]];
+    input.dirZ_   = planes[mapping.plane_[2]];
+    input.signX_  = mapping.sign_[0];
+    input.signY_  = mapping.sign_[1];
+    input.signZ_  = mapping.sign_[2];
+    input.weight_ = solidAngle_.Buffer();
+    input.count_  = texelsPerFace_;
+}
+
+Vector3 CubeTexelTable::GetDirection(CubeMapFace face, int x, int y) const
+{
+    const FaceMapping &mapping = faceMappings_[face];
+    const unsigned idx = (unsigned)(y * faceSize_ + x);
+    const float planes[3] = { planeS_[idx], planeT_[idx], planeN_[idx] };
+
+    return Vector3(mapping.sign_[0] * planes[mapping.plane_[0]],
+                   mapping.sign_[1] * planes[mapping.plane_[1]],
+                   mapping.sign_[2] * planes[mapping.plane_[2]]);
+}
+
+void CubeTexelTable::GetFaceAxes(CubeMapFace face, Vector3 &sAxis, Vector3 &tAxis, Vector3 &nAxis)
+{
+    const FaceMapping &mapping = faceMappings_[face];
+    float axes[3][3] = { { 0.0f } };
+
+    // component i of the direction is plane_[i], signed
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        axes[mapping.plane_[i]][i] = mapping.sign_[i];
+    }
+
+    sAxis = Vector3(axes[Plane_S]);
+    tAxis = Vector3(axes[Plane_T]);
+    nAxis = Vector3(axes[Plane_N]);
+}
+
+//=============================================================================
+// solid angle of the face region from the center to (x, y), the texel solid
+// angle is the signed sum of its four corners
+// ref: http://www.rorydriscoll.com/2012/01/15/cubemap-texel-solid-angle/
+//=============================================================================
+float CubeTexelTable::AreaElement(float x, float y)
+{
+    return atan2f(x * y, sqrtf(x * x + y * y + 1.0f));
+}
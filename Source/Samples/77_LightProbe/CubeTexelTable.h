@@ -0,0 +1,73 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Graphics/GraphicsDefs.h>
+
+using namespace Urho3D;
+
+struct SHProjectionInput;
+
+//=============================================================================
+// analytic cube texel directions and solid angles for one face size.
+//
+// texels are addressed as (face, y, x) in row-major order, matching the
+// image data of a captured face. all six faces are the same (s, t, 1) grid
+// with permuted and negated axes, so only one face worth of normalized
+// s, t, n planes and solid angle weights is stored.
+//=============================================================================
+class CubeTexelTable
+{
+public:
+    // returns the shared table for a face size, built on first use.
+    // lookups of an already built size don't lock
+    static const CubeTexelTable* Get(int faceSize);
+
+    int GetFaceSize() const                     { return faceSize_; }
+    unsigned GetTexelsPerFace() const           { return texelsPerFace_; }
+
+    // fills the direction and weight planes of the projection input for a face
+    void SetupFaceInput(CubeMapFace face, SHProjectionInput &input) const;
+
+    // unit direction of a texel center
+    Vector3 GetDirection(CubeMapFace face, int x, int y) const;
+
+    // world axes of a face's s, t and n coords, dir = s * sAxis + t * tAxis + nAxis
+    static void GetFaceAxes(CubeMapFace face, Vector3 &sAxis, Vector3 &tAxis, Vector3 &nAxis);
+
+protected:
+    CubeTexelTable(int faceSize);
+
+    static float AreaElement(float x, float y);
+
+protected:
+    int faceSize_;
+    unsigned texelsPerFace_;
+
+    // normalized face-local coords: s/len, t/len and 1/len
+    PODVector<float> planeS_;
+    PODVector<float> planeT_;
+    PODVector<float> planeN_;
+    PODVector<float> solidAngle_;
+};
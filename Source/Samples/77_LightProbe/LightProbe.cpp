@@ -22,60 +22,88 @@
 
 #include <Urho3D/Core/Context.h>
 #include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/Profiler.h>
 #include <Urho3D/Scene/Scene.h>
 #include <Urho3D/Scene/SceneEvents.h>
 #include <Urho3D/Resource/ResourceCache.h>
-#include <Urho3D/Resource/Image.h>
 #include <Urho3D/Graphics/Material.h>
-#include <Urho3D/Graphics/Model.h>
-#include <Urho3D/Graphics/Geometry.h>
-#include <Urho3D/Graphics/VertexBuffer.h>
-#include <Urho3D/Graphics/IndexBuffer.h>
 #include <Urho3D/IO/FileSystem.h>
 #include <Urho3D/IO/Log.h>
 #include <cstdio>
 
 #include "LightProbe.h"
 #include "CubeCapture.h"
+#include "SHBasis.h"
+#include "CubeTexelTable.h"
+#include "SHTileProjector.h"
 
 #include <Urho3D/DebugNew.h>
-//=============================================================================
-// static vars
-//=============================================================================
-PODVector<LightProbe::GeomData> LightProbe::geomData_;
-SharedArrayPtr<unsigned short> LightProbe::indexBuff_;
-unsigned LightProbe::numIndeces_ = 0;
-PODVector<LightProbe::SphericalData> LightProbe::sphericalData_;
-Mutex LightProbe::sphDataLock_;
-
 //=============================================================================
 //=============================================================================
 LightProbe::LightProbe(Context* context)
     : StaticModel(context)
     , generated_(false)
+    , probeID_(0)
+    , shOrder_(SHOrder_L2)
+    , sRGBInput_(false)
+    , hdrCapture_(false)
+    , bakeFailed_(false)
+    , cubeFaces_(NULL)
+    , projector_(NULL)
     , buildState_(SHBuild_Uninit)
     , dumpShCoeff_(false)
 {
+    // keep probe visuals out of other probes' captures
+    SetViewMask(ViewMask_Probe);
 }
 
 LightProbe::~LightProbe()
 {
-    threadProcess_ = NULL;
+    // the jobs use the faces and the projector
+    if (GetState() == SHBuild_BackgroundProcess)
+    {
+        jobPool_->Cancel(this);
+    }
+
+    delete projector_;
+    projector_ = NULL;
+
+    ReleaseCubeFaces();
 }
 
 void LightProbe::RegisterObject(Context* context)
 {
     context->RegisterFactory<LightProbe>();
+
+    URHO3D_ATTRIBUTE("Probe ID", unsigned, probeID_, 0, AM_DEFAULT);
 }
 
 void LightProbe::GenerateSH(const String &basepath, const String &fullpath)
 {
+    URHO3D_PROFILE(StartProbeCapture);
+
     basepath_ = basepath;
+    bakeStats_ = SHProbeBakeStats();
+    bakeFailed_ = false;
+    bakeTimer_.Reset();
 
     // 1st step in the process
     SetState(SHBuild_CubeCapture);
     cubeCapture_ = node_->GetOrCreateComponent<CubeCapture>();
     cubeCapture_->SetFilePath(ToString("node%u", node_->GetID()), basepath, fullpath);
+    cubeCapture_->SetHDR(hdrCapture_);
+    cubeCapture_->SetCapturePool(capturePool_);
+    cubeCapture_->SetSettings(captureSettings_);
+    cubeCapture_->SetBackend(captureBackend_);
+
+    if (facePool_ == NULL)
+    {
+        facePool_ = new SHCubeFacesPool();
+    }
+
+    ReleaseCubeFaces();
+    cubeFaces_ = facePool_->Acquire(cubeCapture_->GetFaceSize(), hdrCapture_ ? SHFace_RGBA16F : SHFace_RGBA8);
+    cubeCapture_->SetReadbackTarget(cubeFaces_);
     cubeCapture_->Start();
 
     SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(LightProbe, HandleUpdate));
@@ -106,55 +134,84 @@ void LightProbe::ForegroundProcess()
         if (cubeCapture_ && cubeCapture_->IsFinished())
         {
             BeginSHBuildProcess();
-
-            SetState(SHBuild_BackgroundProcess);
         }
         break;
 
-    case SHBuild_FinalizeCoeff:
+    case SHBuild_BackgroundProcess:
         {
-            EndSHBuild();
+            URHO3D_PROFILE(ProcessBakedProbes);
 
-            SetState(SHBuild_Complete);
+            // the pool is shared, whichever probe gets here first hands back
+            // every finished probe
+            jobPool_->ProcessCompleted();
         }
         break;
     }
 }
 
-void LightProbe::BackgroundProcess(void *data)
+void LightProbe::RunJob(BakeJobPool *pool, unsigned threadIndex)
 {
-    LightProbe *parent = (LightProbe*)data;
+    // the profiler only sees the main thread, pool stages are timed here
+    bakeStats_.queueUSec_ = (unsigned)queueTimer_.GetUSec(false);
+
+    HiresTimer decodeTimer;
+    const CubeTexelTable *texelTable = bakeFailed_ ? NULL : DecodeCubeFaces(*cubeFaces_, sRGBInput_);
+    bakeStats_.decodeUSec_ = (unsigned)decodeTimer.GetUSec(false);
 
-    if (parent->GetState() == SHBuild_BackgroundProcess)
+    if (texelTable == NULL)
     {
-        int nsamples = SetupSphericalData(parent->GetCubeImages(), parent->GetCoeffVec());
+        bakeFailed_ = true;
+        numSamples_ = 0;
+        pool->Complete(this);
+        return;
+    }
 
-        if (nsamples == 0)
-        {
-            nsamples = CalculateSH(parent->GetCubeImages(), parent->GetCoeffVec());
-        }
+    // the tiles fan out over the pool, the last one completes this probe
+    numSamples_ = (int)(texelTable->GetTexelsPerFace() * MAX_CUBEMAP_FACES);
+    projector_ = new SHTileProjector(shOrder_, texelTable, &cubeFaces_->planeR_[0], &cubeFaces_->planeG_[0], &cubeFaces_->planeB_[0]);
+    projector_->Submit(pool, threadIndex, &coeffVec_[0], this);
+}
 
-        parent->SetNumSamples(nsamples);
-        parent->SetState(SHBuild_FinalizeCoeff);
-    }
+void LightProbe::JobDone()
+{
+    bakeStats_.projectUSec_ = projector_ ? (unsigned)projector_->GetBusyUSec() : 0;
+    bakeStats_.probeUSec_ = (unsigned)bakeTimer_.GetUSec(false);
+
+    EndSHBuild();
+
+    SetState(SHBuild_Complete);
 }
 
 void LightProbe::BeginSHBuildProcess()
 {
-    CopyTextureCube();
+    EndCubeCapture();
 
     ClearCoeff();
 
-    // start the background thread
-    CreateThread();
+    if (jobPool_ == NULL)
+    {
+        jobPool_ = new BakeJobPool(1);
+    }
+
+    SetState(SHBuild_BackgroundProcess);
+    queueTimer_.Reset();
+    jobPool_->Submit(this);
+
+    // the capture resources are free, the next probe can be captured while
+    // this one is projected
+    using namespace SHCaptureDone;
+
+    VariantMap& eventData = GetEventDataMap();
+    eventData[P_NODE] = node_;
+    SendEvent(E_SHCAPTUREDONE, eventData);
 }
 
 void LightProbe::EndSHBuild()
 {
-    // done with the thread
-    DestroyThread();
-
-    FinalizeCoeff();
+    // done with the projection and the face buffers
+    delete projector_;
+    projector_ = NULL;
+    ReleaseCubeFaces();
 
     UnsubscribeFromEvent(E_UPDATE);
 
@@ -172,48 +229,41 @@ void LightProbe::EndSHBuild()
     }
 }
 
-void LightProbe::CopyTextureCube()
+void LightProbe::EndCubeCapture()
 {
-    // get the images from the texturecube
-    cubeImages_.Resize(MAX_CUBEMAP_FACES);
+    bakeStats_.leaseWaitUSec_ = cubeCapture_->GetLeaseWaitUSec();
+    bakeStats_.captureUSec_ = cubeCapture_->GetCaptureUSec();
+    bakeStats_.readbackUSec_ = cubeCapture_->GetReadbackUSec();
+    bakeStats_.readbackBytes_ = cubeCapture_->GetReadbackBytes();
 
-    for ( unsigned i = 0; i < MAX_CUBEMAP_FACES; ++i )
+    // the faces hold whatever the buffer had before
+    if (cubeCapture_->IsFailed())
     {
-        cubeImages_[i] = cubeCapture_->GetTextureCube()->GetImage(CubeMapFace(i));
+        bakeFailed_ = true;
     }
 
-    // done with cube capture
+    // the faces were already read back into cubeFaces_, done with cube capture
     node_->RemoveComponent(cubeCapture_);
     cubeCapture_ = NULL;
 }
 
-void LightProbe::CreateThread()
-{
-    threadProcess_ = new HelperThread<LightProbe>(this, &LightProbe::BackgroundProcess);
-    threadProcess_->Start();
-}
-
-void LightProbe::DestroyThread()
-{
-    threadProcess_ = NULL;
-}
-
-void LightProbe::ClearCoeff()
+void LightProbe::ReleaseCubeFaces()
 {
-    coeffVec_.Resize(9);
-    for ( unsigned i = 0; i < 9; ++i )
+    if (cubeFaces_)
     {
-        coeffVec_[i] = Vector3::ZERO;
+        facePool_->Release(cubeFaces_);
+        cubeFaces_ = NULL;
     }
 }
 
-void LightProbe::FinalizeCoeff()
+void LightProbe::ClearCoeff()
 {
-    const float factor = 4.0f * M_PI /(float)(numSamples_);
+    const unsigned numCoeffs = SHNumCoeffs(shOrder_);
 
-    for ( int i = 0; i < 9; ++i )
+    coeffVec_.Resize(numCoeffs);
+    for ( unsigned i = 0; i < numCoeffs; ++i )
     {
-        coeffVec_[i] *= factor;
+        coeffVec_[i] = Vector3::ZERO;
     }
 }
 
@@ -221,7 +271,7 @@ void LightProbe::DumpSHCoeff()
 {
     URHO3D_LOGINFOF("---------- node %u sh ----------", node_->GetID());
     char buff[50];
-    for ( int i = 0; i < 9; ++i )
+    for ( int i = 0; i < (int)coeffVec_.Size(); ++i )
     {
         sprintf(buff, "%d: {%8.5f, %8.5f, %8.5f}", i, coeffVec_[i].x_, coeffVec_[i].y_, coeffVec_[i].z_);
         URHO3D_LOGINFO(String(buff));
@@ -232,230 +282,32 @@ void LightProbe::DumpSHCoeff()
 //=============================================================================
 // static fns below this pt
 //=============================================================================
-void LightProbe::SetupUnitBoxGeom(Context *context)
-{
-    ResourceCache* cache = context->GetSubsystem<ResourceCache>();
-    Model *model = cache->GetResource<Model>("Models/Box.mdl");
-    Geometry *geometry = model->GetGeometry(0, 0);
-    VertexBuffer *vbuffer = geometry->GetVertexBuffer(0);
-    const unsigned char *vertexData = (const unsigned char*)vbuffer->Lock(0, vbuffer->GetVertexCount());
-
-    // populate geom data
-    if (vertexData)
-    {
-        unsigned elementMask = vbuffer->GetElementMask();
-        unsigned numVertices = vbuffer->GetVertexCount();
-        unsigned vertexSize = vbuffer->GetVertexSize();
-
-        geomData_.Resize(numVertices);
-
-        for ( unsigned i = 0; i < numVertices; ++i )
-        {
-            unsigned char *dataAlign = (unsigned char *)(vertexData + i * vertexSize);
-            GeomData &geom = geomData_[i];
-
-            if (elementMask & MASK_POSITION)
-            {
-                geom.pos_ = *reinterpret_cast<const Vector3*>(dataAlign);
-                dataAlign += sizeof(Vector3);
-            }
-            if (elementMask & MASK_NORMAL)
-            {
-                geom.normal_ = *reinterpret_cast<const Vector3*>(dataAlign);
-                dataAlign += sizeof(Vector3);
-            }
-            if (elementMask & MASK_COLOR)
-            {
-                dataAlign += sizeof(unsigned);
-            }
-            if (elementMask & MASK_TEXCOORD1)
-            {
-                geom.uv_ = *reinterpret_cast<const Vector2*>(dataAlign);
-            }
-        }
-        vbuffer->Unlock();
-    }
-
-    // get indices
-    IndexBuffer *ibuffer = geometry->GetIndexBuffer();
-    const unsigned short *ushortData = (const unsigned short *)ibuffer->Lock(0, ibuffer->GetIndexCount());
-
-    if (ushortData)
-    {
-        numIndeces_ = ibuffer->GetIndexCount();
-        unsigned indexSize = ibuffer->GetIndexSize();
-        indexBuff_ = new unsigned short[numIndeces_];
-        memcpy(indexBuff_.Get(), ushortData, numIndeces_ * indexSize);
-
-        ibuffer->Unlock();
-    }
-}
-
-int LightProbe::CalculateSH(const Vector<SharedPtr<Image> > &cubeImages, PODVector<Vector3> &coeffVec)
+const CubeTexelTable* LightProbe::DecodeCubeFaces(SHCubeFaces &cubeFaces, bool sRGB)
 {
-    // build sh coeff
-    for( unsigned i = 0; i < sphericalData_.Size(); ++i )
-    {
-        const SphericalData &sd = sphericalData_[i];
+    const int faceSize = cubeFaces.faceSize_;
+    const CubeTexelTable *texelTable = CubeTexelTable::Get(faceSize);
 
-        UpdateCoeffs(cubeImages[sd.face_]->GetPixel(sd.x_, sd.y_).ToVector3(), sd.normal_, coeffVec);
-    }
+    if (texelTable == NULL)
+        return NULL;
 
-    return (int)sphericalData_.Size();
-}
+    const unsigned texelsPerFace = texelTable->GetTexelsPerFace();
 
-int LightProbe::SetupSphericalData(const Vector<SharedPtr<Image> > &cubeImages, PODVector<Vector3> &coeffVec)
-{
-    MutexLock lock(sphDataLock_);
+    // decode all faces into the buffer's linear planes for the projection kernel
+    cubeFaces.Allocate(faceSize, cubeFaces.format_);
+    float *colR = &cubeFaces.planeR_[0];
+    float *colG = &cubeFaces.planeG_[0];
+    float *colB = &cubeFaces.planeB_[0];
 
-    // 1st thread to encounter size == 0 will build it
-    if (sphericalData_.Size() == 0)
+    for ( unsigned face = 0; face < MAX_CUBEMAP_FACES; ++face )
     {
-        const int texSizeX = cubeImages[0]->GetWidth();
-        const int texSizeY = cubeImages[0]->GetHeight();
-        const float texSizeXINV = 1.0f/(float)texSizeX;
-        const float texSizeYINV = 1.0f/(float)texSizeY;
-
-        // reserve 5% over what's expected
-        sphericalData_.Reserve((int)((float)texSizeX *(float)texSizeY * 6.0f * 1.05f));
+        const unsigned faceOffset = face * texelsPerFace;
 
-        // build sh coeff
-        for( unsigned i = 0; i < numIndeces_; i += 3 )
+        if (!SHFaceDecoder::DecodeFace(cubeFaces, (CubeMapFace)face, sRGB, &colR[faceOffset], &colG[faceOffset], &colB[faceOffset]))
         {
-            const unsigned short idx0 = indexBuff_[i+0];
-            const unsigned short idx1 = indexBuff_[i+1];
-            const unsigned short idx2 = indexBuff_[i+2];
-
-            const Vector3 &v0 = geomData_[idx0].pos_;	
-            const Vector3 &v1 = geomData_[idx1].pos_;	
-            const Vector3 &v2 = geomData_[idx2].pos_;	
-
-            const Vector3 &n0 = geomData_[idx0].normal_;   
-            //const Vector3 &n1 = geomData_[idx1].normal_;   
-            //const Vector3 &n2 = geomData_[idx2].normal_;  
-
-            const Vector2 &uv0 = geomData_[idx0].uv_;
-            const Vector2 &uv1 = geomData_[idx1].uv_;
-            const Vector2 &uv2 = geomData_[idx2].uv_;
-
-            float xMin = 1.0f;	
-            float xMax = 0.0f;	
-            float yMin = 1.0f;
-            float yMax = 0.0f;
-
-            if (uv0.x_ < xMin) xMin = uv0.x_; 
-            if (uv1.x_ < xMin) xMin = uv1.x_; 
-            if (uv2.x_ < xMin) xMin = uv2.x_; 
-
-            if (uv0.x_ > xMax) xMax = uv0.x_; 
-            if (uv1.x_ > xMax) xMax = uv1.x_; 
-            if (uv2.x_ > xMax) xMax = uv2.x_; 
-
-            if (uv0.y_ < yMin) yMin = uv0.y_; 
-            if (uv1.y_ < yMin) yMin = uv1.y_; 
-            if (uv2.y_ < yMin) yMin = uv2.y_; 
-
-            if (uv0.y_ > yMax) yMax = uv0.y_;
-            if (uv1.y_ > yMax) yMax = uv1.y_;
-            if (uv2.y_ > yMax) yMax = uv2.y_;
-
-            const int pixMinX = (int)Max((float)floor(xMin*texSizeX)-1, 0.0f); 
-            const int pixMaxX = (int)Min((float)ceil(xMax*texSizeX)+1, (float)texSizeX); 
-            const int pixMinY = (int)Max((float)floor(yMin*texSizeY)-1, 0.0f); 
-            const int pixMaxY = (int)Min((float)ceil(yMax*texSizeY)+1, (float)texSizeY);
-
-            // get cur face image
-            CubeMapFace face = GetCubefaceFromNormal(n0);
-            const SharedPtr<Image> curfaceImage = cubeImages[face];
-            Vector3 normal, bary;
-
-            for ( int x = pixMinX; x < pixMaxX; ++x ) 
-            {
-                for ( int y = pixMinY; y < pixMaxY; ++y ) 
-                {
-                    bary = Barycentric(uv0, uv1, uv2, Vector2((float)x * texSizeXINV, (float)y * texSizeYINV));
-
-                    if (BaryInsideTriangle(bary))
-                    {
-                        normal = (bary.x_ * v0 + bary.y_ * v1 + bary.z_ * v2).Normalized();
-                        
-                        UpdateCoeffs(curfaceImage->GetPixel(x, y).ToVector3(), normal, coeffVec);
-
-                        // save sph data
-                        sphericalData_.Resize(sphericalData_.Size() + 1);
-                        SphericalData &sphData = sphericalData_[sphericalData_.Size() - 1];
-
-                        sphData.x_      = x;
-                        sphData.y_      = y;
-                        sphData.face_   = face;
-                        sphData.normal_ = normal;
-                    }
-                }
-            }
+            URHO3D_LOGERROR("LightProbe::DecodeCubeFaces() cube face data is incomplete");
+            return NULL;
         }
-
-        return (int)sphericalData_.Size();
-    }
-
-    return 0;
-}
-
-//=============================================================================
-// based on: An Efficient Representation for Irradiance Environment Maps
-// http://graphics.stanford.edu/papers/envmap/
-// 
-// **note**
-// we're not multiplying individual updates with domega. instead, it's multiplied at the final stage
-//=============================================================================
-void LightProbe::UpdateCoeffs(const Vector3 &vcol, const Vector3 &v, PODVector<Vector3> &coeffVec)
-{
-    const float c0  = 0.282095f;
-    const float c1  = 0.488603f;
-    const float c2  = 1.092548f;
-    const float c3  = 0.315392f;
-    const float c33 = c3 * 3.0f;
-    const float c4  = 0.546274f;
-
-    /* L_{00}.  Note that Y_{00} = 0.282095 */
-    coeffVec[0] += vcol*c0;
-
-    /* L_{1m}. -1 <= m <= 1.  The linear terms */
-    coeffVec[1] += vcol*(c1*v.y_);   /* Y_{1-1} = 0.488603 y  */
-    coeffVec[2] += vcol*(c1*v.z_);   /* Y_{10}  = 0.488603 z  */
-    coeffVec[3] += vcol*(c1*v.x_);   /* Y_{11}  = 0.488603 x  */
-
-    /* The Quadratic terms, L_{2m} -2 <= m <= 2 */
-
-    /* First, L_{2-2}, L_{2-1}, L_{21} corresponding to xy,yz,xz */
-    coeffVec[4] += vcol*(c2*v.x_*v.y_); /* Y_{2-2} = 1.092548 xy */ 
-    coeffVec[5] += vcol*(c2*v.y_*v.z_); /* Y_{2-1} = 1.092548 yz */ 
-    coeffVec[7] += vcol*(c2*v.x_*v.z_); /* Y_{21}  = 1.092548 xz */ 
-
-    /* L_{20}.  Note that Y_{20} = 0.315392 (3z^2 - 1) */
-    coeffVec[6] += vcol*(c33*v.z_*v.z_-c3); 
-
-    /* L_{22}.  Note that Y_{22} = 0.546274 (x^2 - y^2) */
-    coeffVec[8] += vcol*(c4*(v.x_*v.x_-v.y_*v.y_));
-}
-
-CubeMapFace LightProbe::GetCubefaceFromNormal(const Vector3 &normal)
-{
-    const Vector3 cubefaceNormals[MAX_CUBEMAP_FACES] = 
-    {
-        Vector3::RIGHT,
-        Vector3::LEFT,
-        Vector3::UP,
-        Vector3::DOWN,
-        Vector3::FORWARD,
-        Vector3::BACK
-    };
-
-    for ( unsigned i = 0; i < MAX_CUBEMAP_FACES; ++i )
-    {
-        if (normal.DotProduct(cubefaceNormals[i]) > 1.0f - M_LARGE_EPSILON)
-            return (CubeMapFace)i;
     }
 
-    return FACE_POSITIVE_X;
+    return texelTable;
 }
-
@@ -22,26 +22,53 @@
 
 #pragma once
 #include <Urho3D/Graphics/StaticModel.h>
-#include <Urho3D/Core/HelperThread.h>
+#include <Urho3D/Core/Timer.h>
+
+#include "SHCubeFacesPool.h"
+#include "CubeCapture.h"
+#include "BakeJobPool.h"
 
 using namespace Urho3D;
-namespace Urho3D
-{
-class Image;
-}
 
-class CubeCapture;
+class CubeTexelTable;
+class SHTileProjector;
 
 //=============================================================================
 //=============================================================================
+URHO3D_EVENT(E_SHCAPTUREDONE, SHCaptureDone)
+{
+    URHO3D_PARAM(P_NODE, Node);      // node ptr
+}
+
 URHO3D_EVENT(E_SHBUILDDONE, SHBuildDone)
 {
     URHO3D_PARAM(P_NODE, Node);      // node ptr
 }
 
 //=============================================================================
+// where the bake time of one probe went, in usec
 //=============================================================================
-class LightProbe : public StaticModel
+struct SHProbeBakeStats
+{
+    SHProbeBakeStats()
+        : leaseWaitUSec_(0), captureUSec_(0), readbackUSec_(0), queueUSec_(0)
+        , decodeUSec_(0), projectUSec_(0), probeUSec_(0), readbackBytes_(0)
+    {
+    }
+
+    unsigned leaseWaitUSec_;    // waiting for a capture lease
+    unsigned captureUSec_;      // rendering and reading back the faces
+    unsigned readbackUSec_;     // of which the readback
+    unsigned queueUSec_;        // captured, waiting for a pool thread
+    unsigned decodeUSec_;
+    unsigned projectUSec_;      // summed over the pool threads
+    unsigned probeUSec_;        // capture start to projection handed back
+    unsigned readbackBytes_;
+};
+
+//=============================================================================
+//=============================================================================
+class LightProbe : public StaticModel, public BakeJob
 {
     URHO3D_OBJECT(LightProbe, StaticModel);
     friend class LightProbeCreator;
@@ -53,46 +80,89 @@ public:
     static void RegisterObject(Context* context);
 
     void GenerateSH(const String &basepath, const String &fullpath);
+
+    // stable id, the key of this probe in the baked probe set
+    void SetProbeID(unsigned probeID)   { probeID_ = probeID; }
+    unsigned GetProbeID() const         { return probeID_; }
     PODVector<Vector3>& GetCoeffVec() { return coeffVec_; }
 
+    void SetSHOrder(int order)      { shOrder_ = order; }
+    int GetSHOrder() const          { return shOrder_; }
+
+    // capture into a half float cube, for bright emissive sources
+    void SetHDRCapture(bool hdr)    { hdrCapture_ = hdr; }
+    bool GetHDRCapture() const      { return hdrCapture_; }
+
+    // captured ldr faces hold srgb encoded colors
+    void SetSRGBInput(bool sRGB)    { sRGBInput_ = sRGB; }
+    bool GetSRGBInput() const       { return sRGBInput_; }
+
+    // the cube is projected by jobs on this pool, a private single thread one
+    // is created when none is set. results don't depend on its thread count
+    void SetJobPool(BakeJobPool *jobPool)           { jobPool_ = jobPool; }
+
+    // capture and projection buffers come from this pool, a private one is
+    // created when none is set
+    void SetFacePool(SHCubeFacesPool *facePool)     { facePool_ = facePool; }
+    void SetCapturePool(CubeCapturePool *pool)      { capturePool_ = pool; }
+    void SetCaptureSettings(const CubeCaptureSettings &settings) { captureSettings_ = settings; }
+    void SetCaptureBackend(CaptureBackend *backend) { captureBackend_ = backend; }
+
+    // valid once the build is done
+    const SHProbeBakeStats& GetBakeStats() const    { return bakeStats_; }
+    // the capture or decode failed, the coeffs are not valid
+    bool IsBakeFailed() const                       { return bakeFailed_; }
+
     void SetDumpShCoeff(bool dump) { dumpShCoeff_ = dump; }
     void DumpSHCoeff();
 
 protected:
     void HandleUpdate(StringHash eventType, VariantMap& eventData);
     void ForegroundProcess();
-    void BackgroundProcess(void *data);
+    virtual void RunJob(BakeJobPool *pool, unsigned threadIndex);
+    virtual void JobDone();
     void BeginSHBuildProcess();
     void EndSHBuild();
-    void CreateThread();
-    void DestroyThread();
-    void CopyTextureCube();
+    void EndCubeCapture();
+    void ReleaseCubeFaces();
     void ClearCoeff();
-    void FinalizeCoeff();
 
     unsigned GetState();
     void SetState(unsigned state);
-    Vector<SharedPtr<Image> >& GetCubeImages()      { return cubeImages_; }
-    void SetNumSamples(int numSamples)              { numSamples_ = numSamples; }
 protected:
     bool generated_;
+    unsigned probeID_;
 
     // sh coeff
     PODVector<Vector3> coeffVec_;
+    int shOrder_;
+    bool sRGBInput_;
+    bool hdrCapture_;
     int numSamples_;
+    bool bakeFailed_;
 
     // cube map
     SharedPtr<CubeCapture> cubeCapture_;
-    Vector<SharedPtr<Image> > cubeImages_;
+    SharedPtr<SHCubeFacesPool> facePool_;
+    SharedPtr<CubeCapturePool> capturePool_;
+    CubeCaptureSettings captureSettings_;
+    SharedPtr<CaptureBackend> captureBackend_;
+    SHCubeFaces *cubeFaces_;
     String basepath_;
 
-    // thread
-    SharedPtr<HelperThread<LightProbe> > threadProcess_;
+    // projection
+    SharedPtr<BakeJobPool> jobPool_;
+    SHTileProjector *projector_;
     Mutex mutexStateLock_;
 
     // build state
     unsigned buildState_;
 
+    // stats
+    SHProbeBakeStats bakeStats_;
+    HiresTimer bakeTimer_;
+    HiresTimer queueTimer_;
+
     // dbg
     bool dumpShCoeff_;
 
@@ -102,79 +172,9 @@ private:
         SHBuild_Uninit,
         SHBuild_CubeCapture,
         SHBuild_BackgroundProcess,
-        SHBuild_FinalizeCoeff,
         SHBuild_Complete
     };
 
-    struct GeomData
-    {
-        Vector3 pos_;
-        Vector3 normal_;
-        Vector2 uv_;
-    };
-    struct SphericalData
-    {
-        int     x_;
-        int     y_;
-        int     face_;
-        Vector3 normal_;
-    };
-
-    // static vars
-    static PODVector<GeomData> geomData_;
-    static SharedArrayPtr<unsigned short> indexBuff_;
-    static unsigned numIndeces_;
-    static PODVector<SphericalData> sphericalData_;
-    static Mutex sphDataLock_;
-
     // static methods
-    static void SetupUnitBoxGeom(Context *context);
-    static int SetupSphericalData(const Vector<SharedPtr<Image> > &cubeImages, PODVector<Vector3> &coeffVec);
-    static int CalculateSH(const Vector<SharedPtr<Image> > &cubeImages, PODVector<Vector3> &coeffVec);
-    static void UpdateCoeffs(const Vector3 &vcol, const Vector3 &v, PODVector<Vector3> &coeffVec);
-    static CubeMapFace GetCubefaceFromNormal(const Vector3 &normal);
-
-    //=============================================================================
-    // http://answers.unity3d.com/questions/383804/calculate-uv-coordinates-of-3d-point-on-plane-of-m.html
-    // describes a barycentric calculation for 3D using proportional area calculation
-    //=============================================================================
-    static inline Vector3 Barycentric(const Vector2 &v0, const Vector2 &v1, const Vector2 &v2, const Vector2 &vp)
-    {
-        Vector3 bary(Vector3::ONE);
-
-        // edge seg
-        Vector2 e0 = v0 - vp;
-        Vector2 e1 = v1 - vp;
-        Vector2 e2 = v2 - vp;
-
-        float area = CrossProduct(v1 - v0, v2 - v0);
-
-        if (area > M_EPSILON)
-        {
-            // segment area: the subscripts a0, a1, and a2 are 
-            // derived from the opposite subscripts of e0, e1, and e2
-            float a0 = CrossProduct(e1, e2) / area;
-            float a1 = CrossProduct(e2, e0) / area;
-            float a2 = CrossProduct(e0, e1) / area;
-
-            bary = Vector3(a0, a1, a2);
-        }
-
-        return bary;
-    }
-
-    // missing in Urh3D::Vector2
-    static inline float CrossProduct(const Vector2 &a, const Vector2 &b)
-    {
-        return Abs(a.x_ * b.y_ - a.y_ * b.x_);
-    }
-
-    //=============================================================================
-    // **note: another proportinal comparator - the sum of the three segment areas is equal to the 
-    // area of triangle, hence you can also prove that the sum of the barycentric is equal to one, if it's inside the triangle
-    //=============================================================================
-    static inline bool BaryInsideTriangle(const Vector3 &bary)
-    {
-        return (bary.x_ + bary.y_ + bary.z_) < (1.0f + M_EPSILON);
-    }
+    static const CubeTexelTable* DecodeCubeFaces(SHCubeFaces &cubeFaces, bool sRGB);
 };
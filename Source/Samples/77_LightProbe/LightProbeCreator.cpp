@@ -21,32 +21,89 @@
 //
 
 #include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/Profiler.h>
+#include <Urho3D/Container/HashSet.h>
+#include <Urho3D/Container/Sort.h>
 #include <Urho3D/Scene/Scene.h>
 #include <Urho3D/Scene/SceneEvents.h>
 #include <Urho3D/Resource/ResourceCache.h>
 #include <Urho3D/Resource/Image.h>
+#include <Urho3D/Resource/JSONFile.h>
+#include <Urho3D/Graphics/Camera.h>
 #include <Urho3D/Graphics/Material.h>
 #include <Urho3D/Graphics/Model.h>
+#include <Urho3D/IO/File.h>
 #include <Urho3D/IO/FileSystem.h>
 #include <Urho3D/IO/Log.h>
 
 #include "LightProbeCreator.h"
 #include "LightProbe.h"
 #include "CubeCapture.h"
+#include "CubeTexelTable.h"
+#include "SHProbeLayout.h"
+#include "SHProbeSet.h"
+#include "SHIrradianceVolume.h"
+#include "SHBakeCache.h"
 
 #include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+#define DEFAULT_PROJECTION_MEMORY_BUDGET    (32 * 1024 * 1024)
+
+// per probe stages of the report
+static const struct
+{
+    const char *name_;
+    unsigned SHProbeBakeStats::*usec_;
+} bakeStages[] =
+{
+    { "leaseWait", &SHProbeBakeStats::leaseWaitUSec_ },
+    { "capture",   &SHProbeBakeStats::captureUSec_ },
+    { "readback",  &SHProbeBakeStats::readbackUSec_ },
+    { "queue",     &SHProbeBakeStats::queueUSec_ },
+    { "decode",    &SHProbeBakeStats::decodeUSec_ },
+    { "project",   &SHProbeBakeStats::projectUSec_ },
+    { "probe",     &SHProbeBakeStats::probeUSec_ },
+};
+
 //=============================================================================
 //=============================================================================
 LightProbeCreator::LightProbeCreator(Context* context)
     : Object(context)
+    , buildHead_(0)
     , totalCnt_(0)
     , numProcessed_(0)
+    , numFailed_(0)
+    , numCapturing_(0)
     , maxThreads_(8)
+    , maxInFlight_(1)
+    , projectionMemoryBudget_(DEFAULT_PROJECTION_MEMORY_BUDGET)
+    , numProjectionThreads_(0)
     , shProbeTextureWidth_(0)
+    , shOrder_(SHOrder_L2)
+    , sRGBInput_(false)
+    , hdrCapture_(false)
+    , tableEncoding_(SHEncode_ScaleBias)
+    , cacheInfluenceRadius_(0.0f)
+    , volumeCellSize_(1.0f)
+    , outputWritten_(false)
+    , peakInFlight_(0)
+    , peakCaptureMemory_(0)
+    , tableBuildUSec_(0)
+    , writeTableUSec_(0)
+    , writeProbeSetUSec_(0)
+    , writeVolumeUSec_(0)
     , worldPreScaler_(100.0f)
 {
     LightProbe::RegisterObject(context);
     CubeCapture::RegisterObject(context);
+    SHProbeSet::RegisterObject(context);
+    SHIrradianceVolume::RegisterObject(context);
+
+    facePool_ = new SHCubeFacesPool();
+    capturePool_ = new CubeCapturePool(context);
 }
 
 LightProbeCreator::~LightProbeCreator()
@@ -55,13 +112,14 @@ LightProbeCreator::~LightProbeCreator()
 
 void LightProbeCreator::Init(Scene *scene, const String& basepath)
 {
-    // all lightprobes use the default unit box - parse it
-    LightProbe::SetupUnitBoxGeom(context_);
-
     scene_ = scene;
     programPath_ = GetSubsystem<FileSystem>()->GetProgramDir();
     basepath_ = basepath;
 
+    bakeCache_ = new SHBakeCache(context_);
+    bakeCache_->SetCacheDir(programPath_ + basepath_ + "/BakeCache");
+
+    SubscribeToEvent(E_SHCAPTUREDONE, URHO3D_HANDLER(LightProbeCreator, HandleCaptureEvent));
     SubscribeToEvent(E_SHBUILDDONE, URHO3D_HANDLER(LightProbeCreator, HandleBuildEvent));
 }
 
@@ -70,80 +128,447 @@ void LightProbeCreator::SetOutputFilename(const String &outputFilename)
     outputFilename_ = outputFilename;
 }
 
+void LightProbeCreator::SetSHOrder(int order)
+{
+    shOrder_ = Clamp(order, (int)SHOrder_L1, (int)SHOrder_L3);
+}
+
+void LightProbeCreator::SetBakeCacheDir(const String &cacheDir)
+{
+    if (bakeCache_)
+    {
+        bakeCache_->SetCacheDir(cacheDir);
+    }
+}
+
 void LightProbeCreator::GenerateLightProbes()
 {
+    URHO3D_PROFILE(GenerateLightProbes);
+
+    outputWritten_ = false;
+    bakeTimer_.Reset();
+    bakeStats_.Clear();
+    peakInFlight_ = 0;
+    peakCaptureMemory_ = 0;
+    facePool_->ResetPeakInUse();
+    tableBuildUSec_ = 0;
+    writeTableUSec_ = 0;
+    writeProbeSetUSec_ = 0;
+    writeVolumeUSec_ = 0;
+
+    // the probe lists are per bake, a finished creator can bake again
+    origNodeList_.Clear();
+    buildRequiredNodeList_.Clear();
+    probeKeys_.Clear();
+    buildHead_ = 0;
+    totalCnt_ = 0;
+    numProcessed_ = 0;
+    numFailed_ = 0;
+
     ParseLightProbesInScene();
-    QueueNodeProcess();
+
+    if (numProcessed_ == totalCnt_)
+    {
+        // everything came from the cache, finish on the next update so the
+        // caller gets to subscribe to the status event first
+        SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(LightProbeCreator, HandleCachedBuildDone));
+    }
+    else
+    {
+        // a probe holds its face buffer from capture until it's projected,
+        // the budget bounds how far capture runs ahead of the projection
+        const SHFaceFormat format = hdrCapture_ ? SHFace_RGBA16F : SHFace_RGBA8;
+        const unsigned bufferMemory = SHCubeFacesPool::GetBufferMemory(captureSettings_.faceSize_, format);
+        maxInFlight_ = Max(projectionMemoryBudget_ / bufferMemory, 1u);
+
+        facePool_->Reserve(Min(maxInFlight_, buildRequiredNodeList_.Size() - buildHead_), captureSettings_.faceSize_, format);
+
+        // the direction table is shared by every probe, built here so the
+        // first projection doesn't pay for it
+        {
+            URHO3D_PROFILE(BuildTexelTable);
+            HiresTimer timer;
+            CubeTexelTable::Get(captureSettings_.faceSize_);
+            tableBuildUSec_ = timer.GetUSec(false);
+        }
+
+        // the projection threads are started once and shared by every probe
+        const unsigned numThreads = numProjectionThreads_ ? numProjectionThreads_ : GetNumLogicalCPUs();
+        if (jobPool_ == NULL || jobPool_->GetNumThreads() != numThreads)
+        {
+            jobPool_ = new BakeJobPool(numThreads);
+        }
+        jobPool_->ResetBusyUSec();
+
+        // the scene holds still for the bake, a cpu backend gathers it once
+        if (captureBackend_)
+        {
+            captureBackend_->BeginBake();
+        }
+
+        QueueNodeProcess();
+    }
+}
+
+static bool CompareProbeID(Node *lhs, Node *rhs)
+{
+    return lhs->GetComponent<LightProbe>()->GetProbeID() < rhs->GetComponent<LightProbe>()->GetProbeID();
 }
 
 unsigned LightProbeCreator::ParseLightProbesInScene()
 {
+    URHO3D_PROFILE(ParseLightProbes);
+
     PODVector<Node*> result;
     scene_->GetChildrenWithComponent(result, "LightProbe", true);
 
+    AssignProbeIDs(result);
+
+    // table slots follow the probe ids, so the scene order doesn't matter
+    Sort(result.Begin(), result.End(), CompareProbeID);
+
+    const float influenceRadius = cacheInfluenceRadius_ > 0.0f ? cacheInfluenceRadius_ : captureSettings_.maxFarClip_;
+
+    // anything that changes the capture or projection output
+    SHBakeHash settingsHash;
+    settingsHash.Add((unsigned)shOrder_);
+    settingsHash.Add((unsigned)sRGBInput_);
+    settingsHash.Add((unsigned)hdrCapture_);
+    settingsHash.Add(influenceRadius);
+    settingsHash.Add(captureSettings_.renderPathName_);
+    settingsHash.Add(captureSettings_.viewMask_);
+    settingsHash.Add((unsigned)captureSettings_.drawShadows_);
+    settingsHash.Add(captureSettings_.lodBias_);
+    settingsHash.Add(captureSettings_.maxFarClip_);
+    settingsHash.Add((unsigned)captureSettings_.faceSize_);
+    settingsHash.Add((unsigned)(captureBackend_ != NULL));
+
+    bakeCache_->BeginBake(scene_, influenceRadius, captureSettings_.viewMask_, settingsHash.Get());
+
     for ( unsigned i = 0; i < result.Size(); ++i )
     {
-        // retain the order provided by scene query, the same order is used by the Character class
-        origNodeList_.Push(result[i]);
-        buildRequiredNodeList_.Push(result[i]);
+        Node *node = result[i];
+        LightProbe *lightProbe = node->GetComponent<LightProbe>();
+        origNodeList_.Push(node);
+
+        const unsigned long long key = bakeCache_->GetProbeKey(node->GetWorldPosition());
+        probeKeys_[node] = key;
+
+        // only cache misses get captured and projected
+        if (bakeCache_->Load(key, SHNumCoeffs(shOrder_), lightProbe->GetCoeffVec()))
+        {
+            ++numProcessed_;
+        }
+        else
+        {
+            buildRequiredNodeList_.Push(node);
+        }
     }
     totalCnt_ = origNodeList_.Size();
 
+    URHO3D_LOGINFO("LightProbeCreator: bake cache " + String(bakeCache_->GetNumHits()) + " hits, " +
+                   String(bakeCache_->GetNumMisses()) + " misses");
+
     return totalCnt_;
 }
 
-void LightProbeCreator::QueueNodeProcess()
+void LightProbeCreator::AssignProbeIDs(const PODVector<Node*> &nodes)
 {
-    while (buildRequiredNodeList_.Size() && processingNodeList_.Size() < maxThreads_)
+    HashSet<unsigned> usedIDs;
+    PODVector<LightProbe*> needID;
+    unsigned maxID = 0;
+
+    for ( unsigned i = 0; i < nodes.Size(); ++i )
     {
-        Node* node = buildRequiredNodeList_[0];
+        LightProbe *lightProbe = nodes[i]->GetComponent<LightProbe>();
+        const unsigned probeID = lightProbe->GetProbeID();
 
-        StartSHBuild(node);
+        // 0 is unassigned, a repeat comes from a duplicated node
+        if (probeID == 0 || !usedIDs.Insert(probeID).second_)
+        {
+            needID.Push(lightProbe);
+        }
+        else
+        {
+            maxID = Max(maxID, probeID);
+        }
+    }
+
+    for ( unsigned i = 0; i < needID.Size(); ++i )
+    {
+        needID[i]->SetProbeID(++maxID);
+    }
+
+    if (needID.Size())
+    {
+        URHO3D_LOGWARNING("LightProbeCreator: assigned " + String(needID.Size()) + " new probe ids, save the scene to keep them");
+    }
+}
+
+void LightProbeCreator::QueueNodeProcess()
+{
+    URHO3D_PROFILE(StartProbeCaptures);
+
+    while (buildHead_ < buildRequiredNodeList_.Size() && numCapturing_ < maxThreads_ && processingNodeList_.Size() < maxInFlight_)
+    {
+        Node* node = buildRequiredNodeList_[buildHead_++];
 
         processingNodeList_.Push(node);
-        buildRequiredNodeList_.Erase(0);
+        ++numCapturing_;
+
+        StartSHBuild(node);
     }
+
+    peakInFlight_ = Max(peakInFlight_, processingNodeList_.Size());
+    peakCaptureMemory_ = Max(peakCaptureMemory_, capturePool_->GetMemoryUse());
 }
 
 void LightProbeCreator::StartSHBuild(Node *node)
 {
     LightProbe *lightProbe = node->GetComponent<LightProbe>();
+    lightProbe->SetSHOrder(shOrder_);
+    lightProbe->SetJobPool(jobPool_);
+    lightProbe->SetSRGBInput(sRGBInput_);
+    lightProbe->SetHDRCapture(hdrCapture_);
+    lightProbe->SetFacePool(facePool_);
+    lightProbe->SetCapturePool(capturePool_);
+    lightProbe->SetCaptureSettings(captureSettings_);
+    lightProbe->SetCaptureBackend(captureBackend_);
     lightProbe->GenerateSH(basepath_, programPath_);
 }
 
-void LightProbeCreator::WriteSHTableImage()
+bool LightProbeCreator::WriteSHTableImage()
 {
+    URHO3D_PROFILE(WriteSHTable);
+    HiresTimer timer;
+
     SharedPtr<Image> image(new Image(context_));
+    SHProbeLayout layout;
+    layout.SetOrder(shOrder_);
+    layout.SetEncoding(tableEncoding_);
+    layout.SetNumProbes(totalCnt_);
+
+    const unsigned numCoeffs = layout.GetNumCoeffs();
+    const unsigned texelsPerProbe = layout.GetTexelsPerProbe();
 
-    // size is calculated as 64 for testing
-    shProbeTextureWidth_ = NextPowerOfTwo(totalCnt_ * 9);
+    // one row, each probe owns texelsPerProbe texels
+    shProbeTextureWidth_ = NextPowerOfTwo(totalCnt_ * texelsPerProbe);
     image->SetSize(shProbeTextureWidth_, 1, 4);
+    unsigned char *data = image->GetData();
+    memset(data, 0, shProbeTextureWidth_ * 4);
 
-    for ( int i = 0; i < (int)totalCnt_; ++i )
+    for ( unsigned i = 0; i < totalCnt_; ++i )
     {
         LightProbe *lightProbe = origNodeList_[i]->GetComponent<LightProbe>();
         const PODVector<Vector3> &coeffVec = lightProbe->GetCoeffVec();
-        assert(coeffVec.Size() == 9 && "coeff vector size error!");
+        assert(coeffVec.Size() == numCoeffs && "coeff vector size error!");
+
+        // **reverse in shader: GetSH() in LightProbe.glsl/hlsl
+        SHTableEncoder::Encode(tableEncoding_, &coeffVec[0], numCoeffs, &data[i * texelsPerProbe * 4]);
+    }
+
+    // save file
+    String filename = outputFilename_;
+    if (filename.Empty())
+    {
+        // default
+        filename = programPath_ + basepath_ + "/Textures/SHprobeData.png";
+    }
+    if (!image->SaveFile(filename))
+    {
+        URHO3D_LOGERROR("LightProbeCreator::WriteSHTableImage() failed to save " + filename);
+        return false;
+    }
+
+    // describe the layout next to it, so the runtime picks the matching shader
+    if (!layout.SaveForTexture(context_, filename))
+    {
+        return false;
+    }
+    writeTableUSec_ = timer.GetUSec(false);
+
+    return WriteProbeSet(ReplaceExtension(filename, ".shps"));
+}
+
+bool LightProbeCreator::WriteProbeSet(const String &filename)
+{
+    URHO3D_PROFILE(WriteProbeSet);
+    HiresTimer timer;
 
-        // write coeffs - normalized to [0, 1]
-        for ( int j = 0; j < 9; ++j )
+    const unsigned numCoeffs = SHNumCoeffs(shOrder_);
+    PODVector<unsigned> ids(totalCnt_);
+    PODVector<Vector3> positions(totalCnt_);
+    PODVector<Vector3> coeffs(totalCnt_ * numCoeffs);
+
+    for ( unsigned i = 0; i < totalCnt_; ++i )
+    {
+        LightProbe *lightProbe = origNodeList_[i]->GetComponent<LightProbe>();
+        const PODVector<Vector3> &coeffVec = lightProbe->GetCoeffVec();
+
+        ids[i] = lightProbe->GetProbeID();
+        positions[i] = origNodeList_[i]->GetWorldPosition();
+
+        for ( unsigned j = 0; j < numCoeffs; ++j )
         {
-            Vector3 c = coeffVec[j] * 0.1f + Vector3::ONE * 0.5f;
-            // **reverse in shader: coeff = (c - Vector3(0.5,0.5,0.5)) * 10.0f;
-            image->SetPixel((i * 9) + j, 0, Color(c.x_, c.y_, c.z_));
+            coeffs[i * numCoeffs + j] = coeffVec[j];
         }
     }
 
-    // save file
-    if (!outputFilename_.Empty())
+    // origNodeList_ is in id order, so the set's slots match the table
+    SharedPtr<SHProbeSet> probeSet(new SHProbeSet(context_));
+
+    if (!probeSet->Define(shOrder_, ids, positions, coeffs))
     {
-        image->SaveFile(outputFilename_);
+        return false;
     }
-    else
+
+    File outfile(context_, filename, FILE_WRITE);
+    if (!outfile.IsOpen() || !probeSet->Save(outfile))
     {
-        // default
-        image->SavePNG(programPath_ + basepath_ + "/Textures/SHprobeData.png");
+        URHO3D_LOGERROR("LightProbeCreator::WriteProbeSet() failed to save " + filename);
+        return false;
+    }
+    writeProbeSetUSec_ = timer.GetUSec(false);
+
+    const String volumeFilename = ReplaceExtension(filename, ".shvol");
+
+    if (volumeCellSize_ > 0.0f)
+    {
+        return WriteIrradianceVolume(probeSet, volumeFilename);
+    }
+
+    // a volume left from an earlier bake would be loaded over these probes
+    FileSystem *fileSystem = GetSubsystem<FileSystem>();
+    if (fileSystem->FileExists(volumeFilename) && !fileSystem->Delete(volumeFilename))
+    {
+        URHO3D_LOGERROR("LightProbeCreator::WriteProbeSet() failed to delete the stale " + volumeFilename);
+        return false;
+    }
+
+    return true;
+}
+
+bool LightProbeCreator::WriteIrradianceVolume(SHProbeSet *probeSet, const String &filename)
+{
+    URHO3D_PROFILE(WriteIrradianceVolume);
+    HiresTimer timer;
+
+    // resampled through the probe set's tetrahedra, like the runtime blend
+    SharedPtr<SHIrradianceVolume> volume(new SHIrradianceVolume(context_));
+
+    if (!volume->Define(probeSet, volumeBounds_, volumeCellSize_))
+    {
+        return false;
+    }
+
+    File outfile(context_, filename, FILE_WRITE);
+    if (!outfile.IsOpen() || !volume->Save(outfile))
+    {
+        URHO3D_LOGERROR("LightProbeCreator::WriteIrradianceVolume() failed to save " + filename);
+        return false;
+    }
+
+    URHO3D_LOGINFO("LightProbeCreator: irradiance volume " + String(volume->GetSize(0)) + "x" + String(volume->GetSize(1)) + "x" +
+                   String(volume->GetSize(2)) + ", cell size " + String(volume->GetCellSize()));
+    writeVolumeUSec_ = timer.GetUSec(false);
+
+    return true;
+}
+
+static void WriteStageStats(PODVector<unsigned> &values, JSONValue &result)
+{
+    Sort(values.Begin(), values.End());
+
+    long long totalUSec = 0;
+    for ( unsigned i = 0; i < values.Size(); ++i )
+    {
+        totalUSec += values[i];
     }
+
+    // nearest rank
+    const unsigned count = values.Size();
+    const unsigned p50 = count ? values[(count * 50 + 99) / 100 - 1] : 0;
+    const unsigned p90 = count ? values[(count * 90 + 99) / 100 - 1] : 0;
+    const unsigned p99 = count ? values[(count * 99 + 99) / 100 - 1] : 0;
+
+    result["totalMSec"] = (double)totalUSec / 1000.0;
+    result["meanUSec"]  = count ? (double)totalUSec / count : 0.0;
+    result["p50USec"]   = p50;
+    result["p90USec"]   = p90;
+    result["p99USec"]   = p99;
+    result["maxUSec"]   = count ? values.Back() : 0u;
+}
+
+bool LightProbeCreator::WriteReport()
+{
+    URHO3D_PROFILE(WriteBakeReport);
+
+    const double elapsedMSec = (double)bakeTimer_.GetUSec(false) / 1000.0;
+    const SHFaceFormat format = hdrCapture_ ? SHFace_RGBA16F : SHFace_RGBA8;
+
+    SharedPtr<JSONFile> json(new JSONFile(context_));
+    JSONValue &root = json->GetRoot();
+    root["probes"]        = totalCnt_;
+    root["baked"]         = bakeStats_.Size();
+    root["failed"]        = numFailed_;
+    root["cacheHits"]     = bakeCache_ ? bakeCache_->GetNumHits() : 0u;
+    root["faceSize"]      = captureSettings_.faceSize_;
+    root["order"]         = shOrder_;
+    root["hdr"]           = hdrCapture_;
+    root["outputWritten"] = outputWritten_;
+    root["elapsedMSec"]   = elapsedMSec;
+
+    // per probe: wall time of each stage, except project which is summed over the threads
+    JSONValue &stages = root["stages"];
+    PODVector<unsigned> values(bakeStats_.Size());
+    unsigned long long readbackBytes = 0;
+
+    for ( unsigned i = 0; i < sizeof(bakeStages) / sizeof(bakeStages[0]); ++i )
+    {
+        for ( unsigned j = 0; j < bakeStats_.Size(); ++j )
+        {
+            values[j] = bakeStats_[j].*bakeStages[i].usec_;
+        }
+        WriteStageStats(values, stages[bakeStages[i].name_]);
+    }
+    for ( unsigned i = 0; i < bakeStats_.Size(); ++i )
+    {
+        readbackBytes += bakeStats_[i].readbackBytes_;
+    }
+
+    // once per bake
+    root["tableBuildMSec"]    = (double)tableBuildUSec_ / 1000.0;
+    root["writeTableMSec"]    = (double)writeTableUSec_ / 1000.0;
+    root["writeProbeSetMSec"] = (double)writeProbeSetUSec_ / 1000.0;
+    root["writeVolumeMSec"]   = (double)writeVolumeUSec_ / 1000.0;
+
+    JSONValue &memory = root["memory"];
+    memory["peakProbesInFlight"]  = peakInFlight_;
+    memory["peakFaceBufferBytes"] = facePool_->GetPeakInUse() * SHCubeFacesPool::GetBufferMemory(captureSettings_.faceSize_, format);
+    memory["peakCaptureBytes"]    = peakCaptureMemory_;
+    memory["readbackBytes"]       = (double)readbackBytes;
+
+    // every probe is back, but its last job may still be finishing up
+    if (jobPool_)
+    {
+        jobPool_->WaitIdle();
+    }
+
+    JSONValue &threads = root["projectionThreads"];
+    const unsigned numThreads = jobPool_ ? jobPool_->GetNumThreads() : 0;
+    const double busyMSec = jobPool_ ? (double)jobPool_->GetBusyUSec() / 1000.0 : 0.0;
+    threads["count"]       = numThreads;
+    threads["busyMSec"]    = busyMSec;
+    threads["utilisation"] = numThreads && elapsedMSec > 0.0 ? busyMSec / (numThreads * elapsedMSec) : 0.0;
+
+    File file(context_, reportFilename_, FILE_WRITE);
+    if (!file.IsOpen() || !json->Save(file))
+    {
+        URHO3D_LOGERROR("LightProbeCreator::WriteReport() failed to save " + reportFilename_);
+        return false;
+    }
+
+    return true;
 }
 
 Vector4 LightProbeCreator::WorldPositionToColor(const Vector3 &wpos) const
@@ -185,13 +610,25 @@ Vector4 LightProbeCreator::WorldPositionToColor(const Vector3 &wpos) const
 
 void LightProbeCreator::RemoveCompletedNode(Node *node)
 {
+    Node *bakedNode = NULL;
+
     if (processingNodeList_.Remove(node))
     {
+        bakedNode = node;
         ++numProcessed_;
-    }
+        bakeStats_.Push(node->GetComponent<LightProbe>()->GetBakeStats());
 
-    // send event
-    SendEventMsg();
+        // a failed probe isn't cached, the next bake captures it again
+        HashMap<Node*, unsigned long long>::ConstIterator it = probeKeys_.Find(node);
+        if (node->GetComponent<LightProbe>()->IsBakeFailed())
+        {
+            ++numFailed_;
+        }
+        else if (it != probeKeys_.End())
+        {
+            bakeCache_->Store(it->second_, node->GetComponent<LightProbe>()->GetCoeffVec());
+        }
+    }
 
     if (numProcessed_ != totalCnt_)
     {
@@ -199,21 +636,76 @@ void LightProbeCreator::RemoveCompletedNode(Node *node)
     }
     else
     {
-        WriteSHTableImage();
+        buildRequiredNodeList_.Clear();
+        buildHead_ = 0;
+
+        // the render targets aren't needed again until the next bake
+        peakCaptureMemory_ = Max(peakCaptureMemory_, capturePool_->GetMemoryUse());
+        capturePool_->ReleaseIdle();
+
+        if (captureBackend_)
+        {
+            captureBackend_->EndBake();
+        }
+
+        // write before the final event, so listeners see the saved output
+        if (numFailed_)
+        {
+            URHO3D_LOGERROR("LightProbeCreator: " + String(numFailed_) + " probes failed to bake, no output written");
+            outputWritten_ = false;
+        }
+        else
+        {
+            outputWritten_ = WriteSHTableImage();
+        }
+
+        if (!reportFilename_.Empty())
+        {
+            WriteReport();
+        }
     }
+
+    // send event
+    SendEventMsg(bakedNode);
 }
 
-void LightProbeCreator::SendEventMsg()
+void LightProbeCreator::SendEventMsg(Node *node)
 {
     using namespace LightProbeStatus;
 
-    VariantMap& eventData  = GetEventDataMap();
-    eventData[P_TOTAL]     = totalCnt_;
-    eventData[P_COMPLETED] = numProcessed_;
+    const LightProbe *lightProbe = node ? node->GetComponent<LightProbe>() : NULL;
+    const SHProbeBakeStats stats = lightProbe ? lightProbe->GetBakeStats() : SHProbeBakeStats();
+
+    VariantMap& eventData    = GetEventDataMap();
+    eventData[P_TOTAL]       = totalCnt_;
+    eventData[P_COMPLETED]   = numProcessed_;
+    eventData[P_ELAPSEDMSEC] = (unsigned)(bakeTimer_.GetUSec(false) / 1000);
+    eventData[P_NODE]        = node;
+
+    eventData[P_LEASEWAITUSEC] = stats.leaseWaitUSec_;
+    eventData[P_CAPTUREUSEC]   = stats.captureUSec_;
+    eventData[P_READBACKUSEC]  = stats.readbackUSec_;
+    eventData[P_QUEUEUSEC]     = stats.queueUSec_;
+    eventData[P_DECODEUSEC]    = stats.decodeUSec_;
+    eventData[P_PROJECTUSEC]   = stats.projectUSec_;
+    eventData[P_PROBEUSEC]     = stats.probeUSec_;
+    eventData[P_READBACKBYTES] = stats.readbackBytes_;
 
     SendEvent(E_LIGHTPROBESTATUS, eventData);
 }
 
+void LightProbeCreator::HandleCaptureEvent(StringHash eventType, VariantMap& eventData)
+{
+    using namespace SHCaptureDone;
+    Node *node = (Node*)eventData[P_NODE].GetVoidPtr();
+
+    if (processingNodeList_.Contains(node))
+    {
+        --numCapturing_;
+        QueueNodeProcess();
+    }
+}
+
 void LightProbeCreator::HandleBuildEvent(StringHash eventType, VariantMap& eventData)
 {
     using namespace SHBuildDone;
@@ -221,3 +713,16 @@ void LightProbeCreator::HandleBuildEvent(StringHash eventType, VariantMap& event
 
     RemoveCompletedNode(node);
 }
+
+void LightProbeCreator::HandleCachedBuildDone(StringHash eventType, VariantMap& eventData)
+{
+    UnsubscribeFromEvent(E_UPDATE);
+
+    outputWritten_ = WriteSHTableImage();
+
+    if (!reportFilename_.Empty())
+    {
+        WriteReport();
+    }
+    SendEventMsg();
+}
@@ -22,6 +22,15 @@
 
 #pragma once
 #include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Math/BoundingBox.h>
+
+#include "SHTableEncoder.h"
+#include "SHCubeFacesPool.h"
+#include "CubeCapture.h"
+#include "BakeJobPool.h"
+#include "LightProbe.h"
 
 using namespace Urho3D;
 namespace Urho3D
@@ -29,7 +38,8 @@ namespace Urho3D
 class Scene;
 }
 
-class LightProbe;
+class SHBakeCache;
+class SHProbeSet;
 
 //=============================================================================
 //=============================================================================
@@ -37,6 +47,17 @@ URHO3D_EVENT(E_LIGHTPROBESTATUS, LightProbeStatus)
 {
     URHO3D_PARAM(P_TOTAL, TotalCnt);        // total count
     URHO3D_PARAM(P_COMPLETED, CompleteCnt); // initial count
+    URHO3D_PARAM(P_ELAPSEDMSEC, ElapsedMSec);       // since GenerateLightProbes()
+    URHO3D_PARAM(P_NODE, Node);                     // node ptr of the probe just baked, NULL when none
+    // stats of that probe, 0 when none, see SHProbeBakeStats
+    URHO3D_PARAM(P_LEASEWAITUSEC, LeaseWaitUSec);
+    URHO3D_PARAM(P_CAPTUREUSEC, CaptureUSec);
+    URHO3D_PARAM(P_READBACKUSEC, ReadbackUSec);
+    URHO3D_PARAM(P_QUEUEUSEC, QueueUSec);
+    URHO3D_PARAM(P_DECODEUSEC, DecodeUSec);
+    URHO3D_PARAM(P_PROJECTUSEC, ProjectUSec);
+    URHO3D_PARAM(P_PROBEUSEC, ProbeUSec);
+    URHO3D_PARAM(P_READBACKBYTES, ReadbackBytes);
 }
 
 //=============================================================================
@@ -51,17 +72,70 @@ public:
 
     void Init(Scene *scene, const String& basepath);
     void SetOutputFilename(const String &outputFilename);
+    void SetSHOrder(int order);
+    int GetSHOrder() const { return shOrder_; }
+    // threads of the pool the probes are projected on, 0 uses the logical cpu count
+    void SetNumProjectionThreads(unsigned numThreads) { numProjectionThreads_ = numThreads; }
+    // probes captured at the same time. a captured probe is projected while
+    // the next ones are captured
+    void SetMaxThreads(unsigned numThreads) { maxThreads_ = Max(numThreads, 1u); }
+    // face buffers of the probes captured and not yet projected, capture waits
+    // while it's used up. at least one probe is always in flight
+    void SetProjectionMemoryBudget(unsigned bytes) { projectionMemoryBudget_ = bytes; }
+    unsigned GetProjectionMemoryBudget() const { return projectionMemoryBudget_; }
+    void SetSRGBInput(bool sRGB) { sRGBInput_ = sRGB; }
+    void SetHDRCapture(bool hdr) { hdrCapture_ = hdr; }
+    void SetTableEncoding(SHTableEncoding encoding) { tableEncoding_ = encoding; }
+
+    // gpu memory all probe captures share, captures beyond it wait their turn
+    void SetCaptureMemoryBudget(unsigned bytes) { capturePool_->SetMemoryBudget(bytes); }
+    void SetCaptureSettings(const CubeCaptureSettings &settings) { captureSettings_ = settings; }
+    const CubeCaptureSettings& GetCaptureSettings() const { return captureSettings_; }
+
+    // renders the probe faces on the cpu instead, NULL uses the gpu
+    void SetCaptureBackend(CaptureBackend *backend) { captureBackend_ = backend; }
+
+    // unchanged probes are loaded from the bake cache, empty dir disables it.
+    // content beyond the influence radius doesn't invalidate a probe, 0 uses
+    // the capture's max far clip since nothing further out is rendered
+    void SetBakeCacheDir(const String &cacheDir);
+    void SetCacheInfluenceRadius(float radius) { cacheInfluenceRadius_ = radius; }
+
+    // the probes are also resampled into an irradiance volume (.shvol) next to
+    // the table. a cell size of 0 skips it and deletes an old one, undefined
+    // bounds use the probe bounds
+    void SetVolumeCellSize(float cellSize) { volumeCellSize_ = Max(cellSize, 0.0f); }
+    float GetVolumeCellSize() const { return volumeCellSize_; }
+    void SetVolumeBounds(const BoundingBox &bounds) { volumeBounds_ = bounds; }
+    const BoundingBox& GetVolumeBounds() const { return volumeBounds_; }
     void GenerateLightProbes();
     int GetSHProbeTextureWidth() const { return shProbeTextureWidth_; }
 
+    // json report of the stage timings, memory and thread use, written with
+    // the output before the final status event. empty skips it
+    void SetReportFilename(const String &reportFilename) { reportFilename_ = reportFilename; }
+    const String& GetReportFilename() const { return reportFilename_; }
+
+    // after the final status event: whether the table, layout and probe set
+    // were saved. nothing is written when a probe failed to bake
+    bool IsOutputWritten() const { return outputWritten_; }
+    const String& GetOutputFilename() const { return outputFilename_; }
+    SHBakeCache* GetBakeCache() const { return bakeCache_; }
+
 protected:
     unsigned ParseLightProbesInScene();
+    void AssignProbeIDs(const PODVector<Node*> &nodes);
     void QueueNodeProcess();
     void StartSHBuild(Node *node);
-    void WriteSHTableImage();
+    bool WriteSHTableImage();
+    bool WriteProbeSet(const String &filename);
+    bool WriteIrradianceVolume(SHProbeSet *probeSet, const String &filename);
+    bool WriteReport();
     void RemoveCompletedNode(Node *node);
-    void SendEventMsg();
+    void SendEventMsg(Node *node = NULL);
+    void HandleCaptureEvent(StringHash eventType, VariantMap& eventData);
     void HandleBuildEvent(StringHash eventType, VariantMap& eventData);
+    void HandleCachedBuildDone(StringHash eventType, VariantMap& eventData);
 
 protected:
     Vector4 WorldPositionToColor(const Vector3 &wpos) const;
@@ -72,15 +146,52 @@ protected:
     String basepath_;
     String outputFilename_;
     int shProbeTextureWidth_;
+    int shOrder_;
     float worldPreScaler_;
 
     PODVector<Node*> buildRequiredNodeList_;
     PODVector<Node*> origNodeList_;
     PODVector<Node*> processingNodeList_;
+    unsigned buildHead_;
 
     unsigned totalCnt_;
     unsigned numProcessed_;
+    unsigned numFailed_;
+    unsigned numCapturing_;
     unsigned maxThreads_;
+    unsigned maxInFlight_;
+    unsigned projectionMemoryBudget_;
+    unsigned numProjectionThreads_;
+    bool sRGBInput_;
+    bool hdrCapture_;
+    SHTableEncoding tableEncoding_;
+    SharedPtr<SHCubeFacesPool> facePool_;
+    SharedPtr<BakeJobPool> jobPool_;
+    SharedPtr<CubeCapturePool> capturePool_;
+    CubeCaptureSettings captureSettings_;
+    SharedPtr<CaptureBackend> captureBackend_;
+
+    // bake cache
+    SharedPtr<SHBakeCache> bakeCache_;
+    HashMap<Node*, unsigned long long> probeKeys_;
+    float cacheInfluenceRadius_;
+
+    // irradiance volume
+    float volumeCellSize_;
+    BoundingBox volumeBounds_;
+
+    bool outputWritten_;
+
+    // stats
+    String reportFilename_;
+    HiresTimer bakeTimer_;
+    PODVector<SHProbeBakeStats> bakeStats_;
+    unsigned peakInFlight_;
+    unsigned peakCaptureMemory_;
+    long long tableBuildUSec_;
+    long long writeTableUSec_;
+    long long writeProbeSetUSec_;
+    long long writeVolumeUSec_;
 };
 
 
@@ -0,0 +1,68 @@
+#
+# Copyright (c) 2008-2016 the Urho3D project.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+
+# Sources of the 77_LightProbe sample shared with the baker and the benchmarks
+set (LIGHTPROBE_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+# The decode and projection sources, what the benchmarks measure
+set (LIGHTPROBE_PROJECTION_SOURCES BakeJobPool SHTileProjector CubeTexelTable SHProjection SHProjectionAVX2 SHProjectionKernel
+    SHFaceDecoder SHFaceDecoderF16C SHBasis)
+
+# Macro for listing 77_LightProbe sources, all but the demo app when no names are given
+# Macro arguments:
+#  CPP_VAR - variable set to the .cpp files
+#  H_VAR - variable set to the .h files
+#  ARGN - file names without extension
+# Usage:
+#  lightprobe_sources (LIGHTPROBE_CPP_FILES LIGHTPROBE_H_FILES ${LIGHTPROBE_PROJECTION_SOURCES} ProbeSpatialIndex)
+macro (lightprobe_sources CPP_VAR H_VAR)
+    set (${CPP_VAR})
+    set (${H_VAR})
+    if (${ARGC} GREATER 2)
+        foreach (NAME ${ARGN})
+            if (EXISTS ${LIGHTPROBE_DIR}/${NAME}.cpp)
+                list (APPEND ${CPP_VAR} ${LIGHTPROBE_DIR}/${NAME}.cpp)
+            endif ()
+            if (EXISTS ${LIGHTPROBE_DIR}/${NAME}.h)
+                list (APPEND ${H_VAR} ${LIGHTPROBE_DIR}/${NAME}.h)
+            endif ()
+        endforeach ()
+    else ()
+        file (GLOB ${CPP_VAR} ${LIGHTPROBE_DIR}/*.cpp)
+        file (GLOB ${H_VAR} ${LIGHTPROBE_DIR}/*.h)
+        list (REMOVE_ITEM ${CPP_VAR} ${LIGHTPROBE_DIR}/CharacterDemo.cpp ${LIGHTPROBE_DIR}/Character.cpp)
+        list (REMOVE_ITEM ${H_VAR} ${LIGHTPROBE_DIR}/CharacterDemo.h ${LIGHTPROBE_DIR}/Character.h)
+    endif ()
+endmacro ()
+
+# Macro for compiling the AVX2 sh projection kernel and the F16C half float decoder on their own, they are picked at runtime
+# Must be called from the directory defining the target
+macro (lightprobe_simd_flags)
+    if (URHO3D_SSE)
+        if (MSVC)
+            set_source_files_properties (${LIGHTPROBE_DIR}/SHProjectionAVX2.cpp ${LIGHTPROBE_DIR}/SHFaceDecoderF16C.cpp PROPERTIES COMPILE_FLAGS /arch:AVX2)
+        else ()
+            set_source_files_properties (${LIGHTPROBE_DIR}/SHProjectionAVX2.cpp PROPERTIES COMPILE_FLAGS -mavx2)
+            set_source_files_properties (${LIGHTPROBE_DIR}/SHFaceDecoderF16C.cpp PROPERTIES COMPILE_FLAGS "-mavx -mf16c")
+        endif ()
+    endif ()
+endmacro ()
@@ -0,0 +1,57 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/Str.h>
+
+using namespace Urho3D;
+
+//=============================================================================
+// read-only memory mapping of a whole file. the view stays valid until
+// Close() or destruction, pages are brought in by the os on first touch
+//=============================================================================
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool Open(const String &fileName);
+    void Close();
+
+    bool IsOpen() const                 { return data_ != NULL; }
+    const unsigned char* GetData() const { return data_; }
+    unsigned GetSize() const            { return size_; }
+
+private:
+    // non-copyable, the view is owned
+    MappedFile(const MappedFile&);
+    MappedFile& operator =(const MappedFile&);
+
+    const unsigned char *data_;
+    unsigned size_;
+#ifdef _WIN32
+    void *fileHandle_;
+    void *mappingHandle_;
+#endif
+};
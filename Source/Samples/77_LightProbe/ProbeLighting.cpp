@@ -0,0 +1,349 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/Drawable.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/StaticModel.h>
+
+#include "ProbeLighting.h"
+#include "ProbeSpatialIndex.h"
+
+#include <cstring>
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+// fewer moved drawables than this are resolved on the main thread
+#define PARALLEL_MIN_ENTRIES    64
+#define ENTRIES_PER_WORK_ITEM   32
+
+//=============================================================================
+//=============================================================================
+ProbeLighting::ProbeLighting(Context* context)
+    : Object(context)
+    , tetraMesh_(NULL)
+    , uploadSHCoeffs_(true)
+    , moveThreshold_(0.05f)
+    , maxProbeDistance_(15.0f)
+    , numResolved_(0)
+{
+    SubscribeToEvent(E_POSTUPDATE, URHO3D_HANDLER(ProbeLighting, HandlePostUpdate));
+}
+
+ProbeLighting::~ProbeLighting()
+{
+}
+
+void ProbeLighting::SetProbeSet(SHProbeSet *probeSet)
+{
+    probeSet_ = probeSet;
+
+    // built here on the main thread, the workers only read them
+    spatialIndex_ = probeSet_ ? probeSet_->GetSpatialIndex() : NULL;
+    tetraMesh_ = (probeSet_ && !probeSet_->GetTetraMesh().IsEmpty()) ? &probeSet_->GetTetraMesh() : NULL;
+
+    for ( unsigned i = 0; i < entries_.Size(); ++i )
+    {
+        entries_[i].resolved_ = false;
+        entries_[i].tetra_ = -1;
+    }
+}
+
+void ProbeLighting::SetProbePositions(const PODVector<Vector3> &positions)
+{
+    probeSet_.Reset();
+    tetraMesh_ = NULL;
+
+    spatialIndex_ = new ProbeSpatialIndex();
+    if (positions.Size())
+    {
+        spatialIndex_->Build(&positions[0], positions.Size());
+    }
+
+    for ( unsigned i = 0; i < entries_.Size(); ++i )
+    {
+        entries_[i].resolved_ = false;
+    }
+}
+
+void ProbeLighting::AddDrawable(Drawable *drawable, bool cloneMaterials)
+{
+    if (drawable == NULL)
+        return;
+
+    for ( unsigned i = 0; i < entries_.Size(); ++i )
+    {
+        if (entries_[i].drawable_ == drawable)
+            return;
+    }
+
+    Entry entry;
+    entry.drawable_ = drawable;
+    entry.resolved_ = false;
+    entry.tetra_ = -1;
+    entry.nearest_ = -1;
+    entry.changed_ = false;
+
+    // only models can take a material per batch
+    StaticModel *model = (cloneMaterials && drawable->IsInstanceOf<StaticModel>()) ? static_cast<StaticModel*>(drawable) : NULL;
+    const Vector<SourceBatch> &batches = drawable->GetBatches();
+    PODVector<Material*> originals;
+
+    for ( unsigned i = 0; i < batches.Size(); ++i )
+    {
+        Material *material = batches[i].material_;
+
+        if (material == NULL)
+            continue;
+
+        // batches sharing a material share its clone too
+        unsigned index = originals.IndexOf(material);
+        if (index == originals.Size())
+        {
+            originals.Push(material);
+            entry.materials_.Push(model ? material->Clone() : SharedPtr<Material>(material));
+        }
+
+        if (model)
+        {
+            model->SetMaterial(i, entry.materials_[index]);
+        }
+    }
+
+    entries_.Push(entry);
+}
+
+void ProbeLighting::RemoveDrawable(Drawable *drawable)
+{
+    for ( unsigned i = 0; i < entries_.Size(); ++i )
+    {
+        if (entries_[i].drawable_ == drawable)
+        {
+            entries_[i] = entries_.Back();
+            entries_.Pop();
+            return;
+        }
+    }
+}
+
+String ProbeLighting::GetShaderDefines() const
+{
+    String defines;
+
+    if (uploadSHCoeffs_ && probeSet_)
+    {
+        defines += "SH_UNIFORMS ";
+    }
+    if (tetraMesh_)
+    {
+        defines += "SH_TETRA ";
+    }
+
+    return defines;
+}
+
+void ProbeLighting::Update()
+{
+    numResolved_ = 0;
+
+    if (spatialIndex_ == NULL || spatialIndex_->GetNumProbes() == 0)
+        return;
+
+    // gather what moved, dropping drawables that were destroyed
+    const float thresholdSq = moveThreshold_ * moveThreshold_;
+    moved_.Clear();
+
+    for ( unsigned i = 0; i < entries_.Size(); )
+    {
+        Entry &entry = entries_[i];
+        Drawable *drawable = entry.drawable_;
+
+        if (drawable == NULL)
+        {
+            entry = entries_.Back();
+            entries_.Pop();
+            continue;
+        }
+
+        if (drawable->IsEnabledEffective())
+        {
+            // the box center, a character's node is at its feet
+            const Vector3 position = drawable->GetWorldBoundingBox().Center();
+
+            if (!entry.resolved_ || (position - entry.position_).LengthSquared() > thresholdSq)
+            {
+                entry.position_ = position;
+                moved_.Push(i);
+            }
+        }
+
+        ++i;
+    }
+
+    if (moved_.Empty())
+        return;
+
+    // the lookups only read the probe set, so batches of them run on the
+    // work queue threads with the main thread helping out
+    WorkQueue *queue = GetSubsystem<WorkQueue>();
+
+    if (queue && queue->GetNumThreads() && moved_.Size() >= PARALLEL_MIN_ENTRIES)
+    {
+        for ( unsigned begin = 0; begin < moved_.Size(); begin += ENTRIES_PER_WORK_ITEM )
+        {
+            const unsigned end = Min(begin + ENTRIES_PER_WORK_ITEM, moved_.Size());
+
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = ResolveWork;
+            item->aux_ = this;
+            item->start_ = &moved_[0] + begin;
+            item->end_ = &moved_[0] + end;
+            queue->AddWorkItem(item);
+        }
+
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+    else
+    {
+        ResolveEntries(0, moved_.Size());
+    }
+
+    // materials aren't thread safe, set them in one pass here
+    for ( unsigned i = 0; i < moved_.Size(); ++i )
+    {
+        Entry &entry = entries_[moved_[i]];
+
+        if (entry.changed_)
+        {
+            ApplyEntry(entry);
+        }
+    }
+
+    numResolved_ = moved_.Size();
+}
+
+void ProbeLighting::ResolveWork(const WorkItem *item, unsigned threadIndex)
+{
+    ProbeLighting *lighting = (ProbeLighting*)item->aux_;
+    const unsigned *end = (const unsigned*)item->end_;
+
+    for ( const unsigned *index = (const unsigned*)item->start_; index < end; ++index )
+    {
+        lighting->ResolveEntry(lighting->entries_[*index]);
+    }
+}
+
+void ProbeLighting::ResolveEntries(unsigned begin, unsigned end)
+{
+    for ( unsigned i = begin; i < end; ++i )
+    {
+        ResolveEntry(entries_[moved_[i]]);
+    }
+}
+
+void ProbeLighting::ResolveEntry(Entry &entry) const
+{
+    unsigned probes[4] = { 0, 0, 0, 0 };
+    float weights[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    unsigned count = 4;
+
+    if (tetraMesh_)
+    {
+        // from last time's tetrahedron, a step or two for a moving drawable
+        entry.tetra_ = tetraMesh_->Locate(entry.position_, entry.tetra_, probes, weights);
+    }
+    else
+    {
+        // no probe in range gets zero weight
+        entry.nearest_ = spatialIndex_->FindNearest(entry.position_, maxProbeDistance_);
+        probes[0] = (unsigned)Max(entry.nearest_, 0);
+        weights[0] = entry.nearest_ > -1 ? 1.0f : 0.0f;
+        count = 1;
+    }
+
+    entry.changed_ = !entry.resolved_ || memcmp(probes, entry.probes_, sizeof(probes)) != 0 ||
+                     memcmp(weights, entry.weights_, sizeof(weights)) != 0;
+    entry.resolved_ = true;
+
+    if (entry.changed_)
+    {
+        memcpy(entry.probes_, probes, sizeof(probes));
+        memcpy(entry.weights_, weights, sizeof(weights));
+
+        if (uploadSHCoeffs_ && probeSet_)
+        {
+            probeSet_->BlendIrradianceCoeffs(probes, weights, count, entry.coeffs_);
+        }
+    }
+}
+
+void ProbeLighting::ApplyEntry(Entry &entry) const
+{
+    const bool upload = uploadSHCoeffs_ && probeSet_;
+    Variant coeffs;
+
+    if (upload)
+    {
+        // whole vec4s, the L1 array is shorter
+        const unsigned size = ((probeSet_->GetNumIrradianceCoeffs() * 3 + 3) & ~3u) * sizeof(float);
+        coeffs = PODVector<unsigned char>((const unsigned char*)entry.coeffs_, size);
+    }
+
+    for ( unsigned i = 0; i < entry.materials_.Size(); ++i )
+    {
+        Material *material = entry.materials_[i];
+
+        if (upload)
+        {
+            material->SetShaderParameter("SHCoeffs", coeffs);
+        }
+        else if (tetraMesh_)
+        {
+            const unsigned *probes = entry.probes_;
+            material->SetShaderParameter("ProbeIndex", (float)probes[0]);
+            material->SetShaderParameter("ProbeIndices", Vector4((float)probes[0], (float)probes[1], (float)probes[2], (float)probes[3]));
+            material->SetShaderParameter("ProbeWeights", Vector4(entry.weights_));
+        }
+        else
+        {
+            material->SetShaderParameter("ProbeIndex", (float)entry.nearest_);
+        }
+
+        // the single probe path fades with the distance to it
+        if (tetraMesh_ == NULL)
+        {
+            material->SetShaderParameter("ProbePosition", entry.nearest_ > -1 ? spatialIndex_->GetPosition(entry.nearest_) : Vector3::ZERO);
+        }
+    }
+
+    entry.changed_ = false;
+}
+
+void ProbeLighting::HandlePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+    Update();
+}
@@ -0,0 +1,133 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector3.h>
+
+#include "SHProbeSet.h"
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Drawable;
+class Material;
+struct WorkItem;
+}
+
+class ProbeSpatialIndex;
+
+//=============================================================================
+// lights any number of dynamic drawables from the baked probes. once per
+// frame, after the scene update, it gathers the drawables that moved,
+// resolves their probes in batches on the work queue threads and then sets
+// the results on their materials in one pass on the main thread, so a
+// drawable that stands still costs a position compare.
+//
+// what a material gets follows the probe set: the four probes around it with
+// barycentric weights when the set has tetrahedra (SH_TETRA), else the
+// nearest probe in range. with coeff upload on, the blend is done here and
+// sent as SHCoeffs (SH_UNIFORMS). GetShaderDefines() has the defines to add
+// to the lit materials
+//=============================================================================
+class ProbeLighting : public Object
+{
+    URHO3D_OBJECT(ProbeLighting, Object);
+
+public:
+    ProbeLighting(Context* context);
+    virtual ~ProbeLighting();
+
+    void SetProbeSet(SHProbeSet *probeSet);
+    SHProbeSet* GetProbeSet() const                 { return probeSet_; }
+
+    // nearest probe lighting without a probe set, slot i is table slot i
+    void SetProbePositions(const PODVector<Vector3> &positions);
+
+    void SetUploadSHCoeffs(bool upload)             { uploadSHCoeffs_ = upload; }
+    bool GetUploadSHCoeffs() const                  { return uploadSHCoeffs_; }
+
+    // a drawable is resolved again once it moved further than this
+    void SetMoveThreshold(float distance)           { moveThreshold_ = Max(distance, 0.0f); }
+    float GetMoveThreshold() const                  { return moveThreshold_; }
+
+    // range of the nearest probe lookup, sets with tetrahedra don't use it
+    void SetMaxProbeDistance(float distance)        { maxProbeDistance_ = distance; }
+    float GetMaxProbeDistance() const               { return maxProbeDistance_; }
+
+    // the drawable's batch materials are cloned so their params are its own,
+    // pass false if they already are. shared materials take the values of
+    // whichever drawable using them was set last
+    void AddDrawable(Drawable *drawable, bool cloneMaterials = true);
+    void RemoveDrawable(Drawable *drawable);
+    unsigned GetNumDrawables() const                { return entries_.Size(); }
+
+    // pixel shader defines for the lit materials, on top of the table layout's
+    String GetShaderDefines() const;
+
+    // drawables resolved in the last update
+    unsigned GetNumResolved() const                 { return numResolved_; }
+
+    // resolves and sets the params of every drawable that moved, the
+    // post update handler calls this
+    void Update();
+
+protected:
+    struct Entry
+    {
+        WeakPtr<Drawable> drawable_;
+        Vector<SharedPtr<Material> > materials_;
+        Vector3 position_;
+        bool resolved_;
+
+        // results
+        int tetra_;
+        int nearest_;
+        unsigned probes_[4];
+        float weights_[4];
+        float coeffs_[SHProbeSet::MAX_IRRADIANCE_FLOATS];
+        bool changed_;
+    };
+
+    void ResolveEntries(unsigned begin, unsigned end);
+    void ResolveEntry(Entry &entry) const;
+    void ApplyEntry(Entry &entry) const;
+    void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
+
+    static void ResolveWork(const WorkItem *item, unsigned threadIndex);
+
+protected:
+    SharedPtr<SHProbeSet> probeSet_;
+    SharedPtr<ProbeSpatialIndex> spatialIndex_;
+    const ProbeTetraMesh *tetraMesh_;
+
+    bool uploadSHCoeffs_;
+    float moveThreshold_;
+    float maxProbeDistance_;
+
+    Vector<Entry> entries_;
+    PODVector<unsigned> moved_;
+    unsigned numResolved_;
+};
@@ -0,0 +1,389 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Math/MathDefs.h>
+
+#include "ProbeSpatialIndex.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+#define DEFAULT_CELL_SIZE       4.0f
+#define PROBES_PER_CELL         2.0f
+#define MIN_BUCKETS             16
+
+// below this many slots a plain scan beats walking the cells
+#define LINEAR_SCAN_SLOTS       32
+
+//=============================================================================
+//=============================================================================
+ProbeSpatialIndex::ProbeSpatialIndex()
+    : cellSize_(DEFAULT_CELL_SIZE)
+    , invCellSize_(1.0f / DEFAULT_CELL_SIZE)
+    , numProbes_(0)
+    , bucketMask_(0)
+{
+    Clear();
+}
+
+ProbeSpatialIndex::~ProbeSpatialIndex()
+{
+}
+
+void ProbeSpatialIndex::Build(const Vector3 *positions, unsigned count, unsigned stride, float cellSize)
+{
+    Clear();
+
+    const unsigned char *src = reinterpret_cast<const unsigned char*>(positions);
+
+    if (cellSize <= 0.0f && count > 0)
+    {
+        BoundingBox bounds;
+        for ( unsigned i = 0; i < count; ++i )
+        {
+            bounds.Merge(*reinterpret_cast<const Vector3*>(src + i * stride));
+        }
+
+        // size cells for a few probes each, over the axes the probes spread
+        // along, so a flat layout doesn't end up with huge cells
+        const Vector3 size = bounds.Size();
+        const float maxSize = Max(size.x_, Max(size.y_, size.z_));
+        float volume = 1.0f;
+        int numAxes = 0;
+
+        for ( int i = 0; i < 3; ++i )
+        {
+            if (size.Data()[i] > maxSize * 0.01f)
+            {
+                volume *= size.Data()[i];
+                ++numAxes;
+            }
+        }
+
+        cellSize = numAxes ? powf(volume * PROBES_PER_CELL / (float)count, 1.0f / (float)numAxes) : DEFAULT_CELL_SIZE;
+    }
+
+    if (cellSize > 0.0f)
+    {
+        cellSize_ = cellSize;
+        invCellSize_ = 1.0f / cellSize;
+    }
+
+    // buckets first, there's nothing to relink yet
+    Rehash(count);
+    positions_.Resize(count);
+    cells_.Resize(count);
+    next_.Resize(count);
+
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        positions_[i] = *reinterpret_cast<const Vector3*>(src + i * stride);
+        cells_[i] = GetCell(positions_[i]);
+        InsertIntoBucket(i);
+    }
+}
+
+void ProbeSpatialIndex::Clear()
+{
+    positions_.Clear();
+    cells_.Clear();
+    next_.Clear();
+    buckets_.Clear();
+    bucketMask_ = 0;
+    numProbes_ = 0;
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        minCell_[i] = M_MAX_INT;
+        maxCell_[i] = M_MIN_INT;
+    }
+}
+
+void ProbeSpatialIndex::Insert(unsigned slot, const Vector3 &position)
+{
+    if (Contains(slot))
+    {
+        Remove(slot);
+    }
+
+    if (slot >= cells_.Size())
+    {
+        const unsigned oldSize = cells_.Size();
+        positions_.Resize(slot + 1);
+        cells_.Resize(slot + 1);
+        next_.Resize(slot + 1);
+
+        for ( unsigned i = oldSize; i < cells_.Size(); ++i )
+        {
+            cells_[i].used_ = false;
+        }
+    }
+
+    if (numProbes_ + 1 > buckets_.Size())
+    {
+        Rehash(numProbes_ + 1);
+    }
+
+    positions_[slot] = position;
+    cells_[slot] = GetCell(position);
+    InsertIntoBucket(slot);
+}
+
+bool ProbeSpatialIndex::Remove(unsigned slot)
+{
+    if (!Contains(slot))
+        return false;
+
+    const CellCoord &cell = cells_[slot];
+    unsigned *link = &buckets_[GetBucket(cell.x_, cell.y_, cell.z_)];
+
+    while (*link != slot)
+    {
+        link = &next_[*link];
+    }
+
+    *link = next_[slot];
+    cells_[slot].used_ = false;
+    --numProbes_;
+
+    return true;
+}
+
+int ProbeSpatialIndex::FindNearest(const Vector3 &position, float maxDist) const
+{
+    unsigned slot;
+    float distSq;
+
+    return FindNearest(position, 1, &slot, &distSq, maxDist) ? (int)slot : -1;
+}
+
+unsigned ProbeSpatialIndex::FindNearest(const Vector3 &position, unsigned k, unsigned *slots, float *distSq, float maxDist) const
+{
+    if (numProbes_ == 0 || k == 0)
+        return 0;
+
+    float maxDistSq = maxDist < M_INFINITY ? maxDist * maxDist : M_INFINITY;
+    unsigned count = 0;
+
+    if (cells_.Size() <= LINEAR_SCAN_SLOTS)
+    {
+        for ( unsigned slot = 0; slot < cells_.Size(); ++slot )
+        {
+            if (cells_[slot].used_)
+            {
+                AddCandidate(slot, (positions_[slot] - position).LengthSquared(), k, slots, distSq, count, maxDistSq);
+            }
+        }
+
+        return count;
+    }
+
+    const CellCoord c = GetCell(position);
+    const int center[3] = { c.x_, c.y_, c.z_ };
+
+    // rings of cells around the query cell, nothing lies outside the probe cell range
+    int firstRing = 0;
+    int lastRing = 0;
+    for ( int i = 0; i < 3; ++i )
+    {
+        firstRing = Max(firstRing, Max(minCell_[i] - center[i], center[i] - maxCell_[i]));
+        lastRing = Max(lastRing, Max(center[i] - minCell_[i], maxCell_[i] - center[i]));
+    }
+
+    for ( int r = firstRing; r <= lastRing; ++r )
+    {
+        // probes in ring r lie outside the box of the rings before it
+        if (r > 0)
+        {
+            float ringDist = M_INFINITY;
+            for ( int i = 0; i < 3; ++i )
+            {
+                const float p = position.Data()[i];
+                ringDist = Min(ringDist, Min(p - (float)(center[i] - r + 1) * cellSize_, (float)(center[i] + r) * cellSize_ - p));
+            }
+
+            if (ringDist * ringDist >= maxDistSq)
+                break;
+        }
+
+        const int x0 = Max(c.x_ - r, minCell_[0]), x1 = Min(c.x_ + r, maxCell_[0]);
+        const int y0 = Max(c.y_ - r, minCell_[1]), y1 = Min(c.y_ + r, maxCell_[1]);
+        const int z0 = Max(c.z_ - r, minCell_[2]), z1 = Min(c.z_ + r, maxCell_[2]);
+
+        for ( int x = x0; x <= x1; ++x )
+        {
+            const bool xEdge = x == c.x_ - r || x == c.x_ + r;
+
+            for ( int y = y0; y <= y1; ++y )
+            {
+                if (xEdge || y == c.y_ - r || y == c.y_ + r)
+                {
+                    for ( int z = z0; z <= z1; ++z )
+                    {
+                        VisitCell(x, y, z, position, k, slots, distSq, count, maxDistSq);
+                    }
+                }
+                else
+                {
+                    // inside the shell only the two z caps belong to this ring
+                    if (c.z_ - r >= z0)
+                        VisitCell(x, y, c.z_ - r, position, k, slots, distSq, count, maxDistSq);
+                    if (c.z_ + r <= z1)
+                        VisitCell(x, y, c.z_ + r, position, k, slots, distSq, count, maxDistSq);
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+void ProbeSpatialIndex::FindInRadius(const Vector3 &position, float radius, PODVector<unsigned> &result) const
+{
+    result.Clear();
+
+    if (numProbes_ == 0 || radius < 0.0f)
+        return;
+
+    const CellCoord c0 = GetCell(position - Vector3(radius, radius, radius));
+    const CellCoord c1 = GetCell(position + Vector3(radius, radius, radius));
+    const float radiusSq = radius * radius;
+
+    for ( int x = Max(c0.x_, minCell_[0]); x <= Min(c1.x_, maxCell_[0]); ++x )
+    {
+        for ( int y = Max(c0.y_, minCell_[1]); y <= Min(c1.y_, maxCell_[1]); ++y )
+        {
+            for ( int z = Max(c0.z_, minCell_[2]); z <= Min(c1.z_, maxCell_[2]); ++z )
+            {
+                for ( unsigned slot = buckets_[GetBucket(x, y, z)]; slot != NONE; slot = next_[slot] )
+                {
+                    const CellCoord &cell = cells_[slot];
+
+                    // buckets are shared with other cells
+                    if (cell.x_ == x && cell.y_ == y && cell.z_ == z &&
+                        (positions_[slot] - position).LengthSquared() <= radiusSq)
+                    {
+                        result.Push(slot);
+                    }
+                }
+            }
+        }
+    }
+}
+
+ProbeSpatialIndex::CellCoord ProbeSpatialIndex::GetCell(const Vector3 &position) const
+{
+    // keep far off queries in int range
+    const float limit = (float)(1 << 28);
+    CellCoord cell;
+    cell.x_ = FloorToInt(Clamp(position.x_ * invCellSize_, -limit, limit));
+    cell.y_ = FloorToInt(Clamp(position.y_ * invCellSize_, -limit, limit));
+    cell.z_ = FloorToInt(Clamp(position.z_ * invCellSize_, -limit, limit));
+    cell.used_ = true;
+
+    return cell;
+}
+
+unsigned ProbeSpatialIndex::GetBucket(int x, int y, int z) const
+{
+    return ((unsigned)x * 73856093u ^ (unsigned)y * 19349663u ^ (unsigned)z * 83492791u) & bucketMask_;
+}
+
+void ProbeSpatialIndex::InsertIntoBucket(unsigned slot)
+{
+    const CellCoord &cell = cells_[slot];
+    unsigned &head = buckets_[GetBucket(cell.x_, cell.y_, cell.z_)];
+
+    next_[slot] = head;
+    head = slot;
+    ++numProbes_;
+
+    minCell_[0] = Min(minCell_[0], cell.x_);
+    minCell_[1] = Min(minCell_[1], cell.y_);
+    minCell_[2] = Min(minCell_[2], cell.z_);
+    maxCell_[0] = Max(maxCell_[0], cell.x_);
+    maxCell_[1] = Max(maxCell_[1], cell.y_);
+    maxCell_[2] = Max(maxCell_[2], cell.z_);
+}
+
+void ProbeSpatialIndex::Rehash(unsigned numBuckets)
+{
+    numBuckets = NextPowerOfTwo(Max(numBuckets, (unsigned)MIN_BUCKETS));
+    if (numBuckets == buckets_.Size())
+        return;
+
+    buckets_.Resize(numBuckets);
+    bucketMask_ = numBuckets - 1;
+
+    for ( unsigned i = 0; i < numBuckets; ++i )
+    {
+        buckets_[i] = NONE;
+    }
+
+    // relink what's already in
+    numProbes_ = 0;
+    for ( unsigned i = 0; i < cells_.Size(); ++i )
+    {
+        if (cells_[i].used_)
+        {
+            InsertIntoBucket(i);
+        }
+    }
+}
+
+void ProbeSpatialIndex::VisitCell(int x, int y, int z, const Vector3 &position, unsigned k, unsigned *slots, float *distSq,
+                                  unsigned &count, float &maxDistSq) const
+{
+    for ( unsigned slot = buckets_[GetBucket(x, y, z)]; slot != NONE; slot = next_[slot] )
+    {
+        const CellCoord &cell = cells_[slot];
+        if (cell.x_ != x || cell.y_ != y || cell.z_ != z)
+            continue;
+
+        AddCandidate(slot, (positions_[slot] - position).LengthSquared(), k, slots, distSq, count, maxDistSq);
+    }
+}
+
+void ProbeSpatialIndex::AddCandidate(unsigned slot, float d, unsigned k, unsigned *slots, float *distSq,
+                                     unsigned &count, float &maxDistSq) const
+{
+    if (d >= maxDistSq)
+        return;
+
+    // insertion into the sorted k best, the last one drops off when full
+    unsigned i = count < k ? count++ : k - 1;
+    while (i > 0 && distSq[i - 1] > d)
+    {
+        slots[i] = slots[i - 1];
+        distSq[i] = distSq[i - 1];
+        --i;
+    }
+    slots[i] = slot;
+    distSq[i] = d;
+
+    // once full, only closer probes are of interest
+    if (count == k)
+    {
+        maxDistSq = distSq[k - 1];
+    }
+}
@@ -0,0 +1,104 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+
+//=============================================================================
+// uniform hash grid over probe positions for nearest and radius queries.
+// probes are addressed by their slot (table index), each cell bucket is a
+// linked list through the slots, so inserting and removing a probe doesn't
+// touch the others. queries don't allocate: results go into caller arrays,
+// or a caller owned vector that keeps its capacity between calls
+//=============================================================================
+class ProbeSpatialIndex : public RefCounted
+{
+public:
+    ProbeSpatialIndex();
+    virtual ~ProbeSpatialIndex();
+
+    // replaces the content with count probes, slot i at positions[i]. the
+    // positions are stride bytes apart, a cellSize <= 0 picks one from the
+    // probe density
+    void Build(const Vector3 *positions, unsigned count, unsigned stride = sizeof(Vector3), float cellSize = 0.0f);
+    void Clear();
+
+    // slots don't need to be contiguous, inserting an existing slot moves it
+    void Insert(unsigned slot, const Vector3 &position);
+    bool Remove(unsigned slot);
+
+    // nearest probe within maxDist, -1 if there's none
+    int FindNearest(const Vector3 &position, float maxDist = M_INFINITY) const;
+    // up to k nearest probes within maxDist, closest first. returns the count
+    // written to slots, with their squared distances in distSq
+    unsigned FindNearest(const Vector3 &position, unsigned k, unsigned *slots, float *distSq, float maxDist = M_INFINITY) const;
+    // all probes within radius, in no particular order
+    void FindInRadius(const Vector3 &position, float radius, PODVector<unsigned> &result) const;
+
+    unsigned GetNumProbes() const       { return numProbes_; }
+    float GetCellSize() const           { return cellSize_; }
+    bool Contains(unsigned slot) const  { return slot < cells_.Size() && cells_[slot].used_; }
+    const Vector3& GetPosition(unsigned slot) const { return positions_[slot]; }
+
+protected:
+    struct CellCoord
+    {
+        int x_;
+        int y_;
+        int z_;
+        bool used_;
+    };
+
+    CellCoord GetCell(const Vector3 &position) const;
+    unsigned GetBucket(int x, int y, int z) const;
+    void InsertIntoBucket(unsigned slot);
+    void Rehash(unsigned numBuckets);
+    void VisitCell(int x, int y, int z, const Vector3 &position, unsigned k, unsigned *slots, float *distSq,
+                   unsigned &count, float &maxDistSq) const;
+    void AddCandidate(unsigned slot, float d, unsigned k, unsigned *slots, float *distSq, unsigned &count, float &maxDistSq) const;
+
+protected:
+    float cellSize_;
+    float invCellSize_;
+    unsigned numProbes_;
+
+    // per slot
+    PODVector<Vector3> positions_;
+    PODVector<CellCoord> cells_;
+    PODVector<unsigned> next_;
+
+    // per bucket, first slot or NONE
+    PODVector<unsigned> buckets_;
+    unsigned bucketMask_;
+
+    // cell range holding probes, only grows until the next Build()/Clear()
+    int minCell_[3];
+    int maxCell_[3];
+
+    static const unsigned NONE = 0xffffffff;
+};
@@ -0,0 +1,606 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Container/Swap.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#include "ProbeTetraMesh.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+// relative size of the offsets that break up co-spherical layouts such as grids
+#define BUILD_JITTER            1e-5
+// thinner than this, relative to the size, the probes don't span a volume
+#define FLAT_THRESHOLD          1e-3
+// walks treat a corner this far outside as inside
+#define WALK_TOLERANCE          1e-5f
+
+struct BuildPoint
+{
+    double v_[3];
+};
+
+struct BuildTetra
+{
+    int v_[4];
+    int n_[4];
+    double center_[3];
+    double radiusSq_;
+    bool alive_;
+};
+
+// face of a new tetrahedron that still needs its neighbor
+struct OpenFace
+{
+    unsigned long long edge_;
+    unsigned tetra_;
+    unsigned face_;
+};
+
+static inline void Sub(const double *a, const double *b, double *r)
+{
+    r[0] = a[0] - b[0];
+    r[1] = a[1] - b[1];
+    r[2] = a[2] - b[2];
+}
+
+static inline void Cross(const double *a, const double *b, double *r)
+{
+    r[0] = a[1] * b[2] - a[2] * b[1];
+    r[1] = a[2] * b[0] - a[0] * b[2];
+    r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline double Dot(const double *a, const double *b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// six times the signed volume of abcd
+static double Orient(const double *a, const double *b, const double *c, const double *d)
+{
+    double ab[3], ac[3], ad[3], n[3];
+    Sub(b, a, ab);
+    Sub(c, a, ac);
+    Sub(d, a, ad);
+    Cross(ac, ad, n);
+
+    return Dot(ab, n);
+}
+
+static void SetCircumsphere(BuildTetra &tetra, const PODVector<BuildPoint> &points)
+{
+    const double *a = points[tetra.v_[0]].v_;
+    double u[3], v[3], w[3];
+    Sub(points[tetra.v_[1]].v_, a, u);
+    Sub(points[tetra.v_[2]].v_, a, v);
+    Sub(points[tetra.v_[3]].v_, a, w);
+
+    double vw[3], wu[3], uv[3];
+    Cross(v, w, vw);
+    Cross(w, u, wu);
+    Cross(u, v, uv);
+
+    const double denom = 2.0 * Dot(u, vw);
+    if (denom == 0.0)
+    {
+        // flat, any insertion nearby removes it
+        tetra.center_[0] = a[0];
+        tetra.center_[1] = a[1];
+        tetra.center_[2] = a[2];
+        tetra.radiusSq_ = 1e300;
+        return;
+    }
+
+    const double uu = Dot(u, u), vv = Dot(v, v), ww = Dot(w, w);
+    double rel[3];
+    for ( int i = 0; i < 3; ++i )
+    {
+        rel[i] = (uu * vw[i] + vv * wu[i] + ww * uv[i]) / denom;
+        tetra.center_[i] = a[i] + rel[i];
+    }
+    tetra.radiusSq_ = Dot(rel, rel);
+}
+
+static inline bool InCircumsphere(const BuildTetra &tetra, const double *p)
+{
+    double d[3];
+    Sub(p, tetra.center_, d);
+
+    return Dot(d, d) < tetra.radiusSq_;
+}
+
+// tetrahedron that contains p, by walking over the faces p lies behind
+static int FindContaining(const PODVector<BuildTetra> &tetras, const PODVector<BuildPoint> &points, int start, const double *p)
+{
+    int t = start;
+
+    for ( unsigned step = 0; step < tetras.Size(); ++step )
+    {
+        const BuildTetra &tetra = tetras[t];
+        int next = -1;
+
+        for ( unsigned k = 0; k < 4 && next < 0; ++k )
+        {
+            // vary the first face tried, so a walk can't keep circling
+            const unsigned i = (k + step) & 3;
+            if (tetra.n_[i] < 0)
+                continue;
+
+            const double *f0 = points[tetra.v_[(i + 1) & 3]].v_;
+            const double *f1 = points[tetra.v_[(i + 2) & 3]].v_;
+            const double *f2 = points[tetra.v_[(i + 3) & 3]].v_;
+
+            if (Orient(f0, f1, f2, p) * Orient(f0, f1, f2, points[tetra.v_[i]].v_) < 0.0)
+            {
+                next = tetra.n_[i];
+            }
+        }
+
+        if (next < 0)
+            return t;
+
+        t = next;
+    }
+
+    // degenerate walk, any tetrahedron whose sphere holds p starts the cavity
+    for ( unsigned i = 0; i < tetras.Size(); ++i )
+    {
+        if (tetras[i].alive_ && InCircumsphere(tetras[i], p))
+            return (int)i;
+    }
+
+    return -1;
+}
+
+static inline unsigned long long EdgeKey(int a, int b)
+{
+    return a < b ? ((unsigned long long)a << 32) | (unsigned)b : ((unsigned long long)b << 32) | (unsigned)a;
+}
+
+//=============================================================================
+//=============================================================================
+ProbeTetraMesh::ProbeTetraMesh()
+    : tetras_(NULL)
+    , numTetras_(0)
+{
+}
+
+void ProbeTetraMesh::SetData(const ProbeTetra *tetras, unsigned numTetras)
+{
+    tetras_ = numTetras ? tetras : NULL;
+    numTetras_ = tetras_ ? numTetras : 0;
+}
+
+int ProbeTetraMesh::Locate(const Vector3 &position, int startTetra, unsigned *probes, float *weights) const
+{
+    if (numTetras_ == 0)
+        return -1;
+
+    int t = (startTetra >= 0 && startTetra < (int)numTetras_) ? startTetra : 0;
+
+    // step across the face of the most negative weight until none is left,
+    // or only hull faces are
+    for ( unsigned step = 0; step < numTetras_; ++step )
+    {
+        const ProbeTetra &tetra = tetras_[t];
+        GetWeights(tetra, position, weights);
+
+        int exitFace = -1;
+        float minWeight = -WALK_TOLERANCE;
+
+        for ( int i = 0; i < 4; ++i )
+        {
+            if (weights[i] < minWeight && tetra.neighbors_[i] >= 0)
+            {
+                minWeight = weights[i];
+                exitFace = i;
+            }
+        }
+
+        if (exitFace < 0)
+            break;
+
+        t = tetra.neighbors_[exitFace];
+    }
+
+    const ProbeTetra &tetra = tetras_[t];
+    GetWeights(tetra, position, weights);
+
+    float sum = 0.0f;
+    for ( int i = 0; i < 4; ++i )
+    {
+        weights[i] = Max(weights[i], 0.0f);
+        sum += weights[i];
+        probes[i] = tetra.probes_[i];
+    }
+
+    for ( int i = 0; i < 4; ++i )
+    {
+        weights[i] = sum > 0.0f ? weights[i] / sum : 0.25f;
+    }
+
+    return t;
+}
+
+void ProbeTetraMesh::GetWeights(const ProbeTetra &tetra, const Vector3 &position, float *weights)
+{
+    const float *m = tetra.toBary_;
+
+    weights[1] = m[0] * position.x_ + m[1] * position.y_ + m[2]  * position.z_ + m[3];
+    weights[2] = m[4] * position.x_ + m[5] * position.y_ + m[6]  * position.z_ + m[7];
+    weights[3] = m[8] * position.x_ + m[9] * position.y_ + m[10] * position.z_ + m[11];
+    weights[0] = 1.0f - weights[1] - weights[2] - weights[3];
+}
+
+bool ProbeTetraMesh::Build(const Vector3 *positions, unsigned count, unsigned stride, PODVector<ProbeTetra> &tetras)
+{
+    tetras.Clear();
+
+    if (count < 4)
+        return false;
+
+    const unsigned char *src = reinterpret_cast<const unsigned char*>(positions);
+    PODVector<BuildPoint> points(count + 4);
+
+    double minPos[3] = { 1e300, 1e300, 1e300 };
+    double maxPos[3] = { -1e300, -1e300, -1e300 };
+
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        const Vector3 &pos = *reinterpret_cast<const Vector3*>(src + i * stride);
+        points[i].v_[0] = pos.x_;
+        points[i].v_[1] = pos.y_;
+        points[i].v_[2] = pos.z_;
+
+        for ( int j = 0; j < 3; ++j )
+        {
+            minPos[j] = Min(minPos[j], points[i].v_[j]);
+            maxPos[j] = Max(maxPos[j], points[i].v_[j]);
+        }
+    }
+
+    double center[3], extent[3];
+    Sub(maxPos, minPos, extent);
+    const double size = Max(extent[0], Max(extent[1], extent[2]));
+
+    for ( int j = 0; j < 3; ++j )
+    {
+        center[j] = (minPos[j] + maxPos[j]) * 0.5;
+    }
+
+    if (size <= 0.0)
+        return false;
+
+    // flat sets: the point farthest from the plane of a spread out triangle
+    // is still in it
+    {
+        unsigned i1 = 0, i2 = 0;
+        double best = 0.0;
+        for ( unsigned i = 1; i < count; ++i )
+        {
+            double d[3];
+            Sub(points[i].v_, points[0].v_, d);
+            if (Dot(d, d) > best)
+            {
+                best = Dot(d, d);
+                i1 = i;
+            }
+        }
+
+        double axis[3], n[3];
+        Sub(points[i1].v_, points[0].v_, axis);
+        best = 0.0;
+        for ( unsigned i = 1; i < count; ++i )
+        {
+            double d[3], c[3];
+            Sub(points[i].v_, points[0].v_, d);
+            Cross(axis, d, c);
+            if (Dot(c, c) > best)
+            {
+                best = Dot(c, c);
+                i2 = i;
+            }
+        }
+
+        double d2[3];
+        Sub(points[i2].v_, points[0].v_, d2);
+        Cross(axis, d2, n);
+
+        const double nLen = sqrt(Dot(n, n));
+        if (nLen == 0.0)
+            return false;
+
+        double maxDist = 0.0;
+        for ( unsigned i = 1; i < count; ++i )
+        {
+            double d[3];
+            Sub(points[i].v_, points[0].v_, d);
+            maxDist = Max(maxDist, Abs(Dot(d, n)) / nLen);
+        }
+
+        if (maxDist < size * FLAT_THRESHOLD)
+            return false;
+    }
+
+    // keep the exact positions for the weights
+    PODVector<BuildPoint> exact(points);
+
+    // deterministic offsets keep grids from producing co-spherical points
+    unsigned seed = 12345;
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        for ( int j = 0; j < 3; ++j )
+        {
+            seed = seed * 1103515245u + 12345u;
+            points[i].v_[j] += ((double)((seed >> 8) & 0xffff) / 65535.0 - 0.5) * size * BUILD_JITTER;
+        }
+    }
+
+    // insert in random order, rows of a grid one after another would make
+    // long runs of nearly flat tetrahedra
+    PODVector<unsigned> order(count);
+    for ( unsigned i = 0; i < count; ++i )
+    {
+        order[i] = i;
+    }
+    for ( unsigned i = count - 1; i > 0; --i )
+    {
+        seed = seed * 1103515245u + 12345u;
+        Swap(order[i], order[(seed >> 8) % (i + 1)]);
+    }
+
+    // a regular tetrahedron far around everything, removed at the end
+    const double s = size * 1000.0;
+    const double corners[4][3] = { { 1, 1, 1 }, { 1, -1, -1 }, { -1, 1, -1 }, { -1, -1, 1 } };
+    for ( unsigned i = 0; i < 4; ++i )
+    {
+        for ( int j = 0; j < 3; ++j )
+        {
+            points[count + i].v_[j] = center[j] + corners[i][j] * s;
+        }
+    }
+
+    PODVector<BuildTetra> build;
+    build.Reserve(count * 8);
+
+    BuildTetra super;
+    for ( int i = 0; i < 4; ++i )
+    {
+        super.v_[i] = (int)(count + i);
+        super.n_[i] = -1;
+    }
+    super.alive_ = true;
+    SetCircumsphere(super, points);
+    build.Push(super);
+
+    PODVector<unsigned> visitStamp;
+    PODVector<unsigned> stack;
+    PODVector<unsigned> cavity;
+    PODVector<OpenFace> openFaces;
+    int lastTetra = 0;
+
+    visitStamp.Push(0);
+
+    for ( unsigned o = 0; o < count; ++o )
+    {
+        const unsigned p = order[o];
+        const double *pos = points[p].v_;
+        const unsigned stamp = o + 1;
+
+        const int first = FindContaining(build, points, lastTetra, pos);
+        if (first < 0)
+            continue;
+
+        // bowyer-watson cavity: every tetrahedron connected to the first whose
+        // circumsphere holds the point
+        cavity.Clear();
+        stack.Clear();
+        build[first].alive_ = false;
+        visitStamp[first] = stamp;
+        cavity.Push(first);
+        stack.Push(first);
+
+        while (stack.Size())
+        {
+            const unsigned t = stack.Back();
+            stack.Pop();
+
+            for ( int i = 0; i < 4; ++i )
+            {
+                const int nb = build[t].n_[i];
+                if (nb < 0 || visitStamp[nb] == stamp)
+                    continue;
+
+                visitStamp[nb] = stamp;
+                if (InCircumsphere(build[nb], pos))
+                {
+                    build[nb].alive_ = false;
+                    cavity.Push(nb);
+                    stack.Push(nb);
+                }
+            }
+        }
+
+        // rounding can leave boundary faces the point doesn't see, which would
+        // make inverted tetrahedra. grow the cavity over them until it's star
+        // shaped from the point
+        for ( bool grown = true; grown; )
+        {
+            grown = false;
+
+            for ( unsigned c = 0; c < cavity.Size() && !grown; ++c )
+            {
+                const unsigned t = cavity[c];
+
+                for ( int i = 0; i < 4; ++i )
+                {
+                    const int nb = build[t].n_[i];
+                    if (nb < 0 || !build[nb].alive_)
+                        continue;
+
+                    const double *f0 = points[build[t].v_[(i + 1) & 3]].v_;
+                    const double *f1 = points[build[t].v_[(i + 2) & 3]].v_;
+                    const double *f2 = points[build[t].v_[(i + 3) & 3]].v_;
+
+                    if (Orient(f0, f1, f2, pos) * Orient(f0, f1, f2, points[build[t].v_[i]].v_) <= 0.0)
+                    {
+                        build[nb].alive_ = false;
+                        cavity.Push(nb);
+                        grown = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        // fill it with tetrahedra from the point to the cavity's boundary faces
+        openFaces.Clear();
+
+        for ( unsigned c = 0; c < cavity.Size(); ++c )
+        {
+            const unsigned t = cavity[c];
+
+            for ( int i = 0; i < 4; ++i )
+            {
+                const int nb = build[t].n_[i];
+                if (nb >= 0 && !build[nb].alive_)
+                    continue;
+
+                BuildTetra tetra;
+                tetra.v_[0] = build[t].v_[(i + 1) & 3];
+                tetra.v_[1] = build[t].v_[(i + 2) & 3];
+                tetra.v_[2] = build[t].v_[(i + 3) & 3];
+                tetra.v_[3] = (int)p;
+                tetra.n_[0] = tetra.n_[1] = tetra.n_[2] = -1;
+                tetra.n_[3] = nb;
+                tetra.alive_ = true;
+                SetCircumsphere(tetra, points);
+
+                const unsigned index = build.Size();
+                build.Push(tetra);
+                visitStamp.Push(0);
+
+                if (nb >= 0)
+                {
+                    for ( int j = 0; j < 4; ++j )
+                    {
+                        if (build[nb].n_[j] == (int)t)
+                            build[nb].n_[j] = (int)index;
+                    }
+                }
+
+                // the other faces all hold the point, they pair up by their remaining edge
+                for ( unsigned j = 0; j < 3; ++j )
+                {
+                    OpenFace face;
+                    face.edge_ = EdgeKey(tetra.v_[(j + 1) % 3], tetra.v_[(j + 2) % 3]);
+                    face.tetra_ = index;
+                    face.face_ = j;
+                    openFaces.Push(face);
+                }
+            }
+        }
+
+        for ( unsigned i = 0; i < openFaces.Size(); ++i )
+        {
+            for ( unsigned j = i + 1; j < openFaces.Size(); ++j )
+            {
+                if (openFaces[i].edge_ == openFaces[j].edge_)
+                {
+                    build[openFaces[i].tetra_].n_[openFaces[i].face_] = (int)openFaces[j].tetra_;
+                    build[openFaces[j].tetra_].n_[openFaces[j].face_] = (int)openFaces[i].tetra_;
+                    openFaces[j] = openFaces.Back();
+                    openFaces.Pop();
+                    break;
+                }
+            }
+        }
+
+        lastTetra = (int)build.Size() - 1;
+    }
+
+    // drop everything touching the outer tetrahedron and compact
+    PODVector<int> remap(build.Size());
+    unsigned numTetras = 0;
+
+    for ( unsigned i = 0; i < build.Size(); ++i )
+    {
+        const BuildTetra &tetra = build[i];
+        const bool keep = tetra.alive_ && tetra.v_[0] < (int)count && tetra.v_[1] < (int)count &&
+                          tetra.v_[2] < (int)count && tetra.v_[3] < (int)count;
+        remap[i] = keep ? (int)numTetras++ : -1;
+    }
+
+    tetras.Resize(numTetras);
+
+    for ( unsigned i = 0; i < build.Size(); ++i )
+    {
+        if (remap[i] < 0)
+            continue;
+
+        const BuildTetra &src = build[i];
+        ProbeTetra &dest = tetras[remap[i]];
+
+        for ( int j = 0; j < 4; ++j )
+        {
+            dest.probes_[j] = (unsigned)src.v_[j];
+            dest.neighbors_[j] = src.n_[j] >= 0 ? remap[src.n_[j]] : -1;
+        }
+
+        // invert the edge matrix, rows of the inverse of the matrix with
+        // columns e0, e1, e2. slivers that are flat without the offsets use
+        // the offset corners, nothing is ever inside them anyway
+        const double *p0 = exact[src.v_[0]].v_;
+        double e[3][3], r[3][3];
+        double det = 0.0;
+
+        for ( int pass = 0; pass < 2 && Abs(det) <= size * size * size * 1e-12; ++pass )
+        {
+            const PODVector<BuildPoint> &corners = pass == 0 ? exact : points;
+            p0 = corners[src.v_[0]].v_;
+            Sub(corners[src.v_[1]].v_, p0, e[0]);
+            Sub(corners[src.v_[2]].v_, p0, e[1]);
+            Sub(corners[src.v_[3]].v_, p0, e[2]);
+
+            Cross(e[1], e[2], r[0]);
+            Cross(e[2], e[0], r[1]);
+            Cross(e[0], e[1], r[2]);
+            det = Dot(e[0], r[0]);
+        }
+
+        const double invDet = det != 0.0 ? 1.0 / det : 0.0;
+
+        for ( int row = 0; row < 3; ++row )
+        {
+            for ( int col = 0; col < 3; ++col )
+            {
+                dest.toBary_[row * 4 + col] = (float)(r[row][col] * invDet);
+            }
+            dest.toBary_[row * 4 + 3] = (float)(-Dot(r[row], p0) * invDet);
+        }
+    }
+
+    return numTetras > 0;
+}
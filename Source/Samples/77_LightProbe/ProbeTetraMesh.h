@@ -0,0 +1,78 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+
+//=============================================================================
+// one tetrahedron of the probe mesh, stored as is in the probe set file
+//=============================================================================
+struct ProbeTetra
+{
+    // probe set slots of the corners
+    unsigned probes_[4];
+    // tetrahedron across the face opposite probes_[i], -1 on the hull
+    int neighbors_[4];
+    // 3x4 row major, maps a position to the weights of probes_[1..3],
+    // probes_[0] gets the rest
+    float toBary_[12];
+};
+
+//=============================================================================
+// delaunay tetrahedralization of the probe positions, built at bake time.
+// a lookup walks from the tetrahedron a caller found last time towards the
+// position, objects barely move between frames so that's a step or two,
+// and blends the four corner probes with their barycentric weights.
+// the mesh is a view, the tetrahedra are owned by whoever set them
+//=============================================================================
+class ProbeTetraMesh
+{
+public:
+    ProbeTetraMesh();
+
+    void SetData(const ProbeTetra *tetras, unsigned numTetras);
+
+    unsigned GetNumTetras() const                   { return numTetras_; }
+    const ProbeTetra& GetTetra(unsigned index) const { return tetras_[index]; }
+    bool IsEmpty() const                            { return numTetras_ == 0; }
+
+    // tetrahedron around position, starting the walk at startTetra (any
+    // value works if there's no previous one). writes the corner slots and
+    // weights, which sum to one. outside the hull the walk stops on the hull
+    // and the weights are clamped to it. -1 if the mesh is empty
+    int Locate(const Vector3 &position, int startTetra, unsigned *probes, float *weights) const;
+
+    // tetrahedralizes count positions, stride bytes apart, tetra corners are
+    // position indices. false if there are fewer than four or they're flat
+    static bool Build(const Vector3 *positions, unsigned count, unsigned stride, PODVector<ProbeTetra> &tetras);
+
+protected:
+    static void GetWeights(const ProbeTetra &tetra, const Vector3 &position, float *weights);
+
+protected:
+    const ProbeTetra *tetras_;
+    unsigned numTetras_;
+};
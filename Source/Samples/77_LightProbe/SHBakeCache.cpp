@@ -0,0 +1,282 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Graphics/Drawable.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/Graphics/OctreeQuery.h>
+#include <Urho3D/Graphics/Technique.h>
+#include <Urho3D/Graphics/Texture.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "SHBakeCache.h"
+#include "LightProbe.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+SHBakeCache::SHBakeCache(Context* context)
+    : Object(context)
+    , influenceRadius_(0.0f)
+    , viewMask_(DEFAULT_VIEWMASK)
+    , settingsHash_(0)
+    , numHits_(0)
+    , numMisses_(0)
+{
+}
+
+SHBakeCache::~SHBakeCache()
+{
+}
+
+void SHBakeCache::SetCacheDir(const String &cacheDir)
+{
+    cacheDir_ = cacheDir.Empty() ? String::EMPTY : AddTrailingSlash(cacheDir);
+
+    if (IsEnabled() && !GetSubsystem<FileSystem>()->CreateDir(cacheDir_))
+    {
+        URHO3D_LOGERROR("SHBakeCache: could not create cache dir " + cacheDir_);
+        cacheDir_.Clear();
+    }
+}
+
+void SHBakeCache::BeginBake(Scene *scene, float influenceRadius, unsigned viewMask, unsigned long long settingsHash)
+{
+    scene_ = scene;
+    influenceRadius_ = influenceRadius;
+    viewMask_ = viewMask;
+    settingsHash_ = settingsHash;
+    drawableHashes_.Clear();
+    resourceChecksums_.Clear();
+    numHits_ = 0;
+    numMisses_ = 0;
+}
+
+unsigned long long SHBakeCache::GetProbeKey(const Vector3 &worldPos)
+{
+    SHBakeHash hash;
+    hash.Add(VERSION);
+    hash.Add(settingsHash_);
+    hash.Add(worldPos.x_);
+    hash.Add(worldPos.y_);
+    hash.Add(worldPos.z_);
+
+    Octree *octree = scene_ ? scene_->GetComponent<Octree>() : NULL;
+    if (octree == NULL)
+        return hash.Get();
+
+    // geometry, lights and zones whose bounds reach into the influence sphere.
+    // lights are found by their range, directional lights by their infinite bounds
+    PODVector<Drawable*> drawables;
+    SphereOctreeQuery query(drawables, Sphere(worldPos, influenceRadius_), DRAWABLE_ANY, viewMask_);
+    octree->GetDrawables(query);
+
+    PODVector<unsigned long long> drawableHashes;
+    drawableHashes.Reserve(drawables.Size());
+
+    for ( unsigned i = 0; i < drawables.Size(); ++i )
+    {
+        // other probes don't show up in the capture
+        if (drawables[i]->GetType() == LightProbe::GetTypeStatic())
+            continue;
+
+        drawableHashes.Push(GetDrawableHash(drawables[i]));
+    }
+
+    // the octree order isn't stable between runs
+    Sort(drawableHashes.Begin(), drawableHashes.End());
+
+    if (drawableHashes.Size())
+    {
+        hash.Add(&drawableHashes[0], drawableHashes.Size() * sizeof(unsigned long long));
+    }
+
+    return hash.Get();
+}
+
+bool SHBakeCache::Load(unsigned long long key, unsigned numCoeffs, PODVector<Vector3> &coeffVec)
+{
+    const String path = GetEntryPath(key);
+
+    if (IsEnabled() && GetSubsystem<FileSystem>()->FileExists(path))
+    {
+        File file(context_, path, FILE_READ);
+
+        if (file.ReadFileID() == "SHBC" && file.ReadUInt() == VERSION && file.ReadUInt() == numCoeffs)
+        {
+            coeffVec.Resize(numCoeffs);
+
+            if (file.Read(&coeffVec[0], numCoeffs * sizeof(Vector3)) == numCoeffs * sizeof(Vector3))
+            {
+                ++numHits_;
+                return true;
+            }
+        }
+    }
+
+    ++numMisses_;
+    return false;
+}
+
+bool SHBakeCache::Store(unsigned long long key, const PODVector<Vector3> &coeffVec)
+{
+    if (!IsEnabled() || coeffVec.Empty())
+        return false;
+
+    // write aside and rename, an interrupted bake never leaves a partial entry
+    const String path = GetEntryPath(key);
+    const String tempPath = path + ".tmp";
+    {
+        File file(context_, tempPath, FILE_WRITE);
+
+        if (!file.IsOpen())
+            return false;
+
+        file.WriteFileID("SHBC");
+        file.WriteUInt(VERSION);
+        file.WriteUInt(coeffVec.Size());
+        file.Write(&coeffVec[0], coeffVec.Size() * sizeof(Vector3));
+    }
+
+    FileSystem *fileSystem = GetSubsystem<FileSystem>();
+    fileSystem->Delete(path);
+
+    return fileSystem->Rename(tempPath, path);
+}
+
+String SHBakeCache::GetEntryPath(unsigned long long key) const
+{
+    return cacheDir_ + ToString("%08x%08x.shc", (unsigned)(key >> 32), (unsigned)key);
+}
+
+unsigned long long SHBakeCache::GetDrawableHash(Drawable *drawable)
+{
+    HashMap<Drawable*, unsigned long long>::ConstIterator it = drawableHashes_.Find(drawable);
+    if (it != drawableHashes_.End())
+        return it->second_;
+
+    SHBakeHash hash;
+    hash.Add(drawable->GetTypeName());
+
+    Node *node = drawable->GetNode();
+    if (node)
+    {
+        hash.Add(node->GetWorldTransform().Data(), 12 * sizeof(float));
+    }
+
+    // editable attributes cover model, material refs, light color, zone settings etc.
+    const Vector<AttributeInfo> *attributes = drawable->GetAttributes();
+    if (attributes)
+    {
+        for ( unsigned i = 0; i < attributes->Size(); ++i )
+        {
+            const AttributeInfo &info = attributes->At(i);
+            if (info.mode_ & AM_NOEDIT)
+                continue;
+
+            const Variant value = drawable->GetAttribute(i);
+            hash.Add(info.name_);
+            hash.Add(value.ToString());
+
+            // referenced files by content, so an edited model is picked up without a rename
+            if (value.GetType() == VAR_RESOURCEREF)
+            {
+                HashResource(hash, value.GetResourceRef().name_);
+            }
+            else if (value.GetType() == VAR_RESOURCEREFLIST)
+            {
+                const StringVector &names = value.GetResourceRefList().names_;
+                for ( unsigned j = 0; j < names.Size(); ++j )
+                {
+                    HashResource(hash, names[j]);
+                }
+            }
+        }
+    }
+
+    // material contents, so a material edit is picked up without a rename
+    const Vector<SourceBatch> &batches = drawable->GetBatches();
+    for ( unsigned i = 0; i < batches.Size(); ++i )
+    {
+        HashMaterial(hash, batches[i].material_);
+    }
+
+    drawableHashes_[drawable] = hash.Get();
+    return hash.Get();
+}
+
+void SHBakeCache::HashMaterial(SHBakeHash &hash, Material *material)
+{
+    if (material == NULL)
+    {
+        hash.Add(0u);
+        return;
+    }
+
+    HashResource(hash, material->GetName());
+
+    for ( unsigned i = 0; i < material->GetNumTechniques(); ++i )
+    {
+        Technique *technique = material->GetTechnique(i);
+        HashResource(hash, technique ? technique->GetName() : String::EMPTY);
+    }
+
+    const HashMap<TextureUnit, SharedPtr<Texture> > &textures = material->GetTextures();
+    for ( HashMap<TextureUnit, SharedPtr<Texture> >::ConstIterator it = textures.Begin(); it != textures.End(); ++it )
+    {
+        hash.Add((unsigned)it->first_);
+        HashResource(hash, it->second_ ? it->second_->GetName() : String::EMPTY);
+    }
+
+    const HashMap<StringHash, MaterialShaderParameter> &parameters = material->GetShaderParameters();
+    for ( HashMap<StringHash, MaterialShaderParameter>::ConstIterator it = parameters.Begin(); it != parameters.End(); ++it )
+    {
+        hash.Add(it->second_.name_);
+        hash.Add(it->second_.value_.ToString());
+    }
+}
+
+void SHBakeCache::HashResource(SHBakeHash &hash, const String &name)
+{
+    hash.Add(name);
+
+    if (name.Empty())
+        return;
+
+    // file checksum, read once per bake. resources made in code have no file
+    // and are covered by the attributes and params hashed with them
+    HashMap<String, unsigned>::ConstIterator it = resourceChecksums_.Find(name);
+    if (it == resourceChecksums_.End())
+    {
+        SharedPtr<File> file = GetSubsystem<ResourceCache>()->GetFile(name, false);
+        it = resourceChecksums_.Insert(MakePair(name, file ? file->GetChecksum() : 0u));
+    }
+
+    hash.Add(it->second_);
+}
@@ -0,0 +1,114 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Container/HashMap.h>
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Drawable;
+class Material;
+class Scene;
+}
+
+//=============================================================================
+// 64 bit fnv-1a, used for bake cache keys
+//=============================================================================
+class SHBakeHash
+{
+public:
+    SHBakeHash() : hash_(14695981039346656037ULL) {}
+
+    void Add(const void *data, unsigned size)
+    {
+        const unsigned char *bytes = (const unsigned char*)data;
+        for ( unsigned i = 0; i < size; ++i )
+        {
+            hash_ = (hash_ ^ bytes[i]) * 1099511628211ULL;
+        }
+    }
+    void Add(unsigned long long value)  { Add(&value, sizeof(value)); }
+    void Add(unsigned value)            { Add(&value, sizeof(value)); }
+    void Add(float value)               { Add(&value, sizeof(value)); }
+    void Add(const String &str)         { Add(str.Length()); Add(str.CString(), str.Length()); }
+
+    unsigned long long Get() const      { return hash_; }
+
+private:
+    unsigned long long hash_;
+};
+
+//=============================================================================
+// persistent cache of baked probe coeffs, one file per key in the cache dir.
+// a key covers the probe's world position, the capture settings and every
+// drawable, light and zone that overlaps the probe's influence sphere, so a
+// content edit only invalidates the probes that can see it
+//=============================================================================
+class SHBakeCache : public Object
+{
+    URHO3D_OBJECT(SHBakeCache, Object);
+
+public:
+    SHBakeCache(Context* context);
+    virtual ~SHBakeCache();
+
+    // empty dir disables the cache
+    void SetCacheDir(const String &cacheDir);
+    const String& GetCacheDir() const   { return cacheDir_; }
+    bool IsEnabled() const              { return !cacheDir_.Empty(); }
+
+    // resets stats and per drawable and resource hashes, call when the scene
+    // or its resource files may have changed.
+    // drawables outside the capture view mask don't affect the key
+    void BeginBake(Scene *scene, float influenceRadius, unsigned viewMask, unsigned long long settingsHash);
+
+    unsigned long long GetProbeKey(const Vector3 &worldPos);
+    bool Load(unsigned long long key, unsigned numCoeffs, PODVector<Vector3> &coeffVec);
+    bool Store(unsigned long long key, const PODVector<Vector3> &coeffVec);
+
+    unsigned GetNumHits() const         { return numHits_; }
+    unsigned GetNumMisses() const       { return numMisses_; }
+
+    // bump when the capture or projection output changes for the same input
+    static const unsigned VERSION = 1;
+
+protected:
+    String GetEntryPath(unsigned long long key) const;
+    unsigned long long GetDrawableHash(Drawable *drawable);
+    void HashMaterial(SHBakeHash &hash, Material *material);
+    void HashResource(SHBakeHash &hash, const String &name);
+
+protected:
+    String cacheDir_;
+    WeakPtr<Scene> scene_;
+    float influenceRadius_;
+    unsigned viewMask_;
+    unsigned long long settingsHash_;
+    HashMap<Drawable*, unsigned long long> drawableHashes_;
+    HashMap<String, unsigned> resourceChecksums_;
+
+    unsigned numHits_;
+    unsigned numMisses_;
+};
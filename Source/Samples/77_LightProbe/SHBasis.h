@@ -0,0 +1,168 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+//=============================================================================
+// sh order used across bake, storage and shader. the order is a template
+// parameter of the projection, SHOrder only selects which instantiation runs
+//=============================================================================
+enum SHOrder
+{
+    SHOrder_L1 = 1,
+    SHOrder_L2 = 2,
+    SHOrder_L3 = 3
+};
+
+// coeffs per color channel
+inline unsigned SHNumCoeffs(int order)
+{
+    return (unsigned)((order + 1) * (order + 1));
+}
+
+//=============================================================================
+// real sh basis normalization constants, sqrt(num / (den * pi)), evaluated
+// at compile time
+//=============================================================================
+namespace SHConst
+{
+constexpr double PI = 3.14159265358979323846;
+
+constexpr double SqrtIter(double x, double cur, int iter)
+{
+    return iter == 0 ? cur : SqrtIter(x, 0.5 * (cur + x / cur), iter - 1);
+}
+
+constexpr double Sqrt(double x)
+{
+    return SqrtIter(x, x > 1.0 ? x : 1.0, 32);
+}
+
+constexpr float K(double num, double den)
+{
+    return (float)Sqrt(num / (den * PI));
+}
+
+// band 0
+constexpr float Y00  = K(1.0, 4.0);     // 0.282095
+// band 1
+constexpr float Y1   = K(3.0, 4.0);     // 0.488603 y, z, x
+// band 2
+constexpr float Y2   = K(15.0, 4.0);    // 1.092548 xy, yz, xz
+constexpr float Y20  = K(5.0, 16.0);    // 0.315392 (3z^2 - 1)
+constexpr float Y22  = K(15.0, 16.0);   // 0.546274 (x^2 - y^2)
+// band 3
+constexpr float Y33  = K(35.0, 32.0);   // 0.590044 y(3x^2 - y^2), x(x^2 - 3y^2)
+constexpr float Y32  = K(105.0, 4.0);   // 2.890611 xyz
+constexpr float Y31  = K(21.0, 32.0);   // 0.457046 y(5z^2 - 1), x(5z^2 - 1)
+constexpr float Y30  = K(7.0, 16.0);    // 0.373176 z(5z^2 - 3)
+constexpr float Y32b = K(105.0, 16.0);  // 1.445306 z(x^2 - y^2)
+}
+
+//=============================================================================
+// basis evaluation, one band per specialization. coeff index is l*l + l + m,
+// Ops is the scalar or simd register set used by the projection kernel
+//=============================================================================
+template <int Band>
+struct SHBand;
+
+template <>
+struct SHBand<0>
+{
+    template <class Ops>
+    static inline void Evaluate(typename Ops::Reg, typename Ops::Reg, typename Ops::Reg, typename Ops::Reg *basis)
+    {
+        basis[0] = Ops::Set(SHConst::Y00);
+    }
+};
+
+template <>
+struct SHBand<1>
+{
+    template <class Ops>
+    static inline void Evaluate(typename Ops::Reg x, typename Ops::Reg y, typename Ops::Reg z, typename Ops::Reg *basis)
+    {
+        SHBand<0>::Evaluate<Ops>(x, y, z, basis);
+
+        const typename Ops::Reg k = Ops::Set(SHConst::Y1);
+        basis[1] = Ops::Mul(k, y);
+        basis[2] = Ops::Mul(k, z);
+        basis[3] = Ops::Mul(k, x);
+    }
+};
+
+template <>
+struct SHBand<2>
+{
+    template <class Ops>
+    static inline void Evaluate(typename Ops::Reg x, typename Ops::Reg y, typename Ops::Reg z, typename Ops::Reg *basis)
+    {
+        SHBand<1>::Evaluate<Ops>(x, y, z, basis);
+
+        const typename Ops::Reg k2 = Ops::Set(SHConst::Y2);
+        const typename Ops::Reg k20 = Ops::Set(SHConst::Y20);
+        basis[4] = Ops::Mul(k2, Ops::Mul(x, y));
+        basis[5] = Ops::Mul(k2, Ops::Mul(y, z));
+        basis[6] = Ops::Sub(Ops::Mul(Ops::Set(3.0f * SHConst::Y20), Ops::Mul(z, z)), k20);
+        basis[7] = Ops::Mul(k2, Ops::Mul(x, z));
+        basis[8] = Ops::Mul(Ops::Set(SHConst::Y22), Ops::Sub(Ops::Mul(x, x), Ops::Mul(y, y)));
+    }
+};
+
+template <>
+struct SHBand<3>
+{
+    template <class Ops>
+    static inline void Evaluate(typename Ops::Reg x, typename Ops::Reg y, typename Ops::Reg z, typename Ops::Reg *basis)
+    {
+        SHBand<2>::Evaluate<Ops>(x, y, z, basis);
+
+        const typename Ops::Reg x2 = Ops::Mul(x, x);
+        const typename Ops::Reg y2 = Ops::Mul(y, y);
+        const typename Ops::Reg z2 = Ops::Mul(z, z);
+        const typename Ops::Reg three = Ops::Set(3.0f);
+        const typename Ops::Reg fiveZ2m1 = Ops::Sub(Ops::Mul(Ops::Set(5.0f), z2), Ops::Set(1.0f));
+        const typename Ops::Reg k33 = Ops::Set(SHConst::Y33);
+        const typename Ops::Reg k31 = Ops::Set(SHConst::Y31);
+
+        basis[9]  = Ops::Mul(k33, Ops::Mul(y, Ops::Sub(Ops::Mul(three, x2), y2)));
+        basis[10] = Ops::Mul(Ops::Set(SHConst::Y32), Ops::Mul(Ops::Mul(x, y), z));
+        basis[11] = Ops::Mul(k31, Ops::Mul(y, fiveZ2m1));
+        basis[12] = Ops::Mul(Ops::Set(SHConst::Y30), Ops::Mul(z, Ops::Sub(Ops::Mul(Ops::Set(5.0f), z2), three)));
+        basis[13] = Ops::Mul(k31, Ops::Mul(x, fiveZ2m1));
+        basis[14] = Ops::Mul(Ops::Set(SHConst::Y32b), Ops::Mul(z, Ops::Sub(x2, y2)));
+        basis[15] = Ops::Mul(k33, Ops::Mul(x, Ops::Sub(x2, Ops::Mul(three, y2))));
+    }
+};
+
+template <int Order>
+struct SHBasis
+{
+    enum { NumCoeffs = (Order + 1) * (Order + 1) };
+
+    template <class Ops>
+    static inline void Evaluate(typename Ops::Reg x, typename Ops::Reg y, typename Ops::Reg z, typename Ops::Reg *basis)
+    {
+        SHBand<Order>::template Evaluate<Ops>(x, y, z, basis);
+    }
+};
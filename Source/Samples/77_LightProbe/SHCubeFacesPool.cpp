@@ -0,0 +1,99 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Math/MathDefs.h>
+
+#include "SHCubeFacesPool.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+SHCubeFacesPool::SHCubeFacesPool()
+    : peakInUse_(0)
+{
+}
+
+SHCubeFacesPool::~SHCubeFacesPool()
+{
+    for ( unsigned i = 0; i < buffers_.Size(); ++i )
+    {
+        delete buffers_[i];
+    }
+}
+
+void SHCubeFacesPool::Reserve(unsigned count, int faceSize, SHFaceFormat format)
+{
+    MutexLock lock(mutex_);
+
+    while (buffers_.Size() < count)
+    {
+        SHCubeFaces *faces = new SHCubeFaces();
+        faces->Allocate(faceSize, format);
+
+        buffers_.Push(faces);
+        freeBuffers_.Push(faces);
+    }
+}
+
+SHCubeFaces* SHCubeFacesPool::Acquire(int faceSize, SHFaceFormat format)
+{
+    SHCubeFaces *faces = NULL;
+    {
+        MutexLock lock(mutex_);
+
+        if (freeBuffers_.Size())
+        {
+            faces = freeBuffers_.Back();
+            freeBuffers_.Pop();
+        }
+        else
+        {
+            faces = new SHCubeFaces();
+            buffers_.Push(faces);
+        }
+
+        peakInUse_ = Max(peakInUse_, buffers_.Size() - freeBuffers_.Size());
+    }
+
+    // keeps the memory when the size and format match the last use
+    faces->Allocate(faceSize, format);
+
+    return faces;
+}
+
+void SHCubeFacesPool::Release(SHCubeFaces *faces)
+{
+    if (faces == NULL)
+        return;
+
+    MutexLock lock(mutex_);
+    freeBuffers_.Push(faces);
+}
+
+unsigned SHCubeFacesPool::GetBufferMemory(int faceSize, SHFaceFormat format)
+{
+    const unsigned texelSize = (format == SHFace_RGBA16F) ? 8 : 4;
+    const unsigned numTexels = (unsigned)(faceSize * faceSize) * MAX_CUBEMAP_FACES;
+
+    return numTexels * (texelSize + 3 * sizeof(float));
+}
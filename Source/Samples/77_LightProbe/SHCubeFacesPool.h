@@ -0,0 +1,62 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/RefCounted.h>
+#include <Urho3D/Core/Mutex.h>
+
+#include "SHFaceDecoder.h"
+
+using namespace Urho3D;
+
+//=============================================================================
+// preallocated capture readback and projection buffers. a probe holds one
+// from capture until its projection is done, so a bake needs about as many
+// as it has probes in flight and never allocates per probe
+//=============================================================================
+class SHCubeFacesPool : public RefCounted
+{
+public:
+    SHCubeFacesPool();
+    virtual ~SHCubeFacesPool();
+
+    void Reserve(unsigned count, int faceSize, SHFaceFormat format);
+
+    SHCubeFaces* Acquire(int faceSize, SHFaceFormat format);
+    void Release(SHCubeFaces *faces);
+
+    unsigned GetNumBuffers() const  { return buffers_.Size(); }
+
+    // most buffers acquired at once since the last reset
+    unsigned GetPeakInUse() const   { return peakInUse_; }
+    void ResetPeakInUse()           { peakInUse_ = 0; }
+
+    // readback plus decoded planes of one buffer
+    static unsigned GetBufferMemory(int faceSize, SHFaceFormat format);
+
+protected:
+    PODVector<SHCubeFaces*> buffers_;
+    PODVector<SHCubeFaces*> freeBuffers_;
+    Mutex mutex_;
+    unsigned peakInUse_;
+};
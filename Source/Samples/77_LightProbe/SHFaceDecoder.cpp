@@ -0,0 +1,220 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Math/MathDefs.h>
+#include <cstring>
+
+#if defined(URHO3D_SSE) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(URHO3D_SSE) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+#include "SHFaceDecoder.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+namespace
+{
+struct DecodeTables
+{
+    DecodeTables()
+    {
+        for ( int i = 0; i < 256; ++i )
+        {
+            const float c = (float)i / 255.0f;
+
+            unorm_[i] = c;
+            sRGB_[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+    }
+
+    float unorm_[256];
+    float sRGB_[256];
+};
+
+const DecodeTables& GetDecodeTables()
+{
+    static const DecodeTables tables;
+    return tables;
+}
+}
+
+// implemented in SHFaceDecoderF16C.cpp
+extern bool SHFaceDecoderF16CCompiled();
+extern void SHFaceDecoderF16C(const unsigned short *data, unsigned numTexels, float *r, float *g, float *b);
+
+static bool CPUSupportsF16C()
+{
+#if defined(URHO3D_SSE) && (defined(_MSC_VER) || defined(__GNUC__))
+    unsigned regs[4] = { 0, 0, 0, 0 };
+#ifdef _MSC_VER
+    __cpuid((int*)regs, 1);
+#else
+    __get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+
+    // f16c, avx and osxsave
+    const unsigned required = (1u << 29) | (1u << 28) | (1u << 27);
+    if ((regs[2] & required) != required)
+        return false;
+
+    // os saves the ymm state
+#ifdef _MSC_VER
+    return (_xgetbv(0) & 6) == 6;
+#else
+    unsigned xcrLo, xcrHi;
+    __asm__ ("xgetbv" : "=a"(xcrLo), "=d"(xcrHi) : "c"(0));
+    return (xcrLo & 6) == 6;
+#endif
+#else
+    return false;
+#endif
+}
+
+static const bool f16cSupported_ = SHFaceDecoderF16CCompiled() && CPUSupportsF16C();
+
+//=============================================================================
+//=============================================================================
+void SHFaceDecoder::DecodeRGBA8(const unsigned char *data, unsigned numTexels, unsigned components, bool sRGB,
+                                float *r, float *g, float *b)
+{
+    const float *lut = sRGB ? GetSRGBToLinearTable() : GetUnormToLinearTable();
+
+    if (components == 4)
+    {
+        for ( unsigned i = 0; i < numTexels; ++i, data += 4 )
+        {
+            r[i] = lut[data[0]];
+            g[i] = lut[data[1]];
+            b[i] = lut[data[2]];
+        }
+    }
+    else
+    {
+        for ( unsigned i = 0; i < numTexels; ++i, data += components )
+        {
+            r[i] = lut[data[0]];
+            g[i] = lut[data[1]];
+            b[i] = lut[data[2]];
+        }
+    }
+}
+
+void SHFaceDecoder::DecodeRGBA16F(const unsigned short *data, unsigned numTexels, float *r, float *g, float *b)
+{
+    if (f16cSupported_)
+    {
+        SHFaceDecoderF16C(data, numTexels, r, g, b);
+        return;
+    }
+
+    DecodeRGBA16FScalar(data, numTexels, r, g, b);
+}
+
+void SHFaceDecoder::DecodeRGBA16FScalar(const unsigned short *data, unsigned numTexels, float *r, float *g, float *b)
+{
+    for ( unsigned i = 0; i < numTexels; ++i, data += 4 )
+    {
+        r[i] = HalfToFloat(data[0]);
+        g[i] = HalfToFloat(data[1]);
+        b[i] = HalfToFloat(data[2]);
+    }
+}
+
+bool SHFaceDecoder::DecodeFace(const SHCubeFaces &faces, CubeMapFace face, bool sRGB, float *r, float *g, float *b)
+{
+    const PODVector<unsigned char> &data = faces.data_[face];
+    const unsigned numTexels = (unsigned)(faces.faceSize_ * faces.faceSize_);
+
+    if (numTexels == 0 || data.Size() < faces.GetFaceBytes())
+        return false;
+
+    if (faces.format_ == SHFace_RGBA16F)
+    {
+        DecodeRGBA16F(reinterpret_cast<const unsigned short*>(&data[0]), numTexels, r, g, b);
+    }
+    else
+    {
+        DecodeRGBA8(&data[0], numTexels, 4, sRGB, r, g, b);
+    }
+
+    return true;
+}
+
+float SHFaceDecoder::HalfToFloat(unsigned short h)
+{
+    const unsigned sign = (unsigned)(h & 0x8000u) << 16;
+    unsigned exponent = (h >> 10) & 0x1fu;
+    unsigned mantissa = h & 0x3ffu;
+    unsigned bits;
+
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            // signed zero
+            bits = sign;
+        }
+        else
+        {
+            // denormal, renormalize
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400u) == 0)
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+        }
+    }
+    else if (exponent == 0x1f)
+    {
+        // inf, nan
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+}
+
+bool SHFaceDecoder::IsF16CSupported()
+{
+    return f16cSupported_;
+}
+
+const float* SHFaceDecoder::GetSRGBToLinearTable()
+{
+    return GetDecodeTables().sRGB_;
+}
+
+const float* SHFaceDecoder::GetUnormToLinearTable()
+{
+    return GetDecodeTables().unorm_;
+}
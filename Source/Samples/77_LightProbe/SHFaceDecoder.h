@@ -0,0 +1,101 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Graphics/GraphicsDefs.h>
+
+using namespace Urho3D;
+
+enum SHFaceFormat
+{
+    SHFace_RGBA8,
+    SHFace_RGBA16F
+};
+
+//=============================================================================
+// raw texel data of the six captured faces, rows top to bottom
+//=============================================================================
+struct SHCubeFaces
+{
+    SHCubeFaces()
+        : faceSize_(0)
+        , format_(SHFace_RGBA8)
+    {
+    }
+
+    unsigned GetTexelSize() const   { return format_ == SHFace_RGBA16F ? 8 : 4; }
+    unsigned GetFaceBytes() const   { return (unsigned)(faceSize_ * faceSize_) * GetTexelSize(); }
+
+    // sizes the readback and plane buffers, no-op when they already fit
+    void Allocate(int faceSize, SHFaceFormat format)
+    {
+        faceSize_ = faceSize;
+        format_ = format;
+
+        const unsigned numTexels = (unsigned)(faceSize * faceSize) * MAX_CUBEMAP_FACES;
+        for ( unsigned i = 0; i < MAX_CUBEMAP_FACES; ++i )
+        {
+            data_[i].Resize(GetFaceBytes());
+        }
+        planeR_.Resize(numTexels);
+        planeG_.Resize(numTexels);
+        planeB_.Resize(numTexels);
+    }
+
+    int faceSize_;
+    SHFaceFormat format_;
+    PODVector<unsigned char> data_[MAX_CUBEMAP_FACES];
+
+    // decoded linear colors, face-major, consumed by the projection
+    PODVector<float> planeR_;
+    PODVector<float> planeG_;
+    PODVector<float> planeB_;
+};
+
+//=============================================================================
+// bulk decode of captured cube faces into the linear float planes consumed
+// by the sh projection, one pass over contiguous memory per face
+//=============================================================================
+class SHFaceDecoder
+{
+public:
+    // 8 bit unorm texels with 3 or 4 components. sRGB input is converted to
+    // linear through a 256 entry table, otherwise it's scaled by 1/255
+    static void DecodeRGBA8(const unsigned char *data, unsigned numTexels, unsigned components, bool sRGB,
+                            float *r, float *g, float *b);
+
+    // half float rgba texels, already linear. uses f16c when the cpu has it
+    static void DecodeRGBA16F(const unsigned short *data, unsigned numTexels, float *r, float *g, float *b);
+    // the fallback without f16c, the reference the f16c path is checked against
+    static void DecodeRGBA16FScalar(const unsigned short *data, unsigned numTexels, float *r, float *g, float *b);
+
+    // decodes one face of either format, sRGB only applies to RGBA8
+    static bool DecodeFace(const SHCubeFaces &faces, CubeMapFace face, bool sRGB, float *r, float *g, float *b);
+
+    static float HalfToFloat(unsigned short h);
+    static bool IsF16CSupported();
+
+    static const float* GetSRGBToLinearTable();
+    static const float* GetUnormToLinearTable();
+};
@@ -0,0 +1,92 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Math/MathDefs.h>
+
+//=============================================================================
+// this unit is built with avx/f16c code generation (see CMakeLists.txt) and
+// is only called when the cpu reports f16c support
+//=============================================================================
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define SH_F16C_ENABLED
+#include <immintrin.h>
+#endif
+
+#include "SHFaceDecoder.h"
+
+#include <Urho3D/DebugNew.h>
+
+#ifdef SH_F16C_ENABLED
+
+bool SHFaceDecoderF16CCompiled()
+{
+    return true;
+}
+
+void SHFaceDecoderF16C(const unsigned short *data, unsigned numTexels, float *r, float *g, float *b)
+{
+    unsigned i = 0;
+
+    // 4 texels per step: convert to rgba rows and transpose into planes
+    for ( ; i + 4 <= numTexels; i += 4, data += 16 )
+    {
+        const __m256 t01 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+        const __m256 t23 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 8)));
+
+        __m128 t0 = _mm256_castps256_ps128(t01);
+        __m128 t1 = _mm256_extractf128_ps(t01, 1);
+        __m128 t2 = _mm256_castps256_ps128(t23);
+        __m128 t3 = _mm256_extractf128_ps(t23, 1);
+        _MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+
+        _mm_storeu_ps(r + i, t0);
+        _mm_storeu_ps(g + i, t1);
+        _mm_storeu_ps(b + i, t2);
+    }
+
+    for ( ; i < numTexels; ++i, data += 4 )
+    {
+        r[i] = _cvtsh_ss(data[0]);
+        g[i] = _cvtsh_ss(data[1]);
+        b[i] = _cvtsh_ss(data[2]);
+    }
+}
+
+#else
+
+bool SHFaceDecoderF16CCompiled()
+{
+    return false;
+}
+
+void SHFaceDecoderF16C(const unsigned short *data, unsigned numTexels, float *r, float *g, float *b)
+{
+    for ( unsigned i = 0; i < numTexels; ++i, data += 4 )
+    {
+        r[i] = SHFaceDecoder::HalfToFloat(data[0]);
+        g[i] = SHFaceDecoder::HalfToFloat(data[1]);
+        b[i] = SHFaceDecoder::HalfToFloat(data[2]);
+    }
+}
+
+#endif
@@ -0,0 +1,427 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/Graphics.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Texture3D.h>
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/Serializer.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+#include "SHIrradianceVolume.h"
+#include "SHProbeSet.h"
+#include "SHTableEncoder.h"
+#include "SHBasis.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+static const char SHIV_MAGIC[4] = { 'S', 'H', 'I', 'V' };
+
+#define MAX_GRID_AXIS           1024
+
+static inline unsigned AlignBlock(unsigned offset)
+{
+    return (offset + 15u) & ~15u;
+}
+
+static inline unsigned NumSlabs(unsigned numCoeffs)
+{
+    return (numCoeffs * 3 + 3) / 4;
+}
+
+//=============================================================================
+//=============================================================================
+SHIrradianceVolume::SHIrradianceVolume(Context* context)
+    : Resource(context)
+    , header_(NULL)
+    , texels_(NULL)
+{
+}
+
+SHIrradianceVolume::~SHIrradianceVolume()
+{
+}
+
+void SHIrradianceVolume::RegisterObject(Context* context)
+{
+    context->RegisterFactory<SHIrradianceVolume>();
+}
+
+bool SHIrradianceVolume::BeginLoad(Deserializer& source)
+{
+    Reset();
+
+    // same as the probe set, map plain files and read packaged ones
+    ResourceCache *cache = GetSubsystem<ResourceCache>();
+    const String fileName = cache ? cache->GetResourceFileName(source.GetName()) : String::EMPTY;
+
+    if (!fileName.Empty() && mappedFile_.Open(fileName))
+    {
+        if (mappedFile_.GetSize() == source.GetSize() && SetData(mappedFile_.GetData(), mappedFile_.GetSize()))
+        {
+            SetMemoryUse(sizeof(SHIrradianceVolume));
+            return true;
+        }
+
+        mappedFile_.Close();
+    }
+
+    ownedData_.Resize(source.GetSize());
+    if (ownedData_.Empty() || source.Read(&ownedData_[0], ownedData_.Size()) != ownedData_.Size())
+    {
+        URHO3D_LOGERROR("SHIrradianceVolume::BeginLoad() could not read " + source.GetName());
+        Reset();
+        return false;
+    }
+
+    if (!SetData(&ownedData_[0], ownedData_.Size()))
+    {
+        URHO3D_LOGERROR("SHIrradianceVolume::BeginLoad() invalid irradiance volume " + source.GetName());
+        Reset();
+        return false;
+    }
+
+    SetMemoryUse(sizeof(SHIrradianceVolume) + ownedData_.Size());
+    return true;
+}
+
+bool SHIrradianceVolume::EndLoad()
+{
+    // the texture is made on first use, headless tools never need one
+    return header_ != NULL;
+}
+
+bool SHIrradianceVolume::Save(Serializer& dest) const
+{
+    if (header_ == NULL)
+        return false;
+
+    return dest.Write(header_, header_->fileSize_) == header_->fileSize_;
+}
+
+bool SHIrradianceVolume::Define(SHProbeSet *probeSet, const BoundingBox &bounds, float cellSize)
+{
+    const unsigned numProbes = probeSet ? probeSet->GetNumProbes() : 0;
+
+    if (numProbes == 0)
+    {
+        URHO3D_LOGERROR("SHIrradianceVolume::Define() no probes to resample");
+        return false;
+    }
+
+    if (!(cellSize > 0.0f))
+    {
+        URHO3D_LOGERROR("SHIrradianceVolume::Define() cell size must be positive");
+        return false;
+    }
+
+    BoundingBox box = bounds;
+    if (!box.Defined())
+    {
+        for ( unsigned i = 0; i < numProbes; ++i )
+        {
+            box.Merge(probeSet->GetPosition(i));
+        }
+    }
+
+    const Vector3 extent = box.Size();
+    const float requestedCellSize = cellSize;
+    unsigned size[3];
+
+    // enough points to cover the bounds, coarser cells if that's too many
+    for ( ;; )
+    {
+        unsigned long long numPoints = 1;
+
+        for ( unsigned a = 0; a < 3; ++a )
+        {
+            size[a] = Min((unsigned)ceilf(extent.Data()[a] / cellSize - 1e-4f) + 1, (unsigned)MAX_GRID_AXIS);
+            numPoints *= size[a];
+        }
+
+        if (numPoints <= MAX_GRID_POINTS)
+            break;
+
+        cellSize *= Max(cbrtf((float)numPoints / (float)MAX_GRID_POINTS), 1.01f);
+    }
+
+    if (cellSize != requestedCellSize)
+    {
+        URHO3D_LOGWARNING("SHIrradianceVolume::Define() cell size raised to " + String(cellSize) +
+                          " to stay within " + String(MAX_GRID_POINTS) + " grid points");
+    }
+
+    const unsigned numCoeffs = probeSet->GetNumIrradianceCoeffs();
+    const unsigned numSlabs = NumSlabs(numCoeffs);
+    const unsigned numPoints = size[0] * size[1] * size[2];
+
+    // centered on the bounds, the grid may overhang them by less than a cell
+    const Vector3 gridExtent = Vector3((float)(size[0] - 1), (float)(size[1] - 1), (float)(size[2] - 1)) * cellSize;
+    const Vector3 origin = box.Center() - gridExtent * 0.5f;
+
+    SHIrradianceVolumeHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic_, SHIV_MAGIC, sizeof(SHIV_MAGIC));
+    header.version_     = VERSION;
+    header.headerSize_  = sizeof(SHIrradianceVolumeHeader);
+    header.numCoeffs_   = numCoeffs;
+    header.numSlabs_    = numSlabs;
+    header.cellSize_    = cellSize;
+    header.dataOffset_  = AlignBlock(sizeof(SHIrradianceVolumeHeader));
+    header.fileSize_    = header.dataOffset_ + numPoints * numSlabs * 4 * sizeof(float);
+
+    for ( unsigned a = 0; a < 3; ++a )
+    {
+        header.size_[a] = size[a];
+        header.origin_[a] = origin.Data()[a];
+    }
+
+    Reset();
+    ownedData_.Resize(header.fileSize_);
+    memset(&ownedData_[0], 0, ownedData_.Size());
+    memcpy(&ownedData_[0], &header, sizeof(header));
+
+    float *texels = (float*)&ownedData_[header.dataOffset_];
+    const ProbeTetraMesh &tetraMesh = probeSet->GetTetraMesh();
+    ProbeSpatialIndex *spatialIndex = probeSet->GetSpatialIndex();
+    const unsigned rowFloats = numSlabs * size[0] * 4;
+    int tetra = -1;
+
+    for ( unsigned z = 0; z < size[2]; ++z )
+    {
+        for ( unsigned y = 0; y < size[1]; ++y )
+        {
+            float *row = texels + (z * size[1] + y) * rowFloats;
+
+            for ( unsigned x = 0; x < size[0]; ++x )
+            {
+                const Vector3 position = origin + Vector3((float)x, (float)y, (float)z) * cellSize;
+                float scalars[SHProbeSet::MAX_IRRADIANCE_FLOATS];
+
+                if (!tetraMesh.IsEmpty())
+                {
+                    // neighbouring points are in the same or the next tetrahedron
+                    unsigned probes[4];
+                    float weights[4];
+                    tetra = tetraMesh.Locate(position, tetra, probes, weights);
+                    probeSet->BlendIrradianceCoeffs(probes, weights, 4, scalars);
+                }
+                else
+                {
+                    const unsigned nearest = (unsigned)spatialIndex->FindNearest(position);
+                    const float weight = 1.0f;
+                    probeSet->BlendIrradianceCoeffs(&nearest, &weight, 1, scalars);
+                }
+
+                for ( unsigned s = 0; s < numSlabs; ++s )
+                {
+                    memcpy(&row[(s * size[0] + x) * 4], &scalars[s * 4], 4 * sizeof(float));
+                }
+            }
+        }
+    }
+
+    SetData(&ownedData_[0], ownedData_.Size());
+    SetMemoryUse(sizeof(SHIrradianceVolume) + ownedData_.Size());
+
+    return true;
+}
+
+Vector3 SHIrradianceVolume::GetOrigin() const
+{
+    return header_ ? Vector3(header_->origin_) : Vector3::ZERO;
+}
+
+BoundingBox SHIrradianceVolume::GetBounds() const
+{
+    if (header_ == NULL)
+        return BoundingBox();
+
+    const Vector3 gridExtent = Vector3((float)(GetSize(0) - 1), (float)(GetSize(1) - 1), (float)(GetSize(2) - 1)) * GetCellSize();
+    return BoundingBox(GetOrigin(), GetOrigin() + gridExtent);
+}
+
+void SHIrradianceVolume::GetGridPoint(int x, int y, int z, Vector3 *coeffs) const
+{
+    const unsigned width = header_->size_[0];
+    const unsigned numSlabs = header_->numSlabs_;
+    const float *row = texels_ + (z * header_->size_[1] + y) * numSlabs * width * 4;
+    float scalars[SHProbeSet::MAX_IRRADIANCE_FLOATS];
+
+    for ( unsigned s = 0; s < numSlabs; ++s )
+    {
+        memcpy(&scalars[s * 4], &row[(s * width + x) * 4], 4 * sizeof(float));
+    }
+
+    memcpy(coeffs, scalars, header_->numCoeffs_ * sizeof(Vector3));
+}
+
+void SHIrradianceVolume::Sample(const Vector3 &position, Vector3 *coeffs) const
+{
+    const unsigned numCoeffs = GetNumCoeffs();
+
+    if (numCoeffs == 0)
+        return;
+
+    // same as the shader, which clamps to the outer texel centers
+    const Vector3 grid = (position - GetOrigin()) / GetCellSize();
+    int i0[3], i1[3];
+    float t[3];
+
+    for ( unsigned a = 0; a < 3; ++a )
+    {
+        const int last = (int)header_->size_[a] - 1;
+        const float g = Clamp(grid.Data()[a], 0.0f, (float)last);
+
+        i0[a] = Min((int)g, last);
+        i1[a] = Min(i0[a] + 1, last);
+        t[a] = g - (float)i0[a];
+    }
+
+    Vector3 corner[SHProbeSet::MAX_IRRADIANCE_COEFFS];
+
+    for ( unsigned k = 0; k < numCoeffs; ++k )
+    {
+        coeffs[k] = Vector3::ZERO;
+    }
+
+    for ( unsigned c = 0; c < 8; ++c )
+    {
+        const float w = ((c & 1) ? t[0] : 1.0f - t[0]) *
+                        ((c & 2) ? t[1] : 1.0f - t[1]) *
+                        ((c & 4) ? t[2] : 1.0f - t[2]);
+
+        if (w == 0.0f)
+            continue;
+
+        GetGridPoint((c & 1) ? i1[0] : i0[0], (c & 2) ? i1[1] : i0[1], (c & 4) ? i1[2] : i0[2], corner);
+
+        for ( unsigned k = 0; k < numCoeffs; ++k )
+        {
+            coeffs[k] += corner[k] * w;
+        }
+    }
+}
+
+Texture3D* SHIrradianceVolume::GetTexture()
+{
+    Graphics *graphics = GetSubsystem<Graphics>();
+
+    if (texture_ || header_ == NULL || graphics == NULL)
+        return texture_;
+
+    const int width = (int)(header_->size_[0] * header_->numSlabs_);
+    const int height = (int)header_->size_[1];
+    const int depth = (int)header_->size_[2];
+    const unsigned numFloats = (unsigned)(width * height * depth * 4);
+
+    PODVector<unsigned short> halfs(numFloats);
+    for ( unsigned i = 0; i < numFloats; ++i )
+    {
+        halfs[i] = SHTableEncoder::FloatToHalf(texels_[i]);
+    }
+
+    texture_ = new Texture3D(context_);
+    texture_->SetName(GetName());
+    texture_->SetNumLevels(1);
+    texture_->SetFilterMode(FILTER_BILINEAR);
+    texture_->SetAddressMode(COORD_U, ADDRESS_CLAMP);
+    texture_->SetAddressMode(COORD_V, ADDRESS_CLAMP);
+    texture_->SetAddressMode(COORD_W, ADDRESS_CLAMP);
+
+    if (!texture_->SetSize(width, height, depth, Graphics::GetRGBAFloat16Format()) ||
+        !texture_->SetData(0, 0, 0, 0, width, height, depth, &halfs[0]))
+    {
+        URHO3D_LOGERROR("SHIrradianceVolume::GetTexture() could not create the volume texture for " + GetName());
+        texture_.Reset();
+    }
+
+    return texture_;
+}
+
+bool SHIrradianceVolume::ApplyToMaterial(Material *material)
+{
+    Texture3D *texture = GetTexture();
+
+    if (material == NULL || texture == NULL)
+        return false;
+
+    // the shader maps world positions to texel units, grid point i at i + 0.5
+    const float invCellSize = 1.0f / GetCellSize();
+
+    material->SetTexture(TU_VOLUMEMAP, texture);
+    material->SetShaderParameter("SHVolumeScale", Vector3::ONE * invCellSize);
+    material->SetShaderParameter("SHVolumeOffset", Vector3::ONE * 0.5f - GetOrigin() * invCellSize);
+    material->SetShaderParameter("SHVolumeSize", Vector4((float)GetSize(0), (float)GetSize(1), (float)GetSize(2), (float)GetNumSlabs()));
+
+    return true;
+}
+
+bool SHIrradianceVolume::SetData(const unsigned char *data, unsigned size)
+{
+    if (size < sizeof(SHIrradianceVolumeHeader))
+        return false;
+
+    const SHIrradianceVolumeHeader *header = (const SHIrradianceVolumeHeader*)data;
+
+    if (memcmp(header->magic_, SHIV_MAGIC, sizeof(SHIV_MAGIC)) != 0 || header->version_ != VERSION)
+        return false;
+
+    if (header->headerSize_ < sizeof(SHIrradianceVolumeHeader) || header->fileSize_ > size ||
+        (header->numCoeffs_ != SHNumCoeffs(SHOrder_L1) && header->numCoeffs_ != SHProbeSet::MAX_IRRADIANCE_COEFFS) ||
+        header->numSlabs_ != NumSlabs(header->numCoeffs_) || !(header->cellSize_ > 0.0f))
+        return false;
+
+    unsigned long long dataSize = header->numSlabs_ * 4 * sizeof(float);
+    for ( unsigned a = 0; a < 3; ++a )
+    {
+        if (header->size_[a] == 0 || header->size_[a] > MAX_GRID_AXIS)
+            return false;
+
+        dataSize *= header->size_[a];
+    }
+
+    if ((header->dataOffset_ & 15u) || header->dataOffset_ < header->headerSize_ || header->dataOffset_ + dataSize > header->fileSize_)
+        return false;
+
+    header_ = header;
+    texels_ = (const float*)(data + header->dataOffset_);
+
+    return true;
+}
+
+void SHIrradianceVolume::Reset()
+{
+    texture_.Reset();
+    header_ = NULL;
+    texels_ = NULL;
+
+    mappedFile_.Close();
+    ownedData_.Clear();
+}
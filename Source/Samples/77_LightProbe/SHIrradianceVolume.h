@@ -0,0 +1,129 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Resource/Resource.h>
+#include <Urho3D/Math/BoundingBox.h>
+
+#include "MappedFile.h"
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Material;
+class Texture3D;
+}
+
+class SHProbeSet;
+
+//=============================================================================
+// binary irradiance volume file (.shvol), little endian:
+//   header
+//   float texels[depth][height][numSlabs][width][4]
+// grid point (x, y, z) sits at origin + (x, y, z) * cellSize. its rgb coeff
+// triples are flattened and split four scalars per slab, slab s of the point
+// is texel (s * width + x, y, z) of the 3d texture the shader samples
+//=============================================================================
+struct SHIrradianceVolumeHeader
+{
+    char magic_[4];
+    unsigned version_;
+    unsigned headerSize_;
+    unsigned numCoeffs_;        // 4 for L1 sets, 9 otherwise
+    unsigned numSlabs_;
+    unsigned size_[3];          // grid points per axis
+    float origin_[3];
+    float cellSize_;
+    unsigned dataOffset_;
+    unsigned fileSize_;
+    unsigned reserved_[2];
+};
+
+//=============================================================================
+// probe set resampled onto a regular grid, so shaders light every pixel from
+// its world position with one hardware trilinear lookup and no probe is
+// assigned on the cpu. only the coeffs irradiance needs are kept, band 3 of
+// the clamped cosine is zero. the slabs share one rgba16f 3d texture, the
+// shader clamps x inside a slab so filtering never mixes two of them
+//=============================================================================
+class SHIrradianceVolume : public Resource
+{
+    URHO3D_OBJECT(SHIrradianceVolume, Resource);
+
+public:
+    SHIrradianceVolume(Context* context);
+    virtual ~SHIrradianceVolume();
+
+    static void RegisterObject(Context* context);
+
+    virtual bool BeginLoad(Deserializer& source);
+    virtual bool EndLoad();
+    virtual bool Save(Serializer& dest) const;
+
+    // resample a probe set. an undefined bounds box uses the probe bounds,
+    // the cell size grows if the grid would exceed MAX_GRID_POINTS. grid
+    // points inside the probe mesh blend their tetrahedron's probes, outside
+    // it the hull is clamped to, sets without a mesh use the nearest probe
+    bool Define(SHProbeSet *probeSet, const BoundingBox &bounds, float cellSize);
+
+    unsigned GetNumCoeffs() const       { return header_ ? header_->numCoeffs_ : 0; }
+    unsigned GetNumSlabs() const        { return header_ ? header_->numSlabs_ : 0; }
+    // grid points along axis 0..2
+    int GetSize(unsigned axis) const    { return header_ ? (int)header_->size_[axis] : 0; }
+    Vector3 GetOrigin() const;
+    float GetCellSize() const           { return header_ ? header_->cellSize_ : 0.0f; }
+    BoundingBox GetBounds() const;
+    bool IsMapped() const               { return mappedFile_.IsOpen(); }
+
+    // cpu reference of the shader lookup: trilinear between grid points,
+    // clamped to the grid. writes GetNumCoeffs() rgb triples, the gpu
+    // texture holds them as half floats
+    void Sample(const Vector3 &position, Vector3 *coeffs) const;
+
+    // rgb coeff triples of a grid point
+    void GetGridPoint(int x, int y, int z, Vector3 *coeffs) const;
+
+    // created on first use, NULL without graphics
+    Texture3D* GetTexture();
+
+    // binds the texture to the volume unit and sets the lookup uniforms,
+    // the material also needs the SH_VOLUME pixel shader define
+    bool ApplyToMaterial(Material *material);
+
+    static const unsigned VERSION = 1;
+    static const unsigned MAX_GRID_POINTS = 64 * 64 * 64;
+
+protected:
+    bool SetData(const unsigned char *data, unsigned size);
+    void Reset();
+
+protected:
+    MappedFile mappedFile_;
+    PODVector<unsigned char> ownedData_;
+
+    // views into the mapped or owned data
+    const SHIrradianceVolumeHeader *header_;
+    const float *texels_;
+
+    SharedPtr<Texture3D> texture_;
+};
@@ -0,0 +1,133 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+
+#include "SHProbeLayout.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+SHProbeLayout::SHProbeLayout()
+    : order_(SHOrder_L2)
+    , encoding_(SHEncode_RGBA8)
+    , numProbes_(0)
+{
+}
+
+String SHProbeLayout::GetShaderDefines() const
+{
+    String defines;
+
+    // L2 and the legacy rgba8 encoding are the shader defaults
+    switch (order_)
+    {
+    case SHOrder_L1: defines += "SH_L1 "; break;
+    case SHOrder_L3: defines += "SH_L3 "; break;
+    }
+
+    switch (encoding_)
+    {
+    case SHEncode_RGBA16F:      defines += "SH_ENC_RGBA16F "; break;
+    case SHEncode_RGB9E5:       defines += "SH_ENC_RGB9E5 "; break;
+    case SHEncode_ScaleBias:    defines += "SH_ENC_SCALEBIAS "; break;
+    default: break;
+    }
+
+    return defines.Trimmed();
+}
+
+bool SHProbeLayout::Load(const XMLElement &root)
+{
+    XMLElement layoutElem = root.GetChild("shprobe");
+
+    if (!layoutElem)
+        return false;
+
+    order_ = Clamp(layoutElem.GetInt("order"), (int)SHOrder_L1, (int)SHOrder_L3);
+    numProbes_ = layoutElem.GetUInt("probes");
+
+    // tables written before the encoding attribute existed are rgba8
+    encoding_ = SHTableEncoder::GetEncodingFromName(layoutElem.GetAttribute("encoding"));
+
+    if (layoutElem.GetUInt("coeffs") != GetNumCoeffs())
+    {
+        URHO3D_LOGERROR("SHProbeLayout::Load() coeff count doesn't match the sh order");
+        return false;
+    }
+
+    return true;
+}
+
+void SHProbeLayout::Save(XMLElement &root) const
+{
+    while (root.RemoveChild("shprobe"));
+
+    XMLElement layoutElem = root.CreateChild("shprobe");
+    layoutElem.SetInt("order", order_);
+    layoutElem.SetUInt("coeffs", GetNumCoeffs());
+    layoutElem.SetAttribute("encoding", SHTableEncoder::GetEncodingName(encoding_));
+    layoutElem.SetUInt("probes", numProbes_);
+}
+
+bool SHProbeLayout::LoadForTexture(Context *context, const String &textureName)
+{
+    ResourceCache *cache = context->GetSubsystem<ResourceCache>();
+    const String xmlName = ReplaceExtension(textureName, ".xml");
+
+    if (!cache->Exists(xmlName))
+        return false;
+
+    XMLFile *xmlFile = cache->GetResource<XMLFile>(xmlName);
+
+    return xmlFile && Load(xmlFile->GetRoot());
+}
+
+bool SHProbeLayout::SaveForTexture(Context *context, const String &imageFilename) const
+{
+    const String xmlPath = ReplaceExtension(imageFilename, ".xml");
+    SharedPtr<XMLFile> xmlFile(new XMLFile(context));
+
+    // keep the texture parameters that are already there
+    if (context->GetSubsystem<FileSystem>()->FileExists(xmlPath))
+    {
+        File infile(context, xmlPath, FILE_READ);
+        xmlFile->Load(infile);
+    }
+
+    XMLElement root = xmlFile->GetRoot("texture");
+    if (!root)
+    {
+        root = xmlFile->CreateRoot("texture");
+    }
+
+    Save(root);
+
+    File outfile(context, xmlPath, FILE_WRITE);
+    return xmlFile->Save(outfile, "    ");
+}
@@ -0,0 +1,72 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/Str.h>
+
+#include "SHBasis.h"
+#include "SHTableEncoder.h"
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Context;
+class XMLElement;
+}
+
+//=============================================================================
+// describes how the probe table is laid out. it's written as a <shprobe>
+// element into the table's texture parameter xml (SHprobeData.xml), which
+// the texture loader ignores, so the runtime can pick a matching shader
+//=============================================================================
+class SHProbeLayout
+{
+public:
+    SHProbeLayout();
+
+    void SetOrder(int order)                { order_ = order; }
+    int GetOrder() const                    { return order_; }
+    unsigned GetNumCoeffs() const           { return SHNumCoeffs(order_); }
+
+    void SetEncoding(SHTableEncoding enc)   { encoding_ = enc; }
+    SHTableEncoding GetEncoding() const     { return encoding_; }
+    unsigned GetTexelsPerProbe() const      { return SHTableEncoder::GetTexelsPerProbe(encoding_, GetNumCoeffs()); }
+
+    void SetNumProbes(unsigned numProbes)   { numProbes_ = numProbes; }
+    unsigned GetNumProbes() const           { return numProbes_; }
+
+    // pixel shader defines for LightProbe.glsl/hlsl
+    String GetShaderDefines() const;
+
+    bool Load(const XMLElement &root);
+    void Save(XMLElement &root) const;
+
+    // read/write the layout in the parameter xml that belongs to a table image
+    bool LoadForTexture(Context *context, const String &textureName);
+    bool SaveForTexture(Context *context, const String &imageFilename) const;
+
+protected:
+    int order_;
+    SHTableEncoding encoding_;
+    unsigned numProbes_;
+};
@@ -0,0 +1,365 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/Serializer.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+#include "SHProbeSet.h"
+#include "SHBasis.h"
+
+#include <cstring>
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+static const char SHPS_MAGIC[4] = { 'S', 'H', 'P', 'S' };
+
+static inline unsigned AlignBlock(unsigned offset)
+{
+    return (offset + 15u) & ~15u;
+}
+
+// probe id with the slot it came from, for sorting
+struct ProbeSlot
+{
+    bool operator <(const ProbeSlot &rhs) const { return id_ < rhs.id_; }
+
+    unsigned id_;
+    unsigned src_;
+};
+
+//=============================================================================
+//=============================================================================
+SHProbeSet::SHProbeSet(Context* context)
+    : Resource(context)
+    , header_(NULL)
+    , ids_(NULL)
+    , positions_(NULL)
+    , coeffs_(NULL)
+    , tetras_(NULL)
+    , tetraMeshChecked_(false)
+{
+}
+
+SHProbeSet::~SHProbeSet()
+{
+}
+
+void SHProbeSet::RegisterObject(Context* context)
+{
+    context->RegisterFactory<SHProbeSet>();
+}
+
+bool SHProbeSet::BeginLoad(Deserializer& source)
+{
+    Reset();
+
+    // map the file in place when it's a plain file in a resource dir,
+    // this runs on the background loader thread too
+    ResourceCache *cache = GetSubsystem<ResourceCache>();
+    const String fileName = cache ? cache->GetResourceFileName(source.GetName()) : String::EMPTY;
+
+    if (!fileName.Empty() && mappedFile_.Open(fileName))
+    {
+        if (mappedFile_.GetSize() == source.GetSize() && SetData(mappedFile_.GetData(), mappedFile_.GetSize()))
+        {
+            SetMemoryUse(sizeof(SHProbeSet));
+            return true;
+        }
+
+        mappedFile_.Close();
+    }
+
+    // packaged or unmappable, read it in one go
+    ownedData_.Resize(source.GetSize());
+    if (ownedData_.Empty() || source.Read(&ownedData_[0], ownedData_.Size()) != ownedData_.Size())
+    {
+        URHO3D_LOGERROR("SHProbeSet::BeginLoad() could not read " + source.GetName());
+        Reset();
+        return false;
+    }
+
+    if (!SetData(&ownedData_[0], ownedData_.Size()))
+    {
+        URHO3D_LOGERROR("SHProbeSet::BeginLoad() invalid probe set " + source.GetName());
+        Reset();
+        return false;
+    }
+
+    SetMemoryUse(sizeof(SHProbeSet) + ownedData_.Size());
+    return true;
+}
+
+bool SHProbeSet::EndLoad()
+{
+    // no gpu resources, everything is ready after BeginLoad()
+    return header_ != NULL;
+}
+
+bool SHProbeSet::Save(Serializer& dest) const
+{
+    if (header_ == NULL)
+        return false;
+
+    return dest.Write(header_, header_->fileSize_) == header_->fileSize_;
+}
+
+bool SHProbeSet::Define(int order, const PODVector<unsigned> &ids, const PODVector<Vector3> &positions,
+                        const PODVector<Vector3> &coeffs)
+{
+    const unsigned numProbes = ids.Size();
+    const unsigned numCoeffs = SHNumCoeffs(order);
+
+    if (positions.Size() != numProbes || coeffs.Size() != numProbes * numCoeffs)
+    {
+        URHO3D_LOGERROR("SHProbeSet::Define() probe data size mismatch");
+        return false;
+    }
+
+    // store in ascending id order
+    PODVector<ProbeSlot> slots(numProbes);
+    for ( unsigned i = 0; i < numProbes; ++i )
+    {
+        slots[i].id_ = ids[i];
+        slots[i].src_ = i;
+    }
+    Sort(slots.Begin(), slots.End());
+
+    // the mesh refers to the sorted slots
+    PODVector<Vector3> slotPositions(numProbes);
+    for ( unsigned i = 0; i < numProbes; ++i )
+    {
+        slotPositions[i] = positions[slots[i].src_];
+    }
+
+    PODVector<ProbeTetra> tetras;
+    if (numProbes && !ProbeTetraMesh::Build(&slotPositions[0], numProbes, sizeof(Vector3), tetras))
+    {
+        URHO3D_LOGWARNING("SHProbeSet::Define() probes don't span a volume, no tetrahedra for blending");
+    }
+
+    for ( unsigned i = 1; i < numProbes; ++i )
+    {
+        if (slots[i].id_ == slots[i - 1].id_)
+        {
+            URHO3D_LOGERROR("SHProbeSet::Define() duplicate probe id " + String(slots[i].id_));
+            return false;
+        }
+    }
+
+    SHProbeSetHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic_, SHPS_MAGIC, sizeof(SHPS_MAGIC));
+    header.version_         = VERSION;
+    header.headerSize_      = sizeof(SHProbeSetHeader);
+    header.numProbes_       = numProbes;
+    header.order_           = (unsigned)order;
+    header.numCoeffs_       = numCoeffs;
+    header.coeffStride_     = (numCoeffs * 3 + 3) & ~3u;
+    header.idOffset_        = AlignBlock(sizeof(SHProbeSetHeader));
+    header.positionOffset_  = AlignBlock(header.idOffset_ + numProbes * sizeof(unsigned));
+    header.coeffOffset_     = AlignBlock(header.positionOffset_ + numProbes * 4 * sizeof(float));
+    header.numTetras_       = tetras.Size();
+    header.tetraOffset_     = AlignBlock(header.coeffOffset_ + numProbes * header.coeffStride_ * sizeof(float));
+    header.fileSize_        = AlignBlock(header.tetraOffset_ + tetras.Size() * sizeof(ProbeTetra));
+
+    Reset();
+    ownedData_.Resize(header.fileSize_);
+    memset(&ownedData_[0], 0, ownedData_.Size());
+    memcpy(&ownedData_[0], &header, sizeof(header));
+
+    unsigned *destIds = (unsigned*)&ownedData_[header.idOffset_];
+    float *destPositions = (float*)&ownedData_[header.positionOffset_];
+    float *destCoeffs = (float*)&ownedData_[header.coeffOffset_];
+
+    for ( unsigned i = 0; i < numProbes; ++i )
+    {
+        const unsigned src = slots[i].src_;
+
+        destIds[i] = slots[i].id_;
+        memcpy(&destPositions[i * 4], &positions[src], sizeof(Vector3));
+        memcpy(&destCoeffs[i * header.coeffStride_], &coeffs[src * numCoeffs], numCoeffs * sizeof(Vector3));
+    }
+
+    if (tetras.Size())
+    {
+        memcpy(&ownedData_[header.tetraOffset_], &tetras[0], tetras.Size() * sizeof(ProbeTetra));
+    }
+
+    SetData(&ownedData_[0], ownedData_.Size());
+    SetMemoryUse(sizeof(SHProbeSet) + ownedData_.Size());
+
+    return true;
+}
+
+int SHProbeSet::FindIndex(unsigned probeID) const
+{
+    const unsigned *begin = ids_;
+    const unsigned *end = ids_ + GetNumProbes();
+
+    // ids are sorted
+    while (begin < end)
+    {
+        const unsigned *mid = begin + (end - begin) / 2;
+
+        if (*mid < probeID)
+            begin = mid + 1;
+        else
+            end = mid;
+    }
+
+    return (begin != ids_ + GetNumProbes() && *begin == probeID) ? (int)(begin - ids_) : -1;
+}
+
+void SHProbeSet::BlendIrradianceCoeffs(const unsigned *slots, const float *weights, unsigned count, float *dest) const
+{
+    const unsigned numFloats = GetNumIrradianceCoeffs() * 3;
+
+    memset(dest, 0, MAX_IRRADIANCE_FLOATS * sizeof(float));
+
+    for ( unsigned j = 0; j < count; ++j )
+    {
+        const float *coeffs = GetCoeffs(slots[j]);
+
+        for ( unsigned k = 0; k < numFloats; ++k )
+        {
+            dest[k] += coeffs[k] * weights[j];
+        }
+    }
+}
+
+bool SHProbeSet::SetData(const unsigned char *data, unsigned size)
+{
+    if (size < sizeof(SHProbeSetHeader))
+        return false;
+
+    const SHProbeSetHeader *header = (const SHProbeSetHeader*)data;
+    const unsigned numProbes = header->numProbes_;
+
+    if (memcmp(header->magic_, SHPS_MAGIC, sizeof(SHPS_MAGIC)) != 0 || header->version_ < 1 || header->version_ > VERSION)
+        return false;
+
+    if (header->headerSize_ < sizeof(SHProbeSetHeader) || header->fileSize_ > size ||
+        header->order_ < SHOrder_L1 || header->order_ > SHOrder_L3 ||
+        header->numCoeffs_ != SHNumCoeffs(header->order_) || header->coeffStride_ < header->numCoeffs_ * 3)
+        return false;
+
+    // blocks must be aligned and lie inside the file
+    const unsigned offsets[3] = { header->idOffset_, header->positionOffset_, header->coeffOffset_ };
+    const unsigned long long blockSizes[3] =
+    {
+        (unsigned long long)numProbes * sizeof(unsigned),
+        (unsigned long long)numProbes * 4 * sizeof(float),
+        (unsigned long long)numProbes * header->coeffStride_ * sizeof(float)
+    };
+
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        if ((offsets[i] & 15u) || offsets[i] < header->headerSize_ || offsets[i] + blockSizes[i] > header->fileSize_)
+            return false;
+    }
+
+    // version 1 files have no tetrahedra, the fields were reserved
+    const unsigned numTetras = header->version_ >= 2 ? header->numTetras_ : 0;
+    if (numTetras)
+    {
+        const unsigned long long tetraSize = (unsigned long long)numTetras * sizeof(ProbeTetra);
+        if ((header->tetraOffset_ & 15u) || header->tetraOffset_ < header->headerSize_ || header->tetraOffset_ + tetraSize > header->fileSize_)
+            return false;
+    }
+
+    header_ = header;
+    ids_ = (const unsigned*)(data + header->idOffset_);
+    positions_ = (const float*)(data + header->positionOffset_);
+    coeffs_ = (const float*)(data + header->coeffOffset_);
+    tetras_ = numTetras ? (const ProbeTetra*)(data + header->tetraOffset_) : NULL;
+
+    return true;
+}
+
+ProbeSpatialIndex* SHProbeSet::GetSpatialIndex()
+{
+    if (spatialIndex_ == NULL)
+    {
+        spatialIndex_ = new ProbeSpatialIndex();
+
+        if (GetNumProbes())
+        {
+            spatialIndex_->Build(reinterpret_cast<const Vector3*>(positions_), GetNumProbes(), sizeof(float) * 4);
+        }
+    }
+
+    return spatialIndex_;
+}
+
+const ProbeTetraMesh& SHProbeSet::GetTetraMesh()
+{
+    if (!tetraMeshChecked_)
+    {
+        tetraMeshChecked_ = true;
+
+        const unsigned numTetras = tetras_ ? header_->numTetras_ : 0;
+        const unsigned numProbes = GetNumProbes();
+        bool valid = true;
+
+        // the walk follows these blindly
+        for ( unsigned i = 0; i < numTetras && valid; ++i )
+        {
+            for ( unsigned j = 0; j < 4; ++j )
+            {
+                if (tetras_[i].probes_[j] >= numProbes || tetras_[i].neighbors_[j] >= (int)numTetras || tetras_[i].neighbors_[j] < -1)
+                    valid = false;
+            }
+        }
+
+        if (valid)
+        {
+            tetraMesh_.SetData(tetras_, numTetras);
+        }
+        else
+        {
+            URHO3D_LOGERROR("SHProbeSet::GetTetraMesh() invalid tetrahedra in " + GetName());
+        }
+    }
+
+    return tetraMesh_;
+}
+
+void SHProbeSet::Reset()
+{
+    spatialIndex_.Reset();
+    tetraMesh_.SetData(NULL, 0);
+    tetraMeshChecked_ = false;
+    tetras_ = NULL;
+    header_ = NULL;
+    ids_ = NULL;
+    positions_ = NULL;
+    coeffs_ = NULL;
+
+    mappedFile_.Close();
+    ownedData_.Clear();
+}
@@ -0,0 +1,133 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Resource/Resource.h>
+
+#include "MappedFile.h"
+#include "ProbeSpatialIndex.h"
+#include "ProbeTetraMesh.h"
+
+using namespace Urho3D;
+
+//=============================================================================
+// binary probe set file (.shps), little endian, every block 16 byte aligned:
+//   header
+//   unsigned ids[numProbes]                 ascending, unique
+//   float    positions[numProbes][4]        world position, w unused
+//   float    coeffs[numProbes][coeffStride] rgb triples, zero padded
+//   ProbeTetra tetras[numTetras]            delaunay mesh over the slots (v2)
+// probe i is also slot i of the gpu sh table written next to it
+//=============================================================================
+struct SHProbeSetHeader
+{
+    char magic_[4];
+    unsigned version_;
+    unsigned headerSize_;
+    unsigned numProbes_;
+    unsigned order_;
+    unsigned numCoeffs_;
+    unsigned coeffStride_;      // floats per probe
+    unsigned idOffset_;
+    unsigned positionOffset_;
+    unsigned coeffOffset_;
+    unsigned fileSize_;
+    unsigned numTetras_;
+    unsigned tetraOffset_;
+    unsigned reserved_[3];
+};
+
+//=============================================================================
+// probe set resource. a file served from a resource dir is mapped and used
+// in place, so opening it costs a header check no matter how many probes
+// it holds; packaged files are read into memory in one block
+//=============================================================================
+class SHProbeSet : public Resource
+{
+    URHO3D_OBJECT(SHProbeSet, Resource);
+
+public:
+    SHProbeSet(Context* context);
+    virtual ~SHProbeSet();
+
+    static void RegisterObject(Context* context);
+
+    virtual bool BeginLoad(Deserializer& source);
+    virtual bool EndLoad();
+    virtual bool Save(Serializer& dest) const;
+
+    // build from baked data, probes are stored in ascending id order
+    bool Define(int order, const PODVector<unsigned> &ids, const PODVector<Vector3> &positions,
+                const PODVector<Vector3> &coeffs);
+
+    unsigned GetNumProbes() const       { return header_ ? header_->numProbes_ : 0; }
+    int GetOrder() const                { return header_ ? (int)header_->order_ : 0; }
+    unsigned GetNumCoeffs() const       { return header_ ? header_->numCoeffs_ : 0; }
+    bool IsMapped() const               { return mappedFile_.IsOpen(); }
+
+    unsigned GetProbeID(unsigned index) const       { return ids_[index]; }
+    const Vector3& GetPosition(unsigned index) const { return *reinterpret_cast<const Vector3*>(&positions_[index * 4]); }
+    // numCoeffs rgb triples
+    const float* GetCoeffs(unsigned index) const    { return &coeffs_[index * header_->coeffStride_]; }
+
+    // coeffs irradiance needs, band 3 of the clamped cosine is zero
+    unsigned GetNumIrradianceCoeffs() const { return Min(GetNumCoeffs(), MAX_IRRADIANCE_COEFFS); }
+
+    // weighted sum of count probes' irradiance coeffs as flat rgb scalars,
+    // zero padded to a multiple of four. writes MAX_IRRADIANCE_FLOATS
+    void BlendIrradianceCoeffs(const unsigned *slots, const float *weights, unsigned count, float *dest) const;
+
+    // slot of a probe id, -1 if the set doesn't have it
+    int FindIndex(unsigned probeID) const;
+
+    // nearest and radius queries over the probe positions, index slots are
+    // set slots. built on first use, so opening the set stays cheap
+    ProbeSpatialIndex* GetSpatialIndex();
+
+    // tetrahedra between the probes for blended lookups, built by Define().
+    // empty for flat sets and version 1 files. checked on first use
+    const ProbeTetraMesh& GetTetraMesh();
+
+    static const unsigned VERSION = 2;
+    static const unsigned MAX_IRRADIANCE_COEFFS = 9;
+    static const unsigned MAX_IRRADIANCE_FLOATS = 28;
+
+protected:
+    bool SetData(const unsigned char *data, unsigned size);
+    void Reset();
+
+protected:
+    MappedFile mappedFile_;
+    PODVector<unsigned char> ownedData_;
+
+    // views into the mapped or owned data
+    const SHProbeSetHeader *header_;
+    const unsigned *ids_;
+    const float *positions_;
+    const float *coeffs_;
+    const ProbeTetra *tetras_;
+
+    SharedPtr<ProbeSpatialIndex> spatialIndex_;
+    ProbeTetraMesh tetraMesh_;
+    bool tetraMeshChecked_;
+};
@@ -0,0 +1,181 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Math/MathDefs.h>
+
+#ifdef URHO3D_SSE
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#include "SHProjection.h"
+#include "SHProjectionKernel.h"
+
+#include <Urho3D/DebugNew.h>
+
+// implemented in SHProjectionAVX2.cpp
+extern bool SHProjectionAVX2Compiled();
+template <int Order> void SHProjectionAVX2(const SHProjectionInput &input, Vector3 *coeffs);
+
+//=============================================================================
+//=============================================================================
+#ifdef URHO3D_SSE
+namespace SHKernel
+{
+struct SSE2Ops
+{
+    typedef __m128 Reg;
+    enum { Width = 4 };
+
+    static inline Reg Zero()                        { return _mm_setzero_ps(); }
+    static inline Reg Set(float v)                  { return _mm_set1_ps(v); }
+    static inline Reg Load(const float *p)          { return _mm_loadu_ps(p); }
+    static inline Reg Add(Reg a, Reg b)             { return _mm_add_ps(a, b); }
+    static inline Reg Sub(Reg a, Reg b)             { return _mm_sub_ps(a, b); }
+    static inline Reg Mul(Reg a, Reg b)             { return _mm_mul_ps(a, b); }
+    static inline float Sum(Reg a)
+    {
+        Reg shuf = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+        Reg sums = _mm_add_ps(a, shuf);
+        shuf = _mm_movehl_ps(shuf, sums);
+        return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+    }
+};
+}
+#endif
+
+static bool CPUSupportsAVX2()
+{
+#if defined(URHO3D_SSE) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    // os must save the ymm state (osxsave + avx)
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(URHO3D_SSE) && defined(__GNUC__)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return false;
+#endif
+}
+
+static SHKernelType DetectKernelType()
+{
+    if (SHProjectionAVX2Compiled() && CPUSupportsAVX2())
+        return SHKernel_AVX2;
+
+#ifdef URHO3D_SSE
+    return SHKernel_SSE2;
+#else
+    return SHKernel_Scalar;
+#endif
+}
+
+static SHKernelType activeKernel_ = DetectKernelType();
+
+//=============================================================================
+//=============================================================================
+template <int Order>
+void SHProjection::Project(const SHProjectionInput &input, Vector3 *coeffs)
+{
+    switch (activeKernel_)
+    {
+    case SHKernel_AVX2:
+        SHProjectionAVX2<Order>(input, coeffs);
+        break;
+
+#ifdef URHO3D_SSE
+    case SHKernel_SSE2:
+        SHKernel::Project<Order, SHKernel::SSE2Ops>(input, coeffs);
+        break;
+#endif
+
+    default:
+        SHKernel::Project<Order, SHKernel::ScalarOps>(input, coeffs);
+        break;
+    }
+}
+
+template void SHProjection::Project<SHOrder_L1>(const SHProjectionInput &input, Vector3 *coeffs);
+template void SHProjection::Project<SHOrder_L2>(const SHProjectionInput &input, Vector3 *coeffs);
+template void SHProjection::Project<SHOrder_L3>(const SHProjectionInput &input, Vector3 *coeffs);
+
+SHKernelType SHProjection::GetKernelType()
+{
+    return activeKernel_;
+}
+
+void SHProjection::SetKernelType(SHKernelType type)
+{
+    if (type == SHKernel_Auto)
+    {
+        activeKernel_ = DetectKernelType();
+    }
+    else if (IsKernelSupported(type))
+    {
+        activeKernel_ = type;
+    }
+}
+
+bool SHProjection::IsKernelSupported(SHKernelType type)
+{
+    switch (type)
+    {
+    case SHKernel_Scalar:
+        return true;
+
+    case SHKernel_SSE2:
+#ifdef URHO3D_SSE
+        return true;
+#else
+        return false;
+#endif
+
+    case SHKernel_AVX2:
+        return SHProjectionAVX2Compiled() && CPUSupportsAVX2();
+
+    default:
+        return false;
+    }
+}
+
+const char* SHProjection::GetKernelName(SHKernelType type)
+{
+    switch (type)
+    {
+    case SHKernel_Scalar: return "scalar";
+    case SHKernel_SSE2:   return "sse2";
+    case SHKernel_AVX2:   return "avx2";
+    default:              return "auto";
+    }
+}
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Math/MathDefs.h>
+
+//=============================================================================
+// this unit is built with avx2 code generation (see CMakeLists.txt) and is
+// only called when the cpu reports avx2 support
+//=============================================================================
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "SHProjection.h"
+#include "SHProjectionKernel.h"
+
+#include <Urho3D/DebugNew.h>
+
+#ifdef __AVX2__
+namespace
+{
+// unit local, so the kernel templates instantiated with these are vex encoded
+// copies of their own and never merged with another unit's
+struct AVX2Ops
+{
+    typedef __m256 Reg;
+    enum { Width = 8 };
+
+    static inline Reg Zero()                        { return _mm256_setzero_ps(); }
+    static inline Reg Set(float v)                  { return _mm256_set1_ps(v); }
+    static inline Reg Load(const float *p)          { return _mm256_loadu_ps(p); }
+    static inline Reg Add(Reg a, Reg b)             { return _mm256_add_ps(a, b); }
+    static inline Reg Sub(Reg a, Reg b)             { return _mm256_sub_ps(a, b); }
+    static inline Reg Mul(Reg a, Reg b)             { return _mm256_mul_ps(a, b); }
+    static inline float Sum(Reg a)
+    {
+        __m128 lo = _mm256_castps256_ps128(a);
+        __m128 hi = _mm256_extractf128_ps(a, 1);
+        lo = _mm_add_ps(lo, hi);
+        __m128 shuf = _mm_movehdup_ps(lo);
+        __m128 sums = _mm_add_ps(lo, shuf);
+        shuf = _mm_movehl_ps(shuf, sums);
+        return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+    }
+};
+
+// the remainder, same as SHKernel::ScalarOps
+struct AVX2TailOps
+{
+    typedef float Reg;
+    enum { Width = 1 };
+
+    static inline Reg Zero()                        { return 0.0f; }
+    static inline Reg Set(float v)                  { return v; }
+    static inline Reg Load(const float *p)          { return *p; }
+    static inline Reg Add(Reg a, Reg b)             { return a + b; }
+    static inline Reg Sub(Reg a, Reg b)             { return a - b; }
+    static inline Reg Mul(Reg a, Reg b)             { return a * b; }
+    static inline float Sum(Reg a)                  { return a; }
+};
+}
+
+bool SHProjectionAVX2Compiled()
+{
+    return true;
+}
+
+template <int Order>
+void SHProjectionAVX2(const SHProjectionInput &input, Vector3 *coeffs)
+{
+    SHKernel::Project<Order, AVX2Ops, AVX2TailOps>(input, coeffs);
+}
+
+#else
+
+bool SHProjectionAVX2Compiled()
+{
+    return false;
+}
+
+template <int Order>
+void SHProjectionAVX2(const SHProjectionInput &input, Vector3 *coeffs)
+{
+    SHKernel::Project<Order, SHKernel::ScalarOps>(input, coeffs);
+}
+
+#endif
+
+template void SHProjectionAVX2<SHOrder_L1>(const SHProjectionInput &input, Vector3 *coeffs);
+template void SHProjectionAVX2<SHOrder_L2>(const SHProjectionInput &input, Vector3 *coeffs);
+template void SHProjectionAVX2<SHOrder_L3>(const SHProjectionInput &input, Vector3 *coeffs);
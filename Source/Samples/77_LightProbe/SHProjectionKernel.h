@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include "SHProjection.h"
+#include "SHBasis.h"
+
+//=============================================================================
+// shared kernel body, included by each instruction set translation unit so
+// that it's compiled with that unit's target flags.
+//
+// based on: An Efficient Representation for Irradiance Environment Maps
+// http://graphics.stanford.edu/papers/envmap/
+//=============================================================================
+namespace SHKernel
+{
+struct ScalarOps
+{
+    typedef float Reg;
+    enum { Width = 1 };
+
+    static inline Reg Zero()                        { return 0.0f; }
+    static inline Reg Set(float v)                  { return v; }
+    static inline Reg Load(const float *p)          { return *p; }
+    static inline Reg Add(Reg a, Reg b)             { return a + b; }
+    static inline Reg Sub(Reg a, Reg b)             { return a - b; }
+    static inline Reg Mul(Reg a, Reg b)             { return a * b; }
+    static inline float Sum(Reg a)                  { return a; }
+};
+
+template <int Order, class Ops>
+inline void ProjectRange(const SHProjectionInput &in, unsigned begin, unsigned end, Vector3 *coeffs)
+{
+    typedef typename Ops::Reg Reg;
+    enum { NumCoeffs = SHBasis<Order>::NumCoeffs };
+
+    const Reg sx = Ops::Set(in.signX_);
+    const Reg sy = Ops::Set(in.signY_);
+    const Reg sz = Ops::Set(in.signZ_);
+
+    // lane-wise accumulators, [coeff][channel]
+    Reg acc[NumCoeffs][3];
+    for ( int i = 0; i < NumCoeffs; ++i )
+    {
+        acc[i][0] = acc[i][1] = acc[i][2] = Ops::Zero();
+    }
+
+    for ( unsigned i = begin; i < end; i += Ops::Width )
+    {
+        const Reg x = Ops::Mul(sx, Ops::Load(in.dirX_ + i));
+        const Reg y = Ops::Mul(sy, Ops::Load(in.dirY_ + i));
+        const Reg z = Ops::Mul(sz, Ops::Load(in.dirZ_ + i));
+        const Reg w = Ops::Load(in.weight_ + i);
+        const Reg col[3] = { Ops::Mul(w, Ops::Load(in.r_ + i)), Ops::Mul(w, Ops::Load(in.g_ + i)), Ops::Mul(w, Ops::Load(in.b_ + i)) };
+
+        Reg basis[NumCoeffs];
+        SHBasis<Order>::template Evaluate<Ops>(x, y, z, basis);
+
+        for ( int j = 0; j < NumCoeffs; ++j )
+        {
+            acc[j][0] = Ops::Add(acc[j][0], Ops::Mul(basis[j], col[0]));
+            acc[j][1] = Ops::Add(acc[j][1], Ops::Mul(basis[j], col[1]));
+            acc[j][2] = Ops::Add(acc[j][2], Ops::Mul(basis[j], col[2]));
+        }
+    }
+
+    // single reduction at the end
+    for ( int j = 0; j < NumCoeffs; ++j )
+    {
+        coeffs[j].x_ += Ops::Sum(acc[j][0]);
+        coeffs[j].y_ += Ops::Sum(acc[j][1]);
+        coeffs[j].z_ += Ops::Sum(acc[j][2]);
+    }
+}
+
+// units built with other target flags pass their own TailOps, so none of
+// their template instances is shared with (and picked by the linker over)
+// the scalar ones of the baseline units
+template <int Order, class Ops, class TailOps = ScalarOps>
+inline void Project(const SHProjectionInput &in, Vector3 *coeffs)
+{
+    const unsigned simdEnd = in.count_ - (in.count_ % Ops::Width);
+
+    ProjectRange<Order, Ops>(in, 0, simdEnd, coeffs);
+
+    // remainder
+    if (simdEnd < in.count_)
+    {
+        ProjectRange<Order, TailOps>(in, simdEnd, in.count_, coeffs);
+    }
+}
+}
@@ -0,0 +1,279 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Math/MathDefs.h>
+
+#include "SHTableEncoder.h"
+#include "SHFaceDecoder.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+static const char* encodingNames_[SHEncode_Max] =
+{
+    "rgba8",
+    "rgba16f",
+    "rgb9e5",
+    "scalebias"
+};
+
+static inline unsigned char QuantizeUnorm8(float value)
+{
+    return (unsigned char)Clamp((int)(value * 255.0f + 0.5f), 0, 255);
+}
+
+// scalar k of the coeff array, in rgb order
+static inline float GetScalar(const Vector3 *coeffs, unsigned k)
+{
+    return coeffs[k / 3].Data()[k % 3];
+}
+
+static inline void SetScalar(Vector3 *coeffs, unsigned k, float value)
+{
+    (&coeffs[k / 3].x_)[k % 3] = value;
+}
+
+//=============================================================================
+//=============================================================================
+unsigned SHTableEncoder::GetTexelsPerProbe(SHTableEncoding encoding, unsigned numCoeffs)
+{
+    const unsigned numScalars = numCoeffs * 3;
+
+    switch (encoding)
+    {
+    case SHEncode_RGBA16F:      return (numScalars + 1) / 2;
+    case SHEncode_ScaleBias:    return 1 + (numScalars + 3) / 4;
+    default: break;
+    }
+
+    return numCoeffs;
+}
+
+void SHTableEncoder::Encode(SHTableEncoding encoding, const Vector3 *coeffs, unsigned numCoeffs, unsigned char *dest)
+{
+    const unsigned numScalars = numCoeffs * 3;
+    memset(dest, 0, GetTexelsPerProbe(encoding, numCoeffs) * 4);
+
+    switch (encoding)
+    {
+    case SHEncode_RGBA16F:
+        {
+            // little endian halves: rg = even scalar, ba = odd scalar
+            for ( unsigned k = 0; k < numScalars; ++k )
+            {
+                const unsigned short h = FloatToHalf(GetScalar(coeffs, k));
+                dest[k * 2 + 0] = (unsigned char)(h & 0xff);
+                dest[k * 2 + 1] = (unsigned char)(h >> 8);
+            }
+        }
+        break;
+
+    case SHEncode_RGB9E5:
+        {
+            for ( unsigned i = 0; i < numCoeffs; ++i )
+            {
+                const Vector3 &c = coeffs[i];
+                const float maxAbs = Max(Max(Abs(c.x_), Abs(c.y_)), Abs(c.z_));
+                unsigned char *texel = &dest[i * 4];
+
+                // smallest exponent that keeps the largest channel within 8 bits
+                int exponent = 0;
+                if (maxAbs > 0.0f)
+                {
+                    exponent = Clamp((int)ceilf(log2f(maxAbs / 255.0f)) + RGB9E5_EXP_BIAS, 0, 31);
+                    if (exponent < 31 && maxAbs * exp2f((float)(RGB9E5_EXP_BIAS - exponent)) + 0.5f >= 256.0f)
+                    {
+                        ++exponent;
+                    }
+                }
+
+                const float invScale = exp2f((float)(RGB9E5_EXP_BIAS - exponent));
+                unsigned signs = 0;
+
+                for ( unsigned j = 0; j < 3; ++j )
+                {
+                    const float value = c.Data()[j];
+                    texel[j] = (unsigned char)Min((int)(Abs(value) * invScale + 0.5f), 255);
+                    if (value < 0.0f && texel[j] != 0)
+                    {
+                        signs |= 1u << j;
+                    }
+                }
+
+                texel[3] = (unsigned char)((signs << 5) | (unsigned)exponent);
+            }
+        }
+        break;
+
+    case SHEncode_ScaleBias:
+        {
+            float minValue = M_INFINITY;
+            float maxValue = -M_INFINITY;
+
+            for ( unsigned k = 0; k < numScalars; ++k )
+            {
+                minValue = Min(minValue, GetScalar(coeffs, k));
+                maxValue = Max(maxValue, GetScalar(coeffs, k));
+            }
+
+            // round the half bias down and the half scale up so the range
+            // is still covered after the header is quantized
+            const unsigned short biasH = FloatToHalf(minValue - Abs(minValue) * (1.0f / 1024.0f));
+            const float bias = SHFaceDecoder::HalfToFloat(biasH);
+            const unsigned short scaleH = FloatToHalf((maxValue - bias) * (1.0f + 1.0f / 1024.0f));
+            const float scale = SHFaceDecoder::HalfToFloat(scaleH);
+            const float invScale = scale > 0.0f ? 1.0f / scale : 0.0f;
+
+            dest[0] = (unsigned char)(scaleH & 0xff);
+            dest[1] = (unsigned char)(scaleH >> 8);
+            dest[2] = (unsigned char)(biasH & 0xff);
+            dest[3] = (unsigned char)(biasH >> 8);
+
+            for ( unsigned k = 0; k < numScalars; ++k )
+            {
+                dest[4 + k] = QuantizeUnorm8((GetScalar(coeffs, k) - bias) * invScale);
+            }
+        }
+        break;
+
+    default:
+        {
+            for ( unsigned i = 0; i < numCoeffs; ++i )
+            {
+                const Vector3 c = coeffs[i] * 0.1f + Vector3::ONE * 0.5f;
+                dest[i * 4 + 0] = QuantizeUnorm8(c.x_);
+                dest[i * 4 + 1] = QuantizeUnorm8(c.y_);
+                dest[i * 4 + 2] = QuantizeUnorm8(c.z_);
+                dest[i * 4 + 3] = 255;
+            }
+        }
+        break;
+    }
+}
+
+void SHTableEncoder::Decode(SHTableEncoding encoding, const unsigned char *src, unsigned numCoeffs, Vector3 *coeffs)
+{
+    const unsigned numScalars = numCoeffs * 3;
+
+    switch (encoding)
+    {
+    case SHEncode_RGBA16F:
+        {
+            for ( unsigned k = 0; k < numScalars; ++k )
+            {
+                const unsigned short h = (unsigned short)(src[k * 2] | (src[k * 2 + 1] << 8));
+                SetScalar(coeffs, k, SHFaceDecoder::HalfToFloat(h));
+            }
+        }
+        break;
+
+    case SHEncode_RGB9E5:
+        {
+            for ( unsigned i = 0; i < numCoeffs; ++i )
+            {
+                const unsigned char *texel = &src[i * 4];
+                const float scale = exp2f((float)((int)(texel[3] & 0x1f) - RGB9E5_EXP_BIAS));
+
+                for ( unsigned j = 0; j < 3; ++j )
+                {
+                    const float sign = (texel[3] >> (5 + j)) & 1 ? -1.0f : 1.0f;
+                    SetScalar(coeffs, i * 3 + j, sign * (float)texel[j] * scale);
+                }
+            }
+        }
+        break;
+
+    case SHEncode_ScaleBias:
+        {
+            const float scale = SHFaceDecoder::HalfToFloat((unsigned short)(src[0] | (src[1] << 8)));
+            const float bias = SHFaceDecoder::HalfToFloat((unsigned short)(src[2] | (src[3] << 8)));
+
+            for ( unsigned k = 0; k < numScalars; ++k )
+            {
+                SetScalar(coeffs, k, (float)src[4 + k] / 255.0f * scale + bias);
+            }
+        }
+        break;
+
+    default:
+        {
+            for ( unsigned i = 0; i < numCoeffs; ++i )
+            {
+                const Vector3 c((float)src[i * 4 + 0], (float)src[i * 4 + 1], (float)src[i * 4 + 2]);
+                coeffs[i] = (c / 255.0f - Vector3::ONE * 0.5f) * 10.0f;
+            }
+        }
+        break;
+    }
+}
+
+const char* SHTableEncoder::GetEncodingName(SHTableEncoding encoding)
+{
+    return encodingNames_[Clamp((int)encoding, 0, (int)SHEncode_Max - 1)];
+}
+
+SHTableEncoding SHTableEncoder::GetEncodingFromName(const String &name)
+{
+    for ( int i = 0; i < SHEncode_Max; ++i )
+    {
+        if (name.Compare(encodingNames_[i], false) == 0)
+        {
+            return (SHTableEncoding)i;
+        }
+    }
+
+    return SHEncode_RGBA8;
+}
+
+unsigned short SHTableEncoder::FloatToHalf(float value)
+{
+    unsigned bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    const unsigned short sign = (unsigned short)((bits >> 16) & 0x8000u);
+    const float absValue = Abs(value);
+
+    // largest finite half
+    if (!(absValue < 65504.0f))
+        return (unsigned short)(sign | 0x7bffu);
+
+    // subnormal halves are multiples of 2^-24
+    if (absValue < 6.103515625e-05f)
+        return (unsigned short)(sign | (unsigned)(absValue * 16777216.0f + 0.5f));
+
+    // rebias the exponent and round the mantissa to 10 bits, a carry
+    // out of the mantissa correctly bumps the exponent
+    const unsigned absBits = bits & 0x7fffffffu;
+    unsigned h = ((absBits >> 13) - ((127u - 15u) << 10));
+    const unsigned rest = absBits & 0x1fffu;
+
+    if (rest > 0x1000u || (rest == 0x1000u && (h & 1u)))
+    {
+        ++h;
+    }
+
+    return (unsigned short)(sign | Min(h, 0x7bffu));
+}
@@ -0,0 +1,62 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+
+// how coeffs are packed into the rgba8 texels of the probe table
+enum SHTableEncoding
+{
+    SHEncode_RGBA8,         // legacy: c * 0.1 + 0.5 per texel, clamped to [-5, 5]
+    SHEncode_RGBA16F,       // half floats, two per texel, no clamping
+    SHEncode_RGB9E5,        // 8 bit magnitude + sign per channel, shared 5 bit exponent
+    SHEncode_ScaleBias,     // one half float scale/bias texel per probe + 8 bit unorm values
+    SHEncode_Max
+};
+
+//=============================================================================
+// packs a probe's sh coeffs into table texels and back. the decode mirrors
+// GetSH() in LightProbe.glsl/hlsl, so it can be used to measure the error of
+// an encoding on the cpu
+//=============================================================================
+class SHTableEncoder
+{
+public:
+    static unsigned GetTexelsPerProbe(SHTableEncoding encoding, unsigned numCoeffs);
+
+    // writes GetTexelsPerProbe() * 4 bytes
+    static void Encode(SHTableEncoding encoding, const Vector3 *coeffs, unsigned numCoeffs, unsigned char *dest);
+    static void Decode(SHTableEncoding encoding, const unsigned char *src, unsigned numCoeffs, Vector3 *coeffs);
+
+    static const char* GetEncodingName(SHTableEncoding encoding);
+    static SHTableEncoding GetEncodingFromName(const String &name);
+
+    // round to nearest, clamped to the largest finite half
+    static unsigned short FloatToHalf(float value);
+
+    // shared exponent bias of SHEncode_RGB9E5, value = mantissa * 2^(exp - bias)
+    static const int RGB9E5_EXP_BIAS = 20;
+};
@@ -0,0 +1,223 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Graphics/GraphicsDefs.h>
+
+#include "SHTileProjector.h"
+#include "SHBasis.h"
+#include "SHProjection.h"
+#include "CubeTexelTable.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+// approximate texels per tile, tiles are whole rows of a face
+#define TILE_TEXELS     1024
+
+SHTileProjector::SHTileProjector(int order, const CubeTexelTable *texelTable, const float *colR, const float *colG, const float *colB)
+    : order_(order)
+    , numCoeffs_(SHNumCoeffs(order))
+    , texelTable_(texelTable)
+    , colR_(colR)
+    , colG_(colG)
+    , colB_(colB)
+    , nextTile_(0)
+    , busyUSec_(0)
+    , numActiveJobs_(0)
+    , jobCoeffs_(NULL)
+    , doneJob_(NULL)
+{
+    const unsigned faceSize = (unsigned)texelTable_->GetFaceSize();
+    const unsigned rowsPerTile = Max(TILE_TEXELS / faceSize, 1u);
+
+    for ( unsigned face = 0; face < MAX_CUBEMAP_FACES; ++face )
+    {
+        for ( unsigned row = 0; row < faceSize; row += rowsPerTile )
+        {
+            Tile tile;
+            tile.face_  = face;
+            tile.begin_ = row * faceSize;
+            tile.end_   = Min(row + rowsPerTile, faceSize) * faceSize;
+            tiles_.Push(tile);
+        }
+    }
+
+    partials_.Resize(tiles_.Size() * numCoeffs_);
+}
+
+void SHTileProjector::ResetTiles()
+{
+    for ( unsigned i = 0; i < partials_.Size(); ++i )
+    {
+        partials_[i] = Vector3::ZERO;
+    }
+    nextTile_ = 0;
+    busyUSec_ = 0;
+}
+
+void SHTileProjector::Run(unsigned numThreads, Vector3 *coeffs)
+{
+    ResetTiles();
+
+    // no more threads than tiles, the calling thread is one of them
+    numThreads = Clamp(numThreads, 1u, tiles_.Size());
+
+    Vector<SharedPtr<HelperThread<SHTileProjector> > > workers;
+    for ( unsigned i = 1; i < numThreads; ++i )
+    {
+        SharedPtr<HelperThread<SHTileProjector> > worker(new HelperThread<SHTileProjector>(this, &SHTileProjector::WorkerProcess, false));
+        worker->Start();
+        workers.Push(worker);
+    }
+
+    ProcessTiles();
+
+    // joins the workers
+    workers.Clear();
+
+    ReduceTiles(coeffs);
+}
+
+void SHTileProjector::Submit(BakeJobPool *pool, unsigned threadIndex, Vector3 *coeffs, BakeJob *doneJob)
+{
+    ResetTiles();
+
+    // the jobs pull tiles like the threads in Run(), so the result is the same
+    const unsigned numJobs = Clamp(pool->GetNumThreads(), 1u, tiles_.Size());
+    tileJobs_.Resize(numJobs);
+    numActiveJobs_ = numJobs;
+    jobCoeffs_ = coeffs;
+    doneJob_ = doneJob;
+
+    for ( unsigned i = 0; i < numJobs; ++i )
+    {
+        tileJobs_[i].projector_ = this;
+    }
+
+    for ( unsigned i = 1; i < numJobs; ++i )
+    {
+        pool->Submit(&tileJobs_[i], threadIndex);
+    }
+
+    TileJobProcess(pool);
+}
+
+void SHTileProjector::TileJob::RunJob(BakeJobPool *pool, unsigned threadIndex)
+{
+    projector_->TileJobProcess(pool);
+}
+
+void SHTileProjector::TileJobProcess(BakeJobPool *pool)
+{
+    ProcessTiles();
+
+    // the last one out has every tile
+    if (--numActiveJobs_ == 0)
+    {
+        ReduceTiles(jobCoeffs_);
+        pool->Complete(doneJob_);
+    }
+}
+
+void SHTileProjector::WorkerProcess(void *data)
+{
+    SHTileProjector *parent = (SHTileProjector*)data;
+
+    parent->ProcessTiles();
+}
+
+void SHTileProjector::ProcessTiles()
+{
+    // timed per thread, a tile is too short for the timer
+    HiresTimer timer;
+
+    for ( unsigned tileIdx = nextTile_++; tileIdx < tiles_.Size(); tileIdx = nextTile_++ )
+    {
+        ProjectTile(tileIdx);
+    }
+
+    busyUSec_ += timer.GetUSec(false);
+}
+
+void SHTileProjector::ProjectTile(unsigned tileIdx)
+{
+    const Tile &tile = tiles_[tileIdx];
+    const unsigned colOffset = tile.face_ * texelTable_->GetTexelsPerFace() + tile.begin_;
+    Vector3 *partial = &partials_[tileIdx * numCoeffs_];
+
+    SHProjectionInput input;
+    texelTable_->SetupFaceInput((CubeMapFace)tile.face_, input);
+
+    input.dirX_   += tile.begin_;
+    input.dirY_   += tile.begin_;
+    input.dirZ_   += tile.begin_;
+    input.weight_ += tile.begin_;
+    input.r_       = colR_ + colOffset;
+    input.g_       = colG_ + colOffset;
+    input.b_       = colB_ + colOffset;
+    input.count_   = tile.end_ - tile.begin_;
+
+    switch (order_)
+    {
+    case SHOrder_L1:
+        SHProjection::Project<SHOrder_L1>(input, partial);
+        break;
+
+    case SHOrder_L3:
+        SHProjection::Project<SHOrder_L3>(input, partial);
+        break;
+
+    default:
+        SHProjection::Project<SHOrder_L2>(input, partial);
+        break;
+    }
+}
+
+//=============================================================================
+// pairwise tree reduction in tile order, independent of which thread
+// projected which tile
+//=============================================================================
+void SHTileProjector::ReduceTiles(Vector3 *coeffs)
+{
+    const unsigned numTiles = tiles_.Size();
+
+    for ( unsigned stride = 1; stride < numTiles; stride *= 2 )
+    {
+        for ( unsigned i = 0; i + stride < numTiles; i += stride * 2 )
+        {
+            Vector3 *dst = &partials_[i * numCoeffs_];
+            const Vector3 *src = &partials_[(i + stride) * numCoeffs_];
+
+            for ( unsigned j = 0; j < numCoeffs_; ++j )
+            {
+                dst[j] += src[j];
+            }
+        }
+    }
+
+    for ( unsigned j = 0; j < numCoeffs_; ++j )
+    {
+        coeffs[j] += partials_[j];
+    }
+}
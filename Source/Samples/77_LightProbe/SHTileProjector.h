@@ -0,0 +1,104 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Core/HelperThread.h>
+#include <Urho3D/Math/Vector3.h>
+#include <atomic>
+
+#include "BakeJobPool.h"
+
+using namespace Urho3D;
+
+class CubeTexelTable;
+
+//=============================================================================
+// splits the projection of a whole cube into fixed size tiles that are
+// projected in parallel and then combined with a fixed-order pairwise
+// reduction. tiles only depend on the face size, so the coeffs come out
+// bit-identical for any thread count (for the same kernel type).
+//=============================================================================
+class SHTileProjector
+{
+public:
+    // color planes hold all six faces, face-major, each face row-major
+    SHTileProjector(int order, const CubeTexelTable *texelTable, const float *colR, const float *colG, const float *colB);
+
+    // projects all tiles with numThreads threads, the calling thread included,
+    // and adds the result to coeffs
+    void Run(unsigned numThreads, Vector3 *coeffs);
+
+    // projects the tiles as bake jobs, up to one per pool thread with the
+    // first run right away. the last one to finish adds the result to coeffs
+    // and completes doneJob. call it from a job on the pool, the projector
+    // has to live until doneJob completes
+    void Submit(BakeJobPool *pool, unsigned threadIndex, Vector3 *coeffs, BakeJob *doneJob);
+
+    unsigned GetNumTiles() const { return tiles_.Size(); }
+    // time all threads spent projecting the last Run() or Submit(), read it once done
+    long long GetBusyUSec() const { return busyUSec_; }
+
+protected:
+    class TileJob : public BakeJob
+    {
+    public:
+        virtual void RunJob(BakeJobPool *pool, unsigned threadIndex);
+
+        SHTileProjector *projector_;
+    };
+
+    void ResetTiles();
+    void WorkerProcess(void *data);
+    void TileJobProcess(BakeJobPool *pool);
+    void ProcessTiles();
+    void ProjectTile(unsigned tileIdx);
+    void ReduceTiles(Vector3 *coeffs);
+
+protected:
+    struct Tile
+    {
+        unsigned face_;
+        unsigned begin_;
+        unsigned end_;
+    };
+
+    int order_;
+    unsigned numCoeffs_;
+    const CubeTexelTable *texelTable_;
+    const float *colR_;
+    const float *colG_;
+    const float *colB_;
+
+    PODVector<Tile> tiles_;
+    PODVector<Vector3> partials_;
+    std::atomic<unsigned> nextTile_;
+    std::atomic<long long> busyUSec_;
+
+    // job mode
+    Vector<TileJob> tileJobs_;
+    std::atomic<unsigned> numActiveJobs_;
+    Vector3 *jobCoeffs_;
+    BakeJob *doneJob_;
+};
@@ -0,0 +1,1095 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/Light.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/Graphics/OctreeQuery.h>
+#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/Graphics/Technique.h>
+#include <Urho3D/Graphics/Texture2D.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/Graphics/Zone.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Math/Ray.h>
+#include <Urho3D/Resource/Image.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "SoftwareCaptureBackend.h"
+#include "CubeCapture.h"
+#include "CubeTexelTable.h"
+#include "SHTableEncoder.h"
+
+#include <cstring>
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+#define TILE_ROWS           8
+#define NEAR_CLIP           0.001f
+#define GUARD_BAND          2.0f
+#define SHADOW_BIAS         0.01f
+#define MAX_CLIP_VERTS      16
+#define SHADOW_LEAF_SIZE    4
+#define SHADOW_STACK_SIZE   64
+
+namespace
+{
+// face space vertex, carries its barycentrics in the source triangle
+struct ClipVertex
+{
+    float s_;
+    float t_;
+    float n_;
+    float b1_;
+    float b2_;
+};
+
+struct PixelSample
+{
+    float invDepth_;
+    float b1_;
+    float b2_;
+    float lodBase_;
+    unsigned triangle_;
+};
+
+// clip planes in face space, a vertex is kept where s*x + t*y + n*z + w >= 0.
+// the side planes sit outside the face so edge functions stay well inside
+// float range without clipping every triangle that crosses a face edge
+const float clipPlanes_[5][4] =
+{
+    {  0.0f,  0.0f, 1.0f,       -NEAR_CLIP },
+    {  1.0f,  0.0f, GUARD_BAND, 0.0f },
+    { -1.0f,  0.0f, GUARD_BAND, 0.0f },
+    {  0.0f,  1.0f, GUARD_BAND, 0.0f },
+    {  0.0f, -1.0f, GUARD_BAND, 0.0f },
+};
+
+float PlaneDistance(const float *plane, const ClipVertex &v)
+{
+    return plane[0] * v.s_ + plane[1] * v.t_ + plane[2] * v.n_ + plane[3];
+}
+
+unsigned ClipPolygon(const ClipVertex *in, unsigned numIn, const float *plane, ClipVertex *out)
+{
+    unsigned numOut = 0;
+
+    for ( unsigned i = 0; i < numIn; ++i )
+    {
+        const ClipVertex &a = in[i];
+        const ClipVertex &b = in[(i + 1) % numIn];
+        const float da = PlaneDistance(plane, a);
+        const float db = PlaneDistance(plane, b);
+
+        if (da >= 0.0f)
+        {
+            out[numOut++] = a;
+        }
+
+        if ((da >= 0.0f) != (db >= 0.0f))
+        {
+            const float t = da / (da - db);
+            ClipVertex &v = out[numOut++];
+            v.s_  = a.s_  + (b.s_  - a.s_)  * t;
+            v.t_  = a.t_  + (b.t_  - a.t_)  * t;
+            v.n_  = a.n_  + (b.n_  - a.n_)  * t;
+            v.b1_ = a.b1_ + (b.b1_ - a.b1_) * t;
+            v.b2_ = a.b2_ + (b.b2_ - a.b2_) * t;
+        }
+    }
+
+    return numOut;
+}
+
+Color ToColor(const Variant &value, const Color &defaultColor)
+{
+    switch (value.GetType())
+    {
+    case VAR_VECTOR3:
+        {
+            const Vector3 &v = value.GetVector3();
+            return Color(v.x_, v.y_, v.z_);
+        }
+    case VAR_VECTOR4:
+        {
+            const Vector4 &v = value.GetVector4();
+            return Color(v.x_, v.y_, v.z_, v.w_);
+        }
+    case VAR_COLOR:
+        return value.GetColor();
+
+    default:
+        break;
+    }
+    return defaultColor;
+}
+
+Color Modulate(const Color &a, const Color &b)
+{
+    return Color(a.r_ * b.r_, a.g_ * b.g_, a.b_ * b.b_, a.a_ * b.a_);
+}
+
+// orders triangle indices by their center along one axis
+struct CenterLess
+{
+    CenterLess(const PODVector<Vector3> &centers, unsigned axis) : centers_(centers), axis_(axis) {}
+
+    bool operator()(unsigned a, unsigned b) const
+    {
+        return centers_[a].Data()[axis_] < centers_[b].Data()[axis_];
+    }
+
+    const PODVector<Vector3> &centers_;
+    unsigned axis_;
+};
+
+// two sided moller-trumbore, M_INFINITY on a miss
+float RayTriangle(const Vector3 &origin, const Vector3 &dir, const Vector3 &v0, const Vector3 &v1, const Vector3 &v2)
+{
+    const Vector3 edge1 = v1 - v0;
+    const Vector3 edge2 = v2 - v0;
+    const Vector3 p = dir.CrossProduct(edge2);
+    const float det = edge1.DotProduct(p);
+
+    if (Abs(det) < M_EPSILON)
+        return M_INFINITY;
+
+    const float invDet = 1.0f / det;
+    const Vector3 t = origin - v0;
+    const float u = t.DotProduct(p) * invDet;
+    if (u < 0.0f || u > 1.0f)
+        return M_INFINITY;
+
+    const Vector3 q = t.CrossProduct(edge1);
+    const float v = dir.DotProduct(q) * invDet;
+    if (v < 0.0f || u + v > 1.0f)
+        return M_INFINITY;
+
+    const float distance = edge2.DotProduct(q) * invDet;
+    return distance > 0.0f ? distance : M_INFINITY;
+}
+}
+
+//=============================================================================
+//=============================================================================
+SoftwareCaptureBackend::SoftwareCaptureBackend(Context *context)
+    : context_(context)
+    , numThreads_(Max(GetNumLogicalCPUs(), 1u))
+    , baking_(false)
+    , sceneValid_(false)
+    , viewMask_(DEFAULT_VIEWMASK)
+    , drawShadows_(true)
+    , farClip_(DEFAULT_FARCLIP)
+    , faces_(NULL)
+    , fogStart_(0.0f)
+    , fogEnd_(0.0f)
+    , tilesPerFace_(0)
+    , itemFn_(NULL)
+    , numItems_(0)
+    , nextItem_(0)
+    , numActive_(0)
+{
+}
+
+SoftwareCaptureBackend::~SoftwareCaptureBackend()
+{
+    ReleaseWorkers();
+}
+
+void SoftwareCaptureBackend::BeginBake()
+{
+    // the scene may have changed since the last bake
+    baking_ = true;
+    ClearScene();
+}
+
+void SoftwareCaptureBackend::EndBake()
+{
+    baking_ = false;
+    ClearScene();
+    ReleaseWorkers();
+}
+
+bool SoftwareCaptureBackend::CaptureCube(Scene *scene, const Vector3 &position, const CubeCaptureSettings &settings, SHCubeFaces &faces)
+{
+    if (scene == NULL || faces.faceSize_ <= 0)
+        return false;
+
+    position_ = position;
+    farClip_ = settings.maxFarClip_;
+    faces_ = &faces;
+
+    if (!baking_ || !sceneValid_ || scene_.Get() != scene || viewMask_ != settings.viewMask_ || drawShadows_ != settings.drawShadows_)
+    {
+        GatherScene(scene, settings);
+    }
+
+    CullScene(scene);
+
+    // tiles of a face are consecutive, SetupFace() fills in their bins
+    tilesPerFace_ = (unsigned)((faces.faceSize_ + TILE_ROWS - 1) / TILE_ROWS);
+    tiles_.Resize(tilesPerFace_ * MAX_CUBEMAP_FACES);
+
+    for ( unsigned i = 0; i < tiles_.Size(); ++i )
+    {
+        Tile &tile = tiles_[i];
+        tile.face_ = i / tilesPerFace_;
+        tile.y0_ = (int)(i % tilesPerFace_) * TILE_ROWS;
+        tile.y1_ = Min(tile.y0_ + TILE_ROWS, faces.faceSize_);
+        tile.binBegin_ = 0;
+        tile.binEnd_ = 0;
+    }
+
+    RunParallel(MAX_CUBEMAP_FACES, &SoftwareCaptureBackend::SetupFace);
+    RunParallel(tiles_.Size(), &SoftwareCaptureBackend::RasterizeTile);
+
+    // outside of a bake nothing of the scene is held past the capture
+    if (!baking_)
+    {
+        ClearScene();
+    }
+
+    visibleDrawables_.Clear();
+    lights_.Clear();
+    faces_ = NULL;
+
+    return true;
+}
+
+void SoftwareCaptureBackend::ClearScene()
+{
+    sceneValid_ = false;
+    scene_.Reset();
+
+    vertices_.Clear();
+    triangles_.Clear();
+    materials_.Clear();
+    materialIndices_.Clear();
+    drawables_.Clear();
+    sceneLights_.Clear();
+    shadowTriangles_.Clear();
+    shadowNodes_.Clear();
+}
+
+void SoftwareCaptureBackend::GatherScene(Scene *scene, const CubeCaptureSettings &settings)
+{
+    ClearScene();
+
+    scene_ = scene;
+    viewMask_ = settings.viewMask_;
+    drawShadows_ = settings.drawShadows_;
+    sceneValid_ = true;
+
+    Octree *octree = scene->GetComponent<Octree>();
+    if (octree == NULL)
+        return;
+
+    // everything in view of any probe, each capture culls to its own far clip
+    PODVector<Drawable*> drawables;
+    AllContentOctreeQuery query(drawables, DRAWABLE_GEOMETRY | DRAWABLE_LIGHT, viewMask_);
+    octree->GetDrawables(query);
+
+    for ( unsigned i = 0; i < drawables.Size(); ++i )
+    {
+        Drawable *drawable = drawables[i];
+
+        if (drawable->GetDrawableFlags() & DRAWABLE_LIGHT)
+        {
+            AddLight(static_cast<Light*>(drawable));
+        }
+        else if (drawable->GetType() == StaticModel::GetTypeStatic())
+        {
+            AddStaticModel(static_cast<StaticModel*>(drawable));
+        }
+    }
+
+    // shadow rays walk a bvh over the casters' triangles, split at the
+    // median center so its depth stays within log2 of the triangle count
+    if (shadowTriangles_.Size())
+    {
+        PODVector<Vector3> centers(triangles_.Size());
+        for ( unsigned i = 0; i < shadowTriangles_.Size(); ++i )
+        {
+            const SoftVertex *v = &vertices_[shadowTriangles_[i] * 3];
+            centers[shadowTriangles_[i]] = (v[0].position_ + v[1].position_ + v[2].position_) * (1.0f / 3.0f);
+        }
+
+        shadowNodes_.Reserve(2 * shadowTriangles_.Size() / SHADOW_LEAF_SIZE + 1);
+        BuildShadowNode(0, shadowTriangles_.Size(), centers);
+    }
+}
+
+void SoftwareCaptureBackend::CullScene(Scene *scene)
+{
+    visibleDrawables_.Clear();
+    lights_.Clear();
+
+    // renderer's default zone
+    ambientColor_ = Color(0.1f, 0.1f, 0.1f);
+    fogColor_ = Color::BLACK;
+    fogStart_ = 250.0f;
+    fogEnd_ = 1000.0f;
+
+    Octree *octree = scene->GetComponent<Octree>();
+    if (octree == NULL)
+        return;
+
+    // highest priority zone at the probe, as the renderer picks the camera zone
+    PODVector<Drawable*> zones;
+    PointOctreeQuery zoneQuery(zones, position_, DRAWABLE_ZONE);
+    octree->GetDrawables(zoneQuery);
+
+    Zone *bestZone = NULL;
+    for ( unsigned i = 0; i < zones.Size(); ++i )
+    {
+        Zone *zone = static_cast<Zone*>(zones[i]);
+        if (zone->IsInside(position_) && (bestZone == NULL || zone->GetPriority() > bestZone->GetPriority()))
+        {
+            bestZone = zone;
+        }
+    }
+
+    if (bestZone)
+    {
+        ambientColor_ = bestZone->GetAmbientColor();
+        fogColor_ = bestZone->GetFogColor();
+        fogStart_ = bestZone->GetFogStart();
+        fogEnd_ = bestZone->GetFogEnd();
+    }
+
+    // same test the octree's sphere query does, shadow rays still see all casters
+    const Sphere farSphere(position_, farClip_);
+
+    for ( unsigned i = 0; i < drawables_.Size(); ++i )
+    {
+        if (farSphere.IsInside(drawables_[i].box_) != OUTSIDE)
+        {
+            visibleDrawables_.Push(i);
+        }
+    }
+
+    for ( unsigned i = 0; i < sceneLights_.Size(); ++i )
+    {
+        if (farSphere.IsInside(sceneLights_[i].box_) != OUTSIDE)
+        {
+            lights_.Push(sceneLights_[i]);
+        }
+    }
+}
+
+unsigned SoftwareCaptureBackend::BuildShadowNode(unsigned begin, unsigned end, const PODVector<Vector3> &centers)
+{
+    const unsigned nodeIdx = shadowNodes_.Size();
+    shadowNodes_.Resize(nodeIdx + 1);
+
+    BoundingBox box;
+    BoundingBox centerBox;
+    for ( unsigned i = begin; i < end; ++i )
+    {
+        const SoftVertex *v = &vertices_[shadowTriangles_[i] * 3];
+        box.Merge(v[0].position_);
+        box.Merge(v[1].position_);
+        box.Merge(v[2].position_);
+        centerBox.Merge(centers[shadowTriangles_[i]]);
+    }
+
+    shadowNodes_[nodeIdx].box_ = box;
+    shadowNodes_[nodeIdx].first_ = begin;
+    shadowNodes_[nodeIdx].count_ = end - begin;
+
+    if (end - begin <= SHADOW_LEAF_SIZE)
+        return nodeIdx;
+
+    // longest axis of the centers
+    const Vector3 size = centerBox.Size();
+    const unsigned axis = size.x_ >= size.y_ && size.x_ >= size.z_ ? 0 : (size.y_ >= size.z_ ? 1 : 2);
+    Sort(shadowTriangles_.Begin() + begin, shadowTriangles_.Begin() + end, CenterLess(centers, axis));
+
+    const unsigned middle = begin + (end - begin) / 2;
+    BuildShadowNode(begin, middle, centers);
+    const unsigned second = BuildShadowNode(middle, end, centers);
+
+    shadowNodes_[nodeIdx].first_ = second;
+    shadowNodes_[nodeIdx].count_ = 0;
+
+    return nodeIdx;
+}
+
+void SoftwareCaptureBackend::AddStaticModel(StaticModel *staticModel)
+{
+    const Matrix3x4 &world = staticModel->GetNode()->GetWorldTransform();
+    const Matrix3 normalMatrix = world.ToMatrix3().Inverse().Transpose();
+    const unsigned firstTriangle = triangles_.Size();
+
+    for ( unsigned i = 0; i < staticModel->GetNumGeometries(); ++i )
+    {
+        Geometry *geometry = staticModel->GetLodGeometry(i, 0);
+        if (geometry == NULL || geometry->GetPrimitiveType() != TRIANGLE_LIST)
+            continue;
+
+        // shadow copy of the model's buffers, also there in headless mode
+        const unsigned char *vertexData;
+        const unsigned char *indexData;
+        unsigned vertexSize;
+        unsigned indexSize;
+        const PODVector<VertexElement> *elements;
+        geometry->GetRawData(vertexData, vertexSize, indexData, indexSize, elements);
+
+        if (vertexData == NULL || elements == NULL)
+            continue;
+
+        const unsigned posOffset = VertexBuffer::GetElementOffset(*elements, TYPE_VECTOR3, SEM_POSITION);
+        const unsigned normalOffset = VertexBuffer::GetElementOffset(*elements, TYPE_VECTOR3, SEM_NORMAL);
+        const unsigned uvOffset = VertexBuffer::GetElementOffset(*elements, TYPE_VECTOR2, SEM_TEXCOORD);
+
+        if (posOffset == M_MAX_UNSIGNED)
+            continue;
+
+        const unsigned materialIdx = GetMaterialIndex(staticModel->GetMaterial(i));
+        const bool indexed = indexData != NULL && indexSize != 0;
+        const unsigned start = indexed ? geometry->GetIndexStart() : geometry->GetVertexStart();
+        const unsigned count = indexed ? geometry->GetIndexCount() : geometry->GetVertexCount();
+
+        for ( unsigned j = start; j + 2 < start + count; j += 3 )
+        {
+            SoftVertex v[3];
+
+            for ( unsigned k = 0; k < 3; ++k )
+            {
+                unsigned index = j + k;
+                if (indexed)
+                {
+                    index = indexSize == sizeof(unsigned short) ? ((const unsigned short*)indexData)[index] : ((const unsigned*)indexData)[index];
+                }
+
+                const unsigned char *vertex = vertexData + index * vertexSize;
+                v[k].position_ = world * *((const Vector3*)(vertex + posOffset));
+                v[k].normal_ = normalOffset != M_MAX_UNSIGNED ? (normalMatrix * *((const Vector3*)(vertex + normalOffset))).Normalized() : Vector3::ZERO;
+                v[k].uv_ = uvOffset != M_MAX_UNSIGNED ? *((const Vector2*)(vertex + uvOffset)) : Vector2::ZERO;
+            }
+
+            if (normalOffset == M_MAX_UNSIGNED)
+            {
+                const Vector3 faceNormal = (v[1].position_ - v[0].position_).CrossProduct(v[2].position_ - v[0].position_).Normalized();
+                v[0].normal_ = v[1].normal_ = v[2].normal_ = faceNormal;
+            }
+
+            const Vector2 uvEdge1 = v[1].uv_ - v[0].uv_;
+            const Vector2 uvEdge2 = v[2].uv_ - v[0].uv_;
+
+            SoftTriangle triangle;
+            triangle.material_ = materialIdx;
+            triangle.uvArea_ = 0.5f * Abs(uvEdge1.x_ * uvEdge2.y_ - uvEdge1.y_ * uvEdge2.x_);
+
+            vertices_.Push(v[0]);
+            vertices_.Push(v[1]);
+            vertices_.Push(v[2]);
+            triangles_.Push(triangle);
+        }
+    }
+
+    if (triangles_.Size() == firstTriangle)
+        return;
+
+    SoftDrawable drawable;
+    drawable.box_ = staticModel->GetWorldBoundingBox();
+    drawable.firstTriangle_ = firstTriangle;
+    drawable.endTriangle_ = triangles_.Size();
+    drawables_.Push(drawable);
+
+    if (drawShadows_ && staticModel->GetCastShadows())
+    {
+        for ( unsigned i = firstTriangle; i < triangles_.Size(); ++i )
+        {
+            shadowTriangles_.Push(i);
+        }
+    }
+}
+
+void SoftwareCaptureBackend::AddLight(Light *light)
+{
+    Node *lightNode = light->GetNode();
+
+    SoftLight softLight;
+    softLight.box_ = light->GetWorldBoundingBox();
+    softLight.type_ = light->GetLightType();
+    softLight.position_ = lightNode->GetWorldPosition();
+    softLight.direction_ = lightNode->GetWorldDirection();
+    softLight.color_ = light->GetEffectiveColor();
+    softLight.range_ = light->GetRange();
+    softLight.tanHalfFov_ = tanf(light->GetFov() * 0.5f * M_DEGTORAD);
+    softLight.castShadows_ = drawShadows_ && light->GetCastShadows();
+
+    sceneLights_.Push(softLight);
+}
+
+unsigned SoftwareCaptureBackend::GetMaterialIndex(Material *material)
+{
+    HashMap<Material*, unsigned>::ConstIterator it = materialIndices_.Find(material);
+    if (it != materialIndices_.End())
+        return it->second_;
+
+    // no material renders lit white, like the renderer's default material
+    SoftMaterial softMaterial;
+    softMaterial.diffColor_ = Color::WHITE;
+    softMaterial.emissiveColor_ = Color::BLACK;
+    softMaterial.diffMap_ = NULL;
+    softMaterial.emissiveMap_ = NULL;
+    softMaterial.lit_ = true;
+    softMaterial.cullMode_ = CULL_CCW;
+
+    if (material)
+    {
+        softMaterial.diffColor_ = ToColor(material->GetShaderParameter("MatDiffColor"), Color::WHITE);
+        softMaterial.emissiveColor_ = ToColor(material->GetShaderParameter("MatEmissiveColor"), Color::BLACK);
+        softMaterial.diffMap_ = GetTexture(material->GetTexture(TU_DIFFUSE));
+        softMaterial.emissiveMap_ = GetTexture(material->GetTexture(TU_EMISSIVE));
+        softMaterial.cullMode_ = material->GetCullMode();
+
+        // unlit techniques only have the base pass
+        Technique *technique = material->GetTechnique(0);
+        softMaterial.lit_ = technique == NULL || technique->HasPass("litbase") || technique->HasPass("light");
+    }
+
+    const unsigned index = materials_.Size();
+    materials_.Push(softMaterial);
+    materialIndices_[material] = index;
+
+    return index;
+}
+
+const SoftwareCaptureBackend::SoftTexture* SoftwareCaptureBackend::GetTexture(Texture *texture)
+{
+    if (texture == NULL || texture->GetType() != Texture2D::GetTypeStatic())
+        return NULL;
+
+    // textures don't change between captures, failures are cached too
+    HashMap<String, SoftTexture>::Iterator it = textures_.Find(texture->GetName());
+    if (it != textures_.End())
+        return it->second_.levels_.Size() ? &it->second_ : NULL;
+
+    SoftTexture &softTexture = textures_[texture->GetName()];
+    SharedPtr<Image> image(context_->GetSubsystem<ResourceCache>()->GetResource<Image>(texture->GetName()));
+
+    // dds/ktx/pvr blocks aren't decoded, the material's color is used alone.
+    // the failure is cached, so this warns once per texture
+    if (image && image->IsCompressed())
+    {
+        URHO3D_LOGWARNING("SoftwareCaptureBackend: compressed texture " + texture->GetName() + " is not sampled, using the material color only");
+    }
+    else if (image)
+    {
+        softTexture.levels_.Push(image);
+
+        while (image->GetWidth() > 1 || image->GetHeight() > 1)
+        {
+            image = image->GetNextLevel();
+            if (!image)
+                break;
+
+            softTexture.levels_.Push(image);
+        }
+    }
+
+    return softTexture.levels_.Size() ? &softTexture : NULL;
+}
+
+void SoftwareCaptureBackend::RunParallel(unsigned numItems, ItemFn itemFn)
+{
+    itemFn_ = itemFn;
+    numItems_ = numItems;
+    nextItem_ = 0;
+
+    // the calling thread is one of them
+    const unsigned numWorkers = Clamp(numThreads_, 1u, numItems) - 1;
+
+    {
+        std::lock_guard<std::mutex> lock(workMutex_);
+        numActive_ = numWorkers;
+    }
+
+    // a new worker runs WorkerProcess() once on Start(), the idle ones on Wake()
+    for ( unsigned i = 0; i < numWorkers; ++i )
+    {
+        if (i < workers_.Size())
+        {
+            workers_[i]->Wake();
+        }
+        else
+        {
+            SharedPtr<HelperThread<SoftwareCaptureBackend> > worker(new HelperThread<SoftwareCaptureBackend>(this, &SoftwareCaptureBackend::WorkerProcess, HelperThread_OnWake));
+            workers_.Push(worker);
+            worker->Start();
+        }
+    }
+
+    ProcessItems();
+
+    // wait for the workers still on their last item
+    std::unique_lock<std::mutex> lock(workMutex_);
+    while (numActive_)
+    {
+        workDoneCond_.wait(lock);
+    }
+}
+
+void SoftwareCaptureBackend::ReleaseWorkers()
+{
+    // stops and joins the idle workers
+    workers_.Clear();
+}
+
+void SoftwareCaptureBackend::WorkerProcess(void *data)
+{
+    SoftwareCaptureBackend *parent = (SoftwareCaptureBackend*)data;
+
+    parent->ProcessItems();
+
+    std::lock_guard<std::mutex> lock(parent->workMutex_);
+    if (--parent->numActive_ == 0)
+    {
+        parent->workDoneCond_.notify_one();
+    }
+}
+
+void SoftwareCaptureBackend::ProcessItems()
+{
+    for ( unsigned itemIdx = nextItem_++; itemIdx < numItems_; itemIdx = nextItem_++ )
+    {
+        (this->*itemFn_)(itemIdx);
+    }
+}
+
+void SoftwareCaptureBackend::SetupFace(unsigned face)
+{
+    const int faceSize = faces_->faceSize_;
+    const float halfSize = 0.5f * (float)faceSize;
+
+    PODVector<FacePolygon> &polygons = polygons_[face];
+    PODVector<FaceVertex> &polygonVerts = polygonVerts_[face];
+    polygons.Clear();
+    polygonVerts.Clear();
+
+    // face space, with the same texel mapping the projection uses
+    Vector3 sAxis, tAxis, nAxis;
+    CubeTexelTable::GetFaceAxes((CubeMapFace)face, sAxis, tAxis, nAxis);
+
+    ClipVertex clipBuffers[2][MAX_CLIP_VERTS];
+    PODVector<unsigned> rowBegin;
+    PODVector<unsigned> rowEnd;
+
+    for ( unsigned i = 0; i < visibleDrawables_.Size(); ++i )
+    {
+        const SoftDrawable &drawable = drawables_[visibleDrawables_[i]];
+
+        for ( unsigned triIdx = drawable.firstTriangle_; triIdx < drawable.endTriangle_; ++triIdx )
+        {
+            const SoftVertex *v = &vertices_[triIdx * 3];
+            const SoftMaterial &material = materials_[triangles_[triIdx].material_];
+
+            // front faces are clockwise, their geometric normal faces the probe
+            if (material.cullMode_ != CULL_NONE)
+            {
+                const Vector3 normal = (v[1].position_ - v[0].position_).CrossProduct(v[2].position_ - v[0].position_);
+                const bool frontFace = normal.DotProduct(position_ - v[0].position_) > 0.0f;
+
+                if (frontFace == (material.cullMode_ == CULL_CW))
+                    continue;
+            }
+
+            ClipVertex *poly = clipBuffers[0];
+            for ( unsigned k = 0; k < 3; ++k )
+            {
+                const Vector3 rel = v[k].position_ - position_;
+                poly[k].s_  = rel.DotProduct(sAxis);
+                poly[k].t_  = rel.DotProduct(tAxis);
+                poly[k].n_  = rel.DotProduct(nAxis);
+                poly[k].b1_ = k == 1 ? 1.0f : 0.0f;
+                poly[k].b2_ = k == 2 ? 1.0f : 0.0f;
+            }
+
+            if (poly[0].n_ > farClip_ && poly[1].n_ > farClip_ && poly[2].n_ > farClip_)
+                continue;
+
+            unsigned numVerts = 3;
+            for ( unsigned p = 0; p < 5 && numVerts >= 3; ++p )
+            {
+                ClipVertex *out = clipBuffers[(p + 1) & 1];
+                numVerts = ClipPolygon(poly, numVerts, clipPlanes_[p], out);
+                poly = out;
+            }
+
+            if (numVerts < 3)
+                continue;
+
+            // screen space, attributes over n interpolate linearly
+            FacePolygon polygon;
+            polygon.triangle_ = triIdx;
+            polygon.firstVertex_ = polygonVerts.Size();
+            polygon.numVerts_ = numVerts;
+
+            float minX = M_INFINITY;
+            float maxX = -M_INFINITY;
+            float minY = M_INFINITY;
+            float maxY = -M_INFINITY;
+            for ( unsigned k = 0; k < numVerts; ++k )
+            {
+                FaceVertex vertex;
+                vertex.invN_ = 1.0f / poly[k].n_;
+                vertex.x_    = (poly[k].s_ * vertex.invN_ + 1.0f) * halfSize;
+                vertex.y_    = (poly[k].t_ * vertex.invN_ + 1.0f) * halfSize;
+                vertex.b1N_  = poly[k].b1_ * vertex.invN_;
+                vertex.b2N_  = poly[k].b2_ * vertex.invN_;
+                polygonVerts.Push(vertex);
+
+                minX = Min(minX, vertex.x_);
+                maxX = Max(maxX, vertex.x_);
+                minY = Min(minY, vertex.y_);
+                maxY = Max(maxY, vertex.y_);
+            }
+
+            // the guard band reaches past the face
+            if (maxX < 0.0f || minX > (float)faceSize || maxY < 0.0f || minY > (float)faceSize)
+            {
+                polygonVerts.Resize(polygon.firstVertex_);
+                continue;
+            }
+
+            // texture lod from the texel to pixel area ratio of the visible part
+            const FaceVertex *verts = &polygonVerts[polygon.firstVertex_];
+            float screenArea = 0.0f;
+            float baryArea = 0.0f;
+            for ( unsigned k = 0; k < numVerts; ++k )
+            {
+                const unsigned k1 = (k + 1) % numVerts;
+                screenArea += verts[k].x_ * verts[k1].y_ - verts[k1].x_ * verts[k].y_;
+                baryArea += poly[k].b1_ * poly[k1].b2_ - poly[k1].b1_ * poly[k].b2_;
+            }
+            screenArea = Abs(screenArea) * 0.5f;
+            baryArea = Abs(baryArea);
+
+            const float texelArea = triangles_[triIdx].uvArea_ * baryArea;
+            polygon.lodBase_ = (texelArea > 0.0f && screenArea > 0.0f) ? 0.5f * log2f(texelArea / screenArea) : 0.0f;
+
+            // tiles of the rows it covers, as the rasterizer rounds them
+            rowBegin.Push((unsigned)Max((int)floorf(minY), 0) / TILE_ROWS);
+            rowEnd.Push((unsigned)Min((int)ceilf(maxY), faceSize - 1) / TILE_ROWS + 1);
+            polygons.Push(polygon);
+        }
+    }
+
+    // bin by tile, in triangle order so equal depths resolve as before
+    Tile *tiles = &tiles_[face * tilesPerFace_];
+    PODVector<unsigned> &bins = bins_[face];
+    PODVector<unsigned> counts(tilesPerFace_ + 1);
+    memset(&counts[0], 0, counts.Size() * sizeof(unsigned));
+
+    for ( unsigned i = 0; i < polygons.Size(); ++i )
+    {
+        for ( unsigned row = rowBegin[i]; row < rowEnd[i]; ++row )
+        {
+            ++counts[row + 1];
+        }
+    }
+
+    for ( unsigned row = 0; row < tilesPerFace_; ++row )
+    {
+        counts[row + 1] += counts[row];
+        tiles[row].binBegin_ = counts[row];
+        tiles[row].binEnd_ = counts[row];
+    }
+
+    bins.Resize(counts[tilesPerFace_]);
+    for ( unsigned i = 0; i < polygons.Size(); ++i )
+    {
+        for ( unsigned row = rowBegin[i]; row < rowEnd[i]; ++row )
+        {
+            bins[tiles[row].binEnd_++] = i;
+        }
+    }
+}
+
+void SoftwareCaptureBackend::RasterizeTile(unsigned tileIdx)
+{
+    const Tile &tile = tiles_[tileIdx];
+    const int faceSize = faces_->faceSize_;
+    const float invFarClip = 1.0f / farClip_;
+
+    PODVector<PixelSample> samples((unsigned)((tile.y1_ - tile.y0_) * faceSize));
+    for ( unsigned i = 0; i < samples.Size(); ++i )
+    {
+        samples[i].invDepth_ = 0.0f;
+        samples[i].triangle_ = M_MAX_UNSIGNED;
+    }
+
+    const PODVector<FacePolygon> &polygons = polygons_[tile.face_];
+    const PODVector<unsigned> &bins = bins_[tile.face_];
+    float px[MAX_CLIP_VERTS];
+    float py[MAX_CLIP_VERTS];
+    float invN[MAX_CLIP_VERTS];
+    float b1N[MAX_CLIP_VERTS];
+    float b2N[MAX_CLIP_VERTS];
+
+    for ( unsigned binIdx = tile.binBegin_; binIdx < tile.binEnd_; ++binIdx )
+    {
+        const FacePolygon &polygon = polygons[bins[binIdx]];
+        const FaceVertex *verts = &polygonVerts_[tile.face_][polygon.firstVertex_];
+        const unsigned numVerts = polygon.numVerts_;
+        const unsigned triIdx = polygon.triangle_;
+        const float lodBase = polygon.lodBase_;
+
+        for ( unsigned k = 0; k < numVerts; ++k )
+        {
+            px[k]   = verts[k].x_;
+            py[k]   = verts[k].y_;
+            invN[k] = verts[k].invN_;
+            b1N[k]  = verts[k].b1N_;
+            b2N[k]  = verts[k].b2N_;
+        }
+
+        // fan
+        for ( unsigned k = 1; k + 1 < numVerts; ++k )
+        {
+            const unsigned i0 = 0;
+            const unsigned i1 = k;
+            const unsigned i2 = k + 1;
+
+            const float area = (px[i1] - px[i0]) * (py[i2] - py[i0]) - (py[i1] - py[i0]) * (px[i2] - px[i0]);
+            if (Abs(area) < M_EPSILON)
+                continue;
+
+            const float invArea = 1.0f / area;
+            const int x0 = Max((int)floorf(Min(px[i0], Min(px[i1], px[i2]))), 0);
+            const int x1 = Min((int)ceilf(Max(px[i0], Max(px[i1], px[i2]))), faceSize - 1);
+            const int y0 = Max((int)floorf(Min(py[i0], Min(py[i1], py[i2]))), tile.y0_);
+            const int y1 = Min((int)ceilf(Max(py[i0], Max(py[i1], py[i2]))), tile.y1_ - 1);
+
+            for ( int y = y0; y <= y1; ++y )
+            {
+                const float sy = (float)y + 0.5f;
+                PixelSample *row = &samples[(unsigned)((y - tile.y0_) * faceSize)];
+
+                for ( int x = x0; x <= x1; ++x )
+                {
+                    const float sx = (float)x + 0.5f;
+                    const float w0 = ((px[i2] - px[i1]) * (sy - py[i1]) - (py[i2] - py[i1]) * (sx - px[i1])) * invArea;
+                    const float w1 = ((px[i0] - px[i2]) * (sy - py[i2]) - (py[i0] - py[i2]) * (sx - px[i2])) * invArea;
+                    const float w2 = 1.0f - w0 - w1;
+
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                        continue;
+
+                    const float pixelInvN = w0 * invN[i0] + w1 * invN[i1] + w2 * invN[i2];
+                    PixelSample &sample = row[x];
+
+                    if (pixelInvN < invFarClip || pixelInvN <= sample.invDepth_)
+                        continue;
+
+                    const float n = 1.0f / pixelInvN;
+                    sample.invDepth_ = pixelInvN;
+                    sample.b1_       = (w0 * b1N[i0] + w1 * b1N[i1] + w2 * b1N[i2]) * n;
+                    sample.b2_       = (w0 * b2N[i0] + w1 * b2N[i1] + w2 * b2N[i2]) * n;
+                    sample.lodBase_  = lodBase;
+                    sample.triangle_ = triIdx;
+                }
+            }
+        }
+    }
+
+    // shade the visible samples only, same texel encoding as the gpu readback
+    const bool hdr = faces_->format_ == SHFace_RGBA16F;
+    const unsigned texelSize = faces_->GetTexelSize();
+    unsigned char *faceData = &faces_->data_[tile.face_][0];
+
+    for ( int y = tile.y0_; y < tile.y1_; ++y )
+    {
+        for ( int x = 0; x < faceSize; ++x )
+        {
+            const PixelSample &sample = samples[(unsigned)((y - tile.y0_) * faceSize + x)];
+
+            // the capture path clears to the fog color
+            const Color color = sample.triangle_ == M_MAX_UNSIGNED ? fogColor_ :
+                                ShadePixel(sample.triangle_, sample.b1_, sample.b2_, 1.0f / sample.invDepth_, sample.lodBase_);
+
+            unsigned char *dest = faceData + (unsigned)(y * faceSize + x) * texelSize;
+
+            if (hdr)
+            {
+                unsigned short *half = (unsigned short*)dest;
+                half[0] = SHTableEncoder::FloatToHalf(color.r_);
+                half[1] = SHTableEncoder::FloatToHalf(color.g_);
+                half[2] = SHTableEncoder::FloatToHalf(color.b_);
+                half[3] = SHTableEncoder::FloatToHalf(1.0f);
+            }
+            else
+            {
+                dest[0] = (unsigned char)(Clamp(color.r_, 0.0f, 1.0f) * 255.0f + 0.5f);
+                dest[1] = (unsigned char)(Clamp(color.g_, 0.0f, 1.0f) * 255.0f + 0.5f);
+                dest[2] = (unsigned char)(Clamp(color.b_, 0.0f, 1.0f) * 255.0f + 0.5f);
+                dest[3] = 255;
+            }
+        }
+    }
+}
+
+Color SoftwareCaptureBackend::ShadePixel(unsigned triIdx, float b1, float b2, float depth, float lodBase) const
+{
+    const SoftVertex *v = &vertices_[triIdx * 3];
+    const SoftMaterial &material = materials_[triangles_[triIdx].material_];
+    const float b0 = 1.0f - b1 - b2;
+    const Vector2 uv = v[0].uv_ * b0 + v[1].uv_ * b1 + v[2].uv_ * b2;
+
+    Color diffColor = material.diffColor_;
+    if (material.diffMap_)
+    {
+        diffColor = Modulate(diffColor, SampleTexture(material.diffMap_, uv, lodBase));
+    }
+
+    Color color = diffColor;
+
+    // litsolid: diffuse * (ambient + lights) + emissive
+    if (material.lit_)
+    {
+        const Vector3 worldPos = v[0].position_ * b0 + v[1].position_ * b1 + v[2].position_ * b2;
+        const Vector3 normal = (v[0].normal_ * b0 + v[1].normal_ * b1 + v[2].normal_ * b2).Normalized();
+
+        Color lightColor = ambientColor_;
+
+        for ( unsigned i = 0; i < lights_.Size(); ++i )
+        {
+            const SoftLight &light = lights_[i];
+            Vector3 lightDir;
+            float atten = 1.0f;
+            float maxDist = M_INFINITY;
+
+            if (light.type_ == LIGHT_DIRECTIONAL)
+            {
+                lightDir = -light.direction_;
+            }
+            else
+            {
+                const Vector3 toLight = light.position_ - worldPos;
+                const float dist = toLight.Length();
+                if (dist >= light.range_ || dist < M_EPSILON)
+                    continue;
+
+                // linear stand-in for the default ramp texture
+                lightDir = toLight / dist;
+                atten = 1.0f - dist / light.range_;
+                maxDist = dist;
+
+                // radial falloff over the cone, like the default spot texture
+                if (light.type_ == LIGHT_SPOT)
+                {
+                    const float cosAngle = -lightDir.DotProduct(light.direction_);
+                    if (cosAngle <= 0.0f)
+                        continue;
+
+                    const float radius = sqrtf(Max(1.0f - cosAngle * cosAngle, 0.0f)) / (cosAngle * light.tanHalfFov_);
+                    if (radius >= 1.0f)
+                        continue;
+
+                    atten *= 1.0f - radius;
+                }
+            }
+
+            const float NdotL = normal.DotProduct(lightDir);
+            if (NdotL <= 0.0f)
+                continue;
+
+            if (light.castShadows_ && IsShadowed(worldPos + normal * SHADOW_BIAS, lightDir, maxDist))
+                continue;
+
+            lightColor = lightColor + light.color_ * (NdotL * atten);
+        }
+
+        Color emissive = material.emissiveColor_;
+        if (material.emissiveMap_)
+        {
+            emissive = Modulate(emissive, SampleTexture(material.emissiveMap_, uv, lodBase));
+        }
+
+        color = Modulate(diffColor, lightColor) + emissive;
+    }
+
+    // linear depth fog, the zone's fog range
+    const float fogRange = fogEnd_ - fogStart_;
+    const float fogFactor = fogRange > 0.0f ? Clamp((fogEnd_ - depth) / fogRange, 0.0f, 1.0f) : 1.0f;
+
+    return fogColor_.Lerp(color, fogFactor);
+}
+
+Color SoftwareCaptureBackend::SampleTexture(const SoftTexture *texture, const Vector2 &uv, float lodBase) const
+{
+    const Image *level0 = texture->levels_[0];
+    const float lod = lodBase + 0.5f * log2f((float)(level0->GetWidth() * level0->GetHeight()));
+    const int level = Clamp((int)(lod + 0.5f), 0, (int)texture->levels_.Size() - 1);
+
+    // wrap addressing
+    const float u = uv.x_ - floorf(uv.x_);
+    const float v = uv.y_ - floorf(uv.y_);
+
+    return texture->levels_[level]->GetPixelBilinear(u, v);
+}
+
+bool SoftwareCaptureBackend::IsShadowed(const Vector3 &origin, const Vector3 &dir, float maxDist) const
+{
+    if (shadowNodes_.Empty())
+        return false;
+
+    const Ray ray(origin, dir);
+    unsigned stack[SHADOW_STACK_SIZE];
+    unsigned stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize)
+    {
+        const unsigned nodeIdx = stack[--stackSize];
+        const ShadowNode &node = shadowNodes_[nodeIdx];
+
+        if (ray.HitDistance(node.box_) >= maxDist)
+            continue;
+
+        if (node.count_ == 0)
+        {
+            stack[stackSize++] = node.first_;
+            stack[stackSize++] = nodeIdx + 1;
+            continue;
+        }
+
+        for ( unsigned i = node.first_; i < node.first_ + node.count_; ++i )
+        {
+            const SoftVertex *v = &vertices_[shadowTriangles_[i] * 3];
+            if (RayTriangle(origin, dir, v[0].position_, v[1].position_, v[2].position_) < maxDist)
+                return true;
+        }
+    }
+
+    return false;
+}
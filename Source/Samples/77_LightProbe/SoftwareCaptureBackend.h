@@ -0,0 +1,239 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Core/HelperThread.h>
+#include <Urho3D/Graphics/GraphicsDefs.h>
+#include <Urho3D/Math/BoundingBox.h>
+#include <Urho3D/Math/Color.h>
+#include <Urho3D/Math/Vector2.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "CaptureBackend.h"
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class Context;
+class Image;
+class Light;
+class Material;
+class Scene;
+class StaticModel;
+class Texture;
+}
+
+//=============================================================================
+// cpu rasterizer for headless bakes. draws StaticModel geometry with the
+// material diffuse/emissive color and textures, lit by the zone ambient and
+// the scene's directional, point and spot lights, in the same face layout
+// and color encoding the gpu capture reads back.
+//
+// approximations: light ramps and spot shapes are analytic, shadows are
+// traced through a bvh over shadow casting geometry, no specular, alpha is opaque.
+// each face's triangles are clipped and projected once and binned into row
+// bands, then the bands are rasterized in parallel.
+//
+// during a bake the whole scene is gathered once and each capture only
+// culls it to its far clip. outside of a bake it's gathered per capture
+//=============================================================================
+class SoftwareCaptureBackend : public CaptureBackend
+{
+public:
+    SoftwareCaptureBackend(Context *context);
+    virtual ~SoftwareCaptureBackend();
+
+    // threads used per cube, the calling thread included
+    void SetNumThreads(unsigned numThreads)     { numThreads_ = Max(numThreads, 1u); }
+    unsigned GetNumThreads() const              { return numThreads_; }
+
+    virtual void BeginBake();
+    virtual void EndBake();
+    virtual bool CaptureCube(Scene *scene, const Vector3 &position, const CubeCaptureSettings &settings, SHCubeFaces &faces);
+
+    // regathers the scene on the next capture, for edits made during a bake
+    void InvalidateScene()                      { sceneValid_ = false; }
+
+protected:
+    struct SoftTexture
+    {
+        // mip chain, level 0 is the source image
+        Vector<SharedPtr<Image> > levels_;
+    };
+
+    struct SoftMaterial
+    {
+        Color diffColor_;
+        Color emissiveColor_;
+        const SoftTexture *diffMap_;
+        const SoftTexture *emissiveMap_;
+        bool lit_;
+        CullMode cullMode_;
+    };
+
+    struct SoftVertex
+    {
+        Vector3 position_;
+        Vector3 normal_;
+        Vector2 uv_;
+    };
+
+    // vertices 3 * index to 3 * index + 2
+    struct SoftTriangle
+    {
+        unsigned material_;
+        float uvArea_;
+    };
+
+    // triangles firstTriangle_ to endTriangle_ - 1 come from one drawable
+    struct SoftDrawable
+    {
+        BoundingBox box_;
+        unsigned firstTriangle_;
+        unsigned endTriangle_;
+    };
+
+    struct SoftLight
+    {
+        BoundingBox box_;
+        LightType type_;
+        Vector3 position_;
+        Vector3 direction_;
+        Color color_;
+        float range_;
+        float tanHalfFov_;
+        bool castShadows_;
+    };
+
+    // bvh over the shadow casting triangles. a leaf holds count_ triangles
+    // from shadowTriangles_[first_], an inner node has count_ 0, its first
+    // child right after it and the second at first_
+    struct ShadowNode
+    {
+        BoundingBox box_;
+        unsigned first_;
+        unsigned count_;
+    };
+
+    // a triangle clipped and projected into one face, its vertices are
+    // consecutive in the face's vertex list
+    struct FacePolygon
+    {
+        unsigned triangle_;
+        unsigned firstVertex_;
+        unsigned numVerts_;
+        float lodBase_;
+    };
+
+    // pixel position, 1/depth and barycentrics over depth
+    struct FaceVertex
+    {
+        float x_;
+        float y_;
+        float invN_;
+        float b1N_;
+        float b2N_;
+    };
+
+    // rows y0 to y1 of a face, the polygons overlapping them are bins_[binBegin_ .. binEnd_]
+    struct Tile
+    {
+        unsigned face_;
+        int y0_;
+        int y1_;
+        unsigned binBegin_;
+        unsigned binEnd_;
+    };
+
+    typedef void (SoftwareCaptureBackend::*ItemFn)(unsigned);
+
+    void GatherScene(Scene *scene, const CubeCaptureSettings &settings);
+    void ClearScene();
+    void CullScene(Scene *scene);
+    void AddStaticModel(StaticModel *model);
+    void AddLight(Light *light);
+    unsigned GetMaterialIndex(Material *material);
+    const SoftTexture* GetTexture(Texture *texture);
+    unsigned BuildShadowNode(unsigned begin, unsigned end, const PODVector<Vector3> &centers);
+
+    void RunParallel(unsigned numItems, ItemFn itemFn);
+    void ReleaseWorkers();
+    void WorkerProcess(void *data);
+    void ProcessItems();
+    void SetupFace(unsigned face);
+    void RasterizeTile(unsigned tileIdx);
+    Color ShadePixel(unsigned triIdx, float b1, float b2, float depth, float lodBase) const;
+    Color SampleTexture(const SoftTexture *texture, const Vector2 &uv, float lodBase) const;
+    bool IsShadowed(const Vector3 &origin, const Vector3 &dir, float maxDist) const;
+
+protected:
+    Context *context_;
+    unsigned numThreads_;
+    HashMap<String, SoftTexture> textures_;
+
+    // gathered scene, kept for the whole bake
+    bool baking_;
+    bool sceneValid_;
+    WeakPtr<Scene> scene_;
+    unsigned viewMask_;
+    bool drawShadows_;
+
+    PODVector<SoftVertex> vertices_;
+    PODVector<SoftTriangle> triangles_;
+    PODVector<SoftMaterial> materials_;
+    HashMap<Material*, unsigned> materialIndices_;
+    PODVector<SoftDrawable> drawables_;
+    PODVector<SoftLight> sceneLights_;
+    PODVector<unsigned> shadowTriangles_;
+    PODVector<ShadowNode> shadowNodes_;
+
+    // per capture
+    Vector3 position_;
+    float farClip_;
+    SHCubeFaces *faces_;
+    Color ambientColor_;
+    Color fogColor_;
+    float fogStart_;
+    float fogEnd_;
+    PODVector<unsigned> visibleDrawables_;
+    PODVector<SoftLight> lights_;
+
+    PODVector<FacePolygon> polygons_[MAX_CUBEMAP_FACES];
+    PODVector<FaceVertex> polygonVerts_[MAX_CUBEMAP_FACES];
+    PODVector<unsigned> bins_[MAX_CUBEMAP_FACES];
+    PODVector<Tile> tiles_;
+    unsigned tilesPerFace_;
+
+    // items handed out to the threads, the workers are kept until EndBake()
+    Vector<SharedPtr<HelperThread<SoftwareCaptureBackend> > > workers_;
+    ItemFn itemFn_;
+    unsigned numItems_;
+    std::atomic<unsigned> nextItem_;
+    unsigned numActive_;
+    std::mutex workMutex_;
+    std::condition_variable workDoneCond_;
+};
@@ -0,0 +1,447 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/Graphics/Drawable.h>
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/JSONFile.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "LightProbeBaker.h"
+#include "LightProbeCreator.h"
+#include "SoftwareCaptureBackend.h"
+#include "SHBakeCache.h"
+#include "SHProbeSet.h"
+#include "SHIrradianceVolume.h"
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+URHO3D_DEFINE_APPLICATION_MAIN(LightProbeBaker)
+
+//=============================================================================
+//=============================================================================
+LightProbeBaker::LightProbeBaker(Context* context)
+    : Application(context)
+    , resourcePaths_("Data;CoreData;Data/LightProbe;")
+    , numThreads_(GetNumLogicalCPUs())
+    , faceSize_(32)
+    , shOrder_(SHOrder_L2)
+    , encoding_(SHEncode_ScaleBias)
+    , hdrCapture_(false)
+    , useCache_(true)
+    , volumeCellSize_(1.0f)
+    , loadUSec_(0)
+    , bakeUSec_(0)
+    , numProbes_(0)
+{
+}
+
+LightProbeBaker::~LightProbeBaker()
+{
+}
+
+void LightProbeBaker::Setup()
+{
+    if (!ParseArguments())
+    {
+        PrintUsage();
+        ErrorExit("invalid arguments, see the usage printed to stderr");
+        return;
+    }
+
+    engineParameters_["Headless"]      = true;
+    engineParameters_["LogName"]       = GetSubsystem<FileSystem>()->GetProgramDir() + "lightProbeBaker.log";
+    engineParameters_["ResourcePaths"] = resourcePaths_;
+}
+
+void LightProbeBaker::Start()
+{
+    // needs to be registered before the scene is loaded, otherwise, LightProbe component is unknown
+    LightProbeCreator *lightProbeCreator = new LightProbeCreator(context_);
+    context_->RegisterSubsystem(lightProbeCreator);
+
+    timer_.Reset();
+
+    if (!LoadScene())
+    {
+        ErrorExit("LightProbeBaker: failed to load " + sceneFilename_);
+        return;
+    }
+
+    loadUSec_ = timer_.GetUSec(true);
+
+    SharedPtr<SoftwareCaptureBackend> backend(new SoftwareCaptureBackend(context_));
+    backend->SetNumThreads(numThreads_);
+
+    CubeCaptureSettings settings = lightProbeCreator->GetCaptureSettings();
+    settings.faceSize_ = faceSize_;
+
+    lightProbeCreator->Init(scene_, "Data/LightProbe");
+    lightProbeCreator->SetCaptureBackend(backend);
+    lightProbeCreator->SetCaptureSettings(settings);
+    lightProbeCreator->SetHDRCapture(hdrCapture_);
+    lightProbeCreator->SetSHOrder(shOrder_);
+    lightProbeCreator->SetTableEncoding(encoding_);
+    lightProbeCreator->SetOutputFilename(outputFilename_);
+    GetSubsystem<FileSystem>()->CreateDir(GetPath(outputFilename_));
+    lightProbeCreator->SetBakeCacheDir(useCache_ ? cacheDir_ : String::EMPTY);
+    lightProbeCreator->SetVolumeCellSize(volumeCellSize_);
+    lightProbeCreator->SetVolumeBounds(volumeBounds_);
+    lightProbeCreator->SetReportFilename(reportFilename_);
+
+    // the rasterizer already spreads a cube over all threads, so one probe
+    // at a time and a single projection thread keep the cores busy
+    lightProbeCreator->SetMaxThreads(1);
+    lightProbeCreator->SetNumProjectionThreads(1);
+
+    SubscribeToEvent(E_LIGHTPROBESTATUS, URHO3D_HANDLER(LightProbeBaker, HandleLPStatusEvent));
+
+    URHO3D_LOGINFO("LightProbeBaker: baking " + String(numProbes_) + " probes of " + sceneFilename_ +
+                   " with " + String(numThreads_) + " threads");
+
+    lightProbeCreator->GenerateLightProbes();
+}
+
+void LightProbeBaker::Stop()
+{
+    scene_.Reset();
+}
+
+bool LightProbeBaker::ParseArguments()
+{
+    const Vector<String> &arguments = GetArguments();
+    FileSystem *fileSystem = GetSubsystem<FileSystem>();
+
+    for ( unsigned i = 0; i < arguments.Size(); ++i )
+    {
+        // accept -option and --option, engine options such as -log pass through
+        String option = arguments[i];
+        while (option.StartsWith("-"))
+        {
+            option = option.Substring(1);
+        }
+        option = option.ToLower();
+
+        const bool hasValue = i + 1 < arguments.Size();
+        const String value = hasValue ? arguments[i + 1] : String::EMPTY;
+
+        if (option == "help" || option == "h")
+        {
+            return false;
+        }
+        else if (option == "hdr")
+        {
+            hdrCapture_ = true;
+        }
+        else if (option == "nocache")
+        {
+            useCache_ = false;
+        }
+        else if (option == "scene" || option == "output" || option == "summary" || option == "report" || option == "cache" ||
+                 option == "resources" || option == "threads" || option == "size" || option == "encoding" || option == "order" ||
+                 option == "cellsize" || option == "bounds")
+        {
+            if (!hasValue)
+            {
+                PrintLine("missing value for -" + option, true);
+                return false;
+            }
+            ++i;
+
+            if (option == "scene")
+            {
+                sceneFilename_ = IsAbsolutePath(value) ? value : fileSystem->GetCurrentDir() + value;
+            }
+            else if (option == "output")
+            {
+                outputFilename_ = IsAbsolutePath(value) ? value : fileSystem->GetCurrentDir() + value;
+            }
+            else if (option == "summary")
+            {
+                summaryFilename_ = IsAbsolutePath(value) ? value : fileSystem->GetCurrentDir() + value;
+            }
+            else if (option == "report")
+            {
+                reportFilename_ = IsAbsolutePath(value) ? value : fileSystem->GetCurrentDir() + value;
+            }
+            else if (option == "cache")
+            {
+                cacheDir_ = IsAbsolutePath(value) ? value : fileSystem->GetCurrentDir() + value;
+            }
+            else if (option == "resources")
+            {
+                resourcePaths_ = value;
+            }
+            else if (option == "threads")
+            {
+                numThreads_ = Max(ToUInt(value), 1u);
+            }
+            else if (option == "size")
+            {
+                faceSize_ = ToInt(value);
+                if (faceSize_ < 8 || faceSize_ > 512 || !IsPowerOfTwo(faceSize_))
+                {
+                    PrintLine("-size must be a power of two in [8, 512]", true);
+                    return false;
+                }
+            }
+            else if (option == "encoding")
+            {
+                encoding_ = SHTableEncoder::GetEncodingFromName(value);
+
+                // unknown names fall back to rgba8, don't let a typo through
+                if (value.Compare(SHTableEncoder::GetEncodingName(encoding_), false) != 0)
+                {
+                    PrintLine("unknown -encoding " + value, true);
+                    return false;
+                }
+            }
+            else if (option == "order")
+            {
+                shOrder_ = ToInt(value);
+                if (shOrder_ < SHOrder_L1 || shOrder_ > SHOrder_L3)
+                {
+                    PrintLine("-order must be 1, 2 or 3", true);
+                    return false;
+                }
+            }
+            else if (option == "cellsize")
+            {
+                volumeCellSize_ = ToFloat(value);
+                if (volumeCellSize_ < 0.0f)
+                {
+                    PrintLine("-cellsize must be 0 or positive", true);
+                    return false;
+                }
+            }
+            else if (option == "bounds")
+            {
+                const Vector<String> values = value.Split(' ');
+                if (values.Size() != 6)
+                {
+                    PrintLine("-bounds needs six numbers, \"minx miny minz maxx maxy maxz\"", true);
+                    return false;
+                }
+
+                volumeBounds_ = BoundingBox(Vector3(ToFloat(values[0]), ToFloat(values[1]), ToFloat(values[2])),
+                                            Vector3(ToFloat(values[3]), ToFloat(values[4]), ToFloat(values[5])));
+            }
+        }
+    }
+
+    if (sceneFilename_.Empty())
+    {
+        PrintLine("no -scene given", true);
+        return false;
+    }
+
+    // defaults next to the scene and the output
+    if (outputFilename_.Empty())
+    {
+        outputFilename_ = GetPath(sceneFilename_) + "SHprobeData.png";
+    }
+    if (summaryFilename_.Empty())
+    {
+        summaryFilename_ = ReplaceExtension(outputFilename_, ".bake.json");
+    }
+    if (cacheDir_.Empty())
+    {
+        cacheDir_ = GetPath(outputFilename_) + "BakeCache";
+    }
+
+    return true;
+}
+
+void LightProbeBaker::PrintUsage() const
+{
+    PrintLine("usage: 78_LightProbeBaker -scene <file.xml> [options]\n"
+              "  -output <file.png>   probe table, .xml layout, .shps set and .shvol volume are written next to it\n"
+              "                       (default: SHprobeData.png next to the scene)\n"
+              "  -summary <file.json> timing summary (default: <output>.bake.json)\n"
+              "  -report <file.json>  per stage timings, memory and thread use of the bake (default: none)\n"
+              "  -threads <n>         rasterizer threads (default: logical cpus)\n"
+              "  -size <n>            cube face size, power of two in [8, 512] (default: 32)\n"
+              "  -encoding <name>     rgba8, rgba16f, rgb9e5 or scalebias (default: scalebias)\n"
+              "  -order <n>           sh order 1, 2 or 3 (default: 2)\n"
+              "  -cellsize <f>        irradiance volume cell size, 0 skips the volume and deletes an old one (default: 1)\n"
+              "  -bounds \"<6 floats>\" irradiance volume min and max corners (default: probe bounds)\n"
+              "  -hdr                 capture in half floats\n"
+              "  -cache <dir>         bake cache dir (default: BakeCache next to the output)\n"
+              "  -nocache             bake every probe\n"
+              "  -resources <paths>   resource paths (default: Data;CoreData;Data/LightProbe;)", true);
+}
+
+bool LightProbeBaker::LoadScene()
+{
+    scene_ = new Scene(context_);
+
+    File file(context_, sceneFilename_, FILE_READ);
+    if (!file.IsOpen() || !scene_->LoadXML(file))
+    {
+        URHO3D_LOGERROR("LightProbeBaker: failed to load scene " + sceneFilename_);
+        return false;
+    }
+
+    // no renderer updates the octree in headless mode, place the drawables
+    // in their octants before anything queries it
+    Octree *octree = scene_->GetComponent<Octree>();
+    if (!octree)
+    {
+        URHO3D_LOGERROR("LightProbeBaker: scene " + sceneFilename_ + " has no octree");
+        return false;
+    }
+
+    FrameInfo frame;
+    frame.frameNumber_ = 1;
+    frame.timeStep_ = 0.0f;
+    frame.viewSize_ = IntVector2::ZERO;
+    frame.camera_ = NULL;
+    octree->Update(frame);
+
+    PODVector<Node*> probeNodes;
+    scene_->GetChildrenWithComponent(probeNodes, "LightProbe", true);
+    numProbes_ = probeNodes.Size();
+
+    if (numProbes_ == 0)
+    {
+        URHO3D_LOGERROR("LightProbeBaker: scene " + sceneFilename_ + " has no light probes");
+        return false;
+    }
+
+    return true;
+}
+
+bool LightProbeBaker::WriteSummary(bool succeeded) const
+{
+    LightProbeCreator *lightProbeCreator = GetSubsystem<LightProbeCreator>();
+    SHBakeCache *bakeCache = lightProbeCreator->GetBakeCache();
+
+    const double bakeMSec = (double)bakeUSec_ / 1000.0;
+
+    SharedPtr<JSONFile> json(new JSONFile(context_));
+    JSONValue &root = json->GetRoot();
+    root["scene"]        = sceneFilename_;
+    root["output"]       = outputFilename_;
+    root["succeeded"]    = succeeded;
+    root["probes"]       = numProbes_;
+    root["cacheHits"]    = bakeCache ? bakeCache->GetNumHits() : 0u;
+    root["cacheMisses"]  = bakeCache ? bakeCache->GetNumMisses() : numProbes_;
+    root["faceSize"]     = faceSize_;
+    root["threads"]      = numThreads_;
+    root["encoding"]     = SHTableEncoder::GetEncodingName(encoding_);
+    root["order"]        = shOrder_;
+    root["hdr"]          = hdrCapture_;
+    root["loadMSec"]     = (double)loadUSec_ / 1000.0;
+    root["bakeMSec"]     = bakeMSec;
+    root["msecPerProbe"] = numProbes_ ? bakeMSec / numProbes_ : 0.0;
+
+    if (succeeded && volumeCellSize_ > 0.0f)
+    {
+        CheckVolume(root["volume"]);
+    }
+
+    File file(context_, summaryFilename_, FILE_WRITE);
+    if (!file.IsOpen() || !json->Save(file))
+    {
+        URHO3D_LOGERROR("LightProbeBaker: failed to write " + summaryFilename_);
+        return false;
+    }
+
+    return true;
+}
+
+void LightProbeBaker::CheckVolume(JSONValue &result) const
+{
+    // reload what was written and compare the volume's cpu sampler with the
+    // probes it was resampled from
+    SharedPtr<SHProbeSet> probeSet(new SHProbeSet(context_));
+    SharedPtr<SHIrradianceVolume> volume(new SHIrradianceVolume(context_));
+    File probeSetFile(context_, ReplaceExtension(outputFilename_, ".shps"), FILE_READ);
+    File volumeFile(context_, ReplaceExtension(outputFilename_, ".shvol"), FILE_READ);
+
+    if (!probeSetFile.IsOpen() || !probeSet->Load(probeSetFile) || !volumeFile.IsOpen() || !volume->Load(volumeFile))
+    {
+        result["error"] = "could not reload the probe set or volume";
+        return;
+    }
+
+    const unsigned numCoeffs = volume->GetNumCoeffs();
+    PODVector<Vector3> sampled(numCoeffs);
+    float maxError = 0.0f;
+
+    for ( unsigned i = 0; i < probeSet->GetNumProbes(); ++i )
+    {
+        const float *coeffs = probeSet->GetCoeffs(i);
+        volume->Sample(probeSet->GetPosition(i), &sampled[0]);
+
+        for ( unsigned j = 0; j < numCoeffs * 3; ++j )
+        {
+            maxError = Max(maxError, Abs(sampled[j / 3].Data()[j % 3] - coeffs[j]));
+        }
+    }
+
+    JSONArray size;
+    for ( unsigned a = 0; a < 3; ++a )
+    {
+        size.Push(volume->GetSize(a));
+    }
+
+    result["size"]          = size;
+    result["cellSize"]      = volume->GetCellSize();
+    result["coeffs"]        = numCoeffs;
+    result["bytes"]         = volume->GetSize(0) * volume->GetSize(1) * volume->GetSize(2) * volume->GetNumSlabs() * 8;
+    result["maxProbeError"] = maxError;
+}
+
+void LightProbeBaker::HandleLPStatusEvent(StringHash eventType, VariantMap& eventData)
+{
+    using namespace LightProbeStatus;
+    unsigned totalCnt = eventData[P_TOTAL].GetUInt();
+    unsigned completeCnt = eventData[P_COMPLETED].GetUInt();
+
+    if (totalCnt != completeCnt)
+    {
+        return;
+    }
+
+    bakeUSec_ = timer_.GetUSec(false);
+
+    const bool succeeded = GetSubsystem<LightProbeCreator>()->IsOutputWritten();
+    const bool summaryWritten = WriteSummary(succeeded);
+
+    if (succeeded && summaryWritten)
+    {
+        URHO3D_LOGINFO("LightProbeBaker: wrote " + outputFilename_ + " in " + String((float)bakeUSec_ / 1000.0f) + " msec.");
+        engine_->Exit();
+    }
+    else
+    {
+        ErrorExit("LightProbeBaker: bake of " + sceneFilename_ + " failed");
+    }
+}
@@ -0,0 +1,88 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Engine/Application.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Math/BoundingBox.h>
+
+#include "SHTableEncoder.h"
+
+namespace Urho3D
+{
+class JSONValue;
+class Scene;
+}
+
+//=============================================================================
+// headless probe bake: loads a scene xml, bakes its light probes with the
+// software capture backend and writes the probe table, its layout, the probe
+// set, the irradiance volume and a json timing summary. exits non-zero if any of it fails.
+//
+// usage: 78_LightProbeBaker -scene <file.xml> [options], see PrintUsage()
+//=============================================================================
+class LightProbeBaker : public Application
+{
+    URHO3D_OBJECT(LightProbeBaker, Application);
+
+public:
+    LightProbeBaker(Context* context);
+    ~LightProbeBaker();
+
+    virtual void Setup();
+    virtual void Start();
+    virtual void Stop();
+
+protected:
+    bool ParseArguments();
+    void PrintUsage() const;
+    bool LoadScene();
+    bool WriteSummary(bool succeeded) const;
+    void CheckVolume(JSONValue &result) const;
+    void HandleLPStatusEvent(StringHash eventType, VariantMap& eventData);
+
+protected:
+    SharedPtr<Scene> scene_;
+
+    // options
+    String sceneFilename_;
+    String outputFilename_;
+    String summaryFilename_;
+    String reportFilename_;
+    String cacheDir_;
+    String resourcePaths_;
+    unsigned numThreads_;
+    int faceSize_;
+    int shOrder_;
+    SHTableEncoding encoding_;
+    bool hdrCapture_;
+    bool useCache_;
+    float volumeCellSize_;
+    BoundingBox volumeBounds_;
+
+    // timing
+    HiresTimer timer_;
+    long long loadUSec_;
+    long long bakeUSec_;
+    unsigned numProbes_;
+};
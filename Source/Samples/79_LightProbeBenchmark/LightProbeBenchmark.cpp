@@ -0,0 +1,747 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/HelperThread.h>
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Math/Random.h>
+
+#include "LightProbeBenchmark.h"
+#include "ProbeSpatialIndex.h"
+#include "BakeJobPool.h"
+#include "SHTileProjector.h"
+#include "CubeTexelTable.h"
+#include "SHBasis.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+// probes spread over a level sized volume, queries cover it and a margin
+static const Vector3 LEVEL_SIZE(400.0f, 40.0f, 400.0f);
+static const float QUERY_MARGIN = 20.0f;
+
+// the character's probe search distance
+static const float NEAREST_MAX_DIST = 15.0f;
+static const float RADIUS_QUERY = 10.0f;
+
+// enough queries to time small sets without making the linear scan of the big ones crawl
+static const unsigned QUERY_BUDGET = 20000000;
+static const unsigned MIN_QUERIES = 1000;
+static const unsigned MAX_QUERIES = 200000;
+
+// LightProbeCreator's defaults: capture face size and probes in flight
+static const int BAKE_FACE_SIZE = 32;
+static const unsigned BAKE_MAX_IN_FLIGHT = 8;
+
+// the helper thread check's queue, small so it's overrun several times
+static const unsigned CHECK_QUEUE_SIZE = 8;
+static const unsigned CHECK_NUM_POSTS = 3 * CHECK_QUEUE_SIZE + 1;
+
+//=============================================================================
+//=============================================================================
+URHO3D_DEFINE_APPLICATION_MAIN(LightProbeBenchmark)
+
+//=============================================================================
+//=============================================================================
+LightProbeBenchmark::LightProbeBenchmark(Context* context)
+    : Application(context)
+{
+}
+
+LightProbeBenchmark::~LightProbeBenchmark()
+{
+}
+
+void LightProbeBenchmark::Setup()
+{
+    engineParameters_["Headless"]      = true;
+    engineParameters_["LogName"]       = GetSubsystem<FileSystem>()->GetProgramDir() + "lightProbeBenchmark.log";
+    engineParameters_["ResourcePaths"] = "CoreData;";
+}
+
+void LightProbeBenchmark::Start()
+{
+    static const unsigned probeCounts[] = { 10, 1000, 100000 };
+    bool succeeded = true;
+
+    PrintLine("probe index: ns per query, linear scan / spatial index");
+    PrintLine("   probes  queries   build ms      nearest         k=4 nearest     radius");
+
+    for ( unsigned i = 0; i < sizeof(probeCounts) / sizeof(probeCounts[0]); ++i )
+    {
+        succeeded &= RunProbeIndexBenchmark(probeCounts[i]);
+    }
+
+    static const unsigned bakeCounts[] = { 6, 100, 1000 };
+
+    PrintLine("");
+    PrintLine(ToString("bake jobs: %dx%d L2 cube projection, %u probes in flight, %u logical cpus",
+                       BAKE_FACE_SIZE, BAKE_FACE_SIZE, BAKE_MAX_IN_FLIGHT, GetNumLogicalCPUs()));
+    PrintLine("cores busy: cpu time / wall time, working: single thread projection time / wall time");
+    PrintLine("   probes  model               wall ms     cpu ms  cores busy  working");
+
+    // the models only differ in overhead on one cpu, scaling needs more
+    if (GetNumLogicalCPUs() < 2)
+    {
+        PrintLine("note: single cpu, these numbers show overhead only, not scaling");
+    }
+
+    for ( unsigned i = 0; i < sizeof(bakeCounts) / sizeof(bakeCounts[0]); ++i )
+    {
+        succeeded &= RunBakeJobBenchmark(bakeCounts[i]);
+    }
+
+    PrintLine("");
+    succeeded &= RunHelperThreadCheck();
+
+    if (succeeded)
+    {
+        engine_->Exit();
+    }
+    else
+    {
+        ErrorExit("LightProbeBenchmark: results differ from the reference");
+    }
+}
+
+static Vector3 RandomPosition(const Vector3 &size, float margin)
+{
+    return Vector3(Random(-margin, size.x_ + margin), Random(-margin, size.y_ + margin), Random(-margin, size.z_ + margin));
+}
+
+bool LightProbeBenchmark::RunProbeIndexBenchmark(unsigned numProbes)
+{
+    const unsigned numQueries = Clamp(QUERY_BUDGET / numProbes, MIN_QUERIES, MAX_QUERIES);
+    const unsigned K = 4;
+
+    SetRandomSeed(numProbes);
+
+    PODVector<Vector3> probes(numProbes);
+    PODVector<Vector3> queries(numQueries);
+
+    for ( unsigned i = 0; i < numProbes; ++i )
+    {
+        probes[i] = RandomPosition(LEVEL_SIZE, 0.0f);
+    }
+    for ( unsigned i = 0; i < numQueries; ++i )
+    {
+        queries[i] = RandomPosition(LEVEL_SIZE, QUERY_MARGIN);
+    }
+
+    HiresTimer timer;
+    SharedPtr<ProbeSpatialIndex> index(new ProbeSpatialIndex());
+    index->Build(&probes[0], numProbes);
+    const float buildMSec = (float)timer.GetUSec(true) / 1000.0f;
+
+    // the checksums keep the loops from being optimized out and are compared after
+    PODVector<unsigned> radiusResult;
+    unsigned slots[K];
+    float distSq[K];
+    long long linearUSec[3];
+    long long indexUSec[3];
+    long long linearSum[3] = { 0, 0, 0 };
+    long long indexSum[3] = { 0, 0, 0 };
+    const float maxDistSq = NEAREST_MAX_DIST * NEAREST_MAX_DIST;
+    const float radiusSq = RADIUS_QUERY * RADIUS_QUERY;
+
+    // nearest within NEAREST_MAX_DIST, what Character::UpdateLPIndex() used to do
+    timer.Reset();
+    for ( unsigned q = 0; q < numQueries; ++q )
+    {
+        float bestDistSq = maxDistSq;
+        int best = -1;
+
+        for ( unsigned i = 0; i < numProbes; ++i )
+        {
+            const float d = (probes[i] - queries[q]).LengthSquared();
+            if (d < bestDistSq)
+            {
+                bestDistSq = d;
+                best = (int)i;
+            }
+        }
+        linearSum[0] += best;
+    }
+    linearUSec[0] = timer.GetUSec(true);
+
+    for ( unsigned q = 0; q < numQueries; ++q )
+    {
+        indexSum[0] += index->FindNearest(queries[q], NEAREST_MAX_DIST);
+    }
+    indexUSec[0] = timer.GetUSec(true);
+
+    // k nearest, unbounded
+    for ( unsigned q = 0; q < numQueries; ++q )
+    {
+        unsigned count = 0;
+
+        for ( unsigned i = 0; i < numProbes; ++i )
+        {
+            const float d = (probes[i] - queries[q]).LengthSquared();
+            if (count == K && d >= distSq[K - 1])
+                continue;
+
+            unsigned j = count < K ? count++ : K - 1;
+            while (j > 0 && distSq[j - 1] > d)
+            {
+                slots[j] = slots[j - 1];
+                distSq[j] = distSq[j - 1];
+                --j;
+            }
+            slots[j] = i;
+            distSq[j] = d;
+        }
+        for ( unsigned j = 0; j < count; ++j )
+        {
+            linearSum[1] += slots[j];
+        }
+    }
+    linearUSec[1] = timer.GetUSec(true);
+
+    for ( unsigned q = 0; q < numQueries; ++q )
+    {
+        const unsigned count = index->FindNearest(queries[q], K, slots, distSq);
+        for ( unsigned j = 0; j < count; ++j )
+        {
+            indexSum[1] += slots[j];
+        }
+    }
+    indexUSec[1] = timer.GetUSec(true);
+
+    // radius
+    for ( unsigned q = 0; q < numQueries; ++q )
+    {
+        for ( unsigned i = 0; i < numProbes; ++i )
+        {
+            if ((probes[i] - queries[q]).LengthSquared() <= radiusSq)
+            {
+                linearSum[2] += i + 1;
+            }
+        }
+    }
+    linearUSec[2] = timer.GetUSec(true);
+
+    for ( unsigned q = 0; q < numQueries; ++q )
+    {
+        index->FindInRadius(queries[q], RADIUS_QUERY, radiusResult);
+        for ( unsigned j = 0; j < radiusResult.Size(); ++j )
+        {
+            indexSum[2] += radiusResult[j] + 1;
+        }
+    }
+    indexUSec[2] = timer.GetUSec(true);
+
+    char line[256];
+    float nsPerQuery[6];
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        nsPerQuery[i * 2] = (float)linearUSec[i] * 1000.0f / (float)numQueries;
+        nsPerQuery[i * 2 + 1] = (float)indexUSec[i] * 1000.0f / (float)numQueries;
+    }
+
+    sprintf(line, "%9u %8u %10.3f %9.0f / %-6.0f %9.0f / %-6.0f %9.0f / %-6.0f", numProbes, numQueries, buildMSec,
+            nsPerQuery[0], nsPerQuery[1], nsPerQuery[2], nsPerQuery[3], nsPerQuery[4], nsPerQuery[5]);
+    PrintLine(line);
+
+    // ties in distance are practically impossible with random positions, so
+    // both sides have to find exactly the same probes
+    bool succeeded = true;
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        if (linearSum[i] != indexSum[i])
+        {
+            PrintLine("  checksum mismatch in query " + String(i) + ": " + String(linearSum[i]) + " vs " + String(indexSum[i]), true);
+            succeeded = false;
+        }
+    }
+
+    return succeeded;
+}
+
+//=============================================================================
+// bake jobs. both models get the creator's main loop: probes are started up
+// to the in flight limit and finished probes are picked up once per frame
+//=============================================================================
+struct BakeInput
+{
+    const CubeTexelTable *texelTable_;
+    PODVector<float> colR_;
+    PODVector<float> colG_;
+    PODVector<float> colB_;
+};
+
+// HelperThread as it was before it became event driven, kept so the
+// baseline still pays for it: a looping thread calls its ProcessFn again
+// after every Sleep(0) and WaitExit() polls every millisecond
+template<class T>
+class LegacyHelperThread : public Thread, public RefCounted
+{
+public:
+    typedef void (T::*ProcessFn)(void *);
+
+    LegacyHelperThread(T *parent, ProcessFn pFn, bool looping=true, int priority=M_MAX_INT)
+        : parent_(parent), processFn_(pFn), looping_(looping), priority_(priority), fnExited_(true)
+    {
+    }
+
+    virtual ~LegacyHelperThread()
+    {
+        WaitExit();
+    }
+
+    void Start()
+    {
+        Run();
+        SetPriority(priority_);
+    }
+
+    virtual void ThreadFunction()
+    {
+        SetFnExit(false);
+
+        while (true)
+        {
+            (parent_->*processFn_)(parent_);
+
+            if (!IsLooping())
+                break;
+
+            Time::Sleep(0);
+        }
+
+        SetFnExit(true);
+    }
+
+    bool HasFnExited()
+    {
+        MutexLock lock(mutexLock_);
+        return fnExited_;
+    }
+
+protected:
+    void WaitExit()
+    {
+        SetLooping(false);
+
+        do
+        {
+            Time::Sleep(1);
+        } while (!HasFnExited());
+    }
+
+    void SetLooping(bool bset)
+    {
+        MutexLock lock(mutexLock_);
+        looping_ = bset;
+    }
+
+    bool IsLooping()
+    {
+        MutexLock lock(mutexLock_);
+        return looping_;
+    }
+
+    void SetFnExit(bool bset)
+    {
+        MutexLock lock(mutexLock_);
+        fnExited_ = bset;
+    }
+
+protected:
+    T           *parent_;
+    ProcessFn   processFn_;
+    Mutex       mutexLock_;
+    bool        looping_;
+    int         priority_;
+    bool        fnExited_;
+};
+
+// a LightProbe before BakeJobPool: a looping HelperThread per probe that
+// projects on its own threads and spins until the main thread joins it
+class ThreadPerProbe : public RefCounted
+{
+public:
+    ThreadPerProbe(const BakeInput &input, unsigned numThreads, Vector3 *coeffs)
+        : input_(input), numThreads_(numThreads), coeffs_(coeffs), done_(false)
+    {
+        thread_ = new LegacyHelperThread<ThreadPerProbe>(this, &ThreadPerProbe::Process);
+        thread_->Start();
+    }
+
+    bool IsDone() const { return done_; }
+
+    void Process(void *data)
+    {
+        if (!done_)
+        {
+            SHTileProjector projector(SHOrder_L2, input_.texelTable_, &input_.colR_[0], &input_.colG_[0], &input_.colB_[0]);
+            projector.Run(numThreads_, coeffs_);
+            done_ = true;
+        }
+    }
+
+protected:
+    const BakeInput &input_;
+    unsigned numThreads_;
+    Vector3 *coeffs_;
+    std::atomic<bool> done_;
+    SharedPtr<LegacyHelperThread<ThreadPerProbe> > thread_;
+};
+
+class PooledProbe : public BakeJob
+{
+public:
+    PooledProbe(const BakeInput &input, Vector3 *coeffs, unsigned *numDone)
+        : projector_(SHOrder_L2, input.texelTable_, &input.colR_[0], &input.colG_[0], &input.colB_[0])
+        , coeffs_(coeffs)
+        , numDone_(numDone)
+    {
+    }
+
+    virtual void RunJob(BakeJobPool *pool, unsigned threadIndex)
+    {
+        projector_.Submit(pool, threadIndex, coeffs_, this);
+    }
+
+    virtual void JobDone()
+    {
+        ++*numDone_;
+    }
+
+protected:
+    SHTileProjector projector_;
+    Vector3 *coeffs_;
+    unsigned *numDone_;
+};
+
+// clock() is the process cpu time on posix, msvc's is wall time
+static void PrintBakeLine(unsigned numProbes, const char *model, long long wallUSec, clock_t cpuClocks, long long workUSec)
+{
+    const float wallMSec = (float)wallUSec / 1000.0f;
+    const float cpuMSec = (float)cpuClocks * 1000.0f / (float)CLOCKS_PER_SEC;
+
+    char line[256];
+    sprintf(line, "%9u  %-16s %10.1f %10.1f %11.2f %8.2f", numProbes, model, wallMSec, cpuMSec,
+            cpuMSec / wallMSec, (float)workUSec / 1000.0f / wallMSec);
+    PrintLine(line);
+}
+
+bool LightProbeBenchmark::RunBakeJobBenchmark(unsigned numProbes)
+{
+    const unsigned numCoeffs = SHNumCoeffs(SHOrder_L2);
+
+    // one random cube shared by every probe, the projection cost doesn't depend on the colors
+    BakeInput input;
+    input.texelTable_ = CubeTexelTable::Get(BAKE_FACE_SIZE);
+    const unsigned numTexels = input.texelTable_->GetTexelsPerFace() * MAX_CUBEMAP_FACES;
+
+    SetRandomSeed(numProbes);
+    input.colR_.Resize(numTexels);
+    input.colG_.Resize(numTexels);
+    input.colB_.Resize(numTexels);
+    for ( unsigned i = 0; i < numTexels; ++i )
+    {
+        input.colR_[i] = Random();
+        input.colG_[i] = Random();
+        input.colB_[i] = Random();
+    }
+
+    PODVector<Vector3> threadCoeffs(numProbes * numCoeffs);
+    PODVector<Vector3> poolCoeffs(numProbes * numCoeffs);
+    memset(&threadCoeffs[0], 0, threadCoeffs.Size() * sizeof(Vector3));
+    memset(&poolCoeffs[0], 0, poolCoeffs.Size() * sizeof(Vector3));
+
+    // the work itself, one probe on one thread
+    PODVector<Vector3> refCoeffs(numCoeffs);
+    SHTileProjector refProjector(SHOrder_L2, input.texelTable_, &input.colR_[0], &input.colG_[0], &input.colB_[0]);
+    HiresTimer timer;
+    const unsigned numRefRuns = 20;
+    for ( unsigned i = 0; i < numRefRuns; ++i )
+    {
+        refProjector.Run(1, &refCoeffs[0]);
+    }
+    const long long workUSec = timer.GetUSec(true) * numProbes / numRefRuns;
+
+    // thread per probe, the remaining cores split over the probes in flight
+    const unsigned numProjectionThreads = Max(GetNumLogicalCPUs() / BAKE_MAX_IN_FLIGHT, 1u);
+    Vector<SharedPtr<ThreadPerProbe> > inFlight;
+    unsigned numStarted = 0;
+    unsigned numDone = 0;
+    clock_t cpuStart = clock();
+    timer.Reset();
+
+    while (numDone < numProbes)
+    {
+        while (numStarted < numProbes && inFlight.Size() < BAKE_MAX_IN_FLIGHT)
+        {
+            inFlight.Push(SharedPtr<ThreadPerProbe>(new ThreadPerProbe(input, numProjectionThreads, &threadCoeffs[numStarted * numCoeffs])));
+            ++numStarted;
+        }
+
+        Time::Sleep(1);
+
+        // joins the finished ones
+        for ( unsigned i = 0; i < inFlight.Size(); )
+        {
+            if (inFlight[i]->IsDone())
+            {
+                inFlight.Erase(i);
+                ++numDone;
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    PrintBakeLine(numProbes, "thread per probe", timer.GetUSec(true), clock() - cpuStart, workUSec);
+
+    // job pool, started before the clock like the creator's
+    SharedPtr<BakeJobPool> pool(new BakeJobPool());
+    PODVector<PooledProbe*> probes(numProbes);
+    for ( unsigned i = 0; i < numProbes; ++i )
+    {
+        probes[i] = new PooledProbe(input, &poolCoeffs[i * numCoeffs], &numDone);
+    }
+
+    numStarted = 0;
+    numDone = 0;
+    timer.Reset();
+    cpuStart = clock();
+
+    while (numDone < numProbes)
+    {
+        while (numStarted < numProbes && numStarted - numDone < BAKE_MAX_IN_FLIGHT)
+        {
+            pool->Submit(probes[numStarted++]);
+        }
+
+        Time::Sleep(1);
+
+        pool->ProcessCompleted();
+    }
+
+    PrintBakeLine(numProbes, "job pool", timer.GetUSec(true), clock() - cpuStart, workUSec);
+
+    for ( unsigned i = 0; i < numProbes; ++i )
+    {
+        delete probes[i];
+    }
+
+    // the tiles are reduced in the same order either way
+    if (memcmp(&threadCoeffs[0], &poolCoeffs[0], threadCoeffs.Size() * sizeof(Vector3)) != 0)
+    {
+        PrintLine("  coeffs differ between the thread per probe and job pool bakes", true);
+        return false;
+    }
+
+    return true;
+}
+
+//=============================================================================
+// helper thread check: the looping modes' ProcessFn calls, the post queue's
+// order, Post() waiting while the queue is full and the destructor dropping
+// the calls that haven't started
+//=============================================================================
+class HelperThreadCheck : public RefCounted
+{
+public:
+    HelperThreadCheck()
+        : numProcessed_(0), numRecorded_(0), gateOpen_(true), inGate_(false), released_(false)
+    {
+    }
+
+    void Process(void *data)
+    {
+        ++numProcessed_;
+    }
+
+    // holds the thread, so whatever is posted after it stays queued
+    void Gate(void *data)
+    {
+        inGate_ = true;
+        while (!gateOpen_)
+        {
+            Time::Sleep(1);
+        }
+        inGate_ = false;
+    }
+
+    // run on its own thread, opens the gate while the main thread waits in
+    // Post() or the destructor
+    void Release(void *data)
+    {
+        Time::Sleep(20);
+        released_ = true;
+        gateOpen_ = true;
+    }
+
+    void Record(void *data)
+    {
+        posted_.Push((unsigned)(size_t)data);
+        ++numRecorded_;
+    }
+
+    void CloseGate()
+    {
+        gateOpen_ = false;
+        released_ = false;
+    }
+
+    bool WaitForGate() const
+    {
+        for ( unsigned i = 0; i < 1000 && !inGate_; ++i )
+        {
+            Time::Sleep(1);
+        }
+        return inGate_;
+    }
+
+    static bool WaitFor(const std::atomic<unsigned> &count, unsigned value)
+    {
+        for ( unsigned i = 0; i < 1000 && count < value; ++i )
+        {
+            Time::Sleep(1);
+        }
+        return count >= value;
+    }
+
+    // written by the worker, read once numRecorded_ says it's there
+    PODVector<unsigned> posted_;
+    std::atomic<unsigned> numProcessed_;
+    std::atomic<unsigned> numRecorded_;
+    std::atomic<bool> gateOpen_;
+    std::atomic<bool> inGate_;
+    std::atomic<bool> released_;
+};
+
+typedef HelperThread<HelperThreadCheck, CHECK_QUEUE_SIZE> CheckThread;
+
+bool LightProbeBenchmark::RunHelperThreadCheck()
+{
+    bool succeeded = true;
+    SharedPtr<HelperThreadCheck> check(new HelperThreadCheck());
+
+    // looping=true is still the polling loop
+    {
+        SharedPtr<CheckThread> thread(new CheckThread(check, &HelperThreadCheck::Process));
+        thread->Start();
+
+        const bool continuous = HelperThreadCheck::WaitFor(check->numProcessed_, 3);
+        PrintLine(ToString("helper thread: continuous ProcessFn calls %s", continuous ? "ok" : "FAILED"), !continuous);
+        succeeded &= continuous;
+    }
+
+    // on wake: once on Start() and once per Wake()
+    {
+        check->numProcessed_ = 0;
+        SharedPtr<CheckThread> thread(new CheckThread(check, &HelperThreadCheck::Process, HelperThread_OnWake));
+        thread->Start();
+        HelperThreadCheck::WaitFor(check->numProcessed_, 1);
+
+        thread->Wake();
+        HelperThreadCheck::WaitFor(check->numProcessed_, 2);
+
+        // and no more without another wake
+        Time::Sleep(20);
+        const bool onWake = check->numProcessed_ == 2;
+        PrintLine(ToString("helper thread: on wake ProcessFn calls %u of 2 %s", (unsigned)check->numProcessed_, onWake ? "ok" : "FAILED"), !onWake);
+        succeeded &= onWake;
+    }
+
+    // more posts than the queue holds, in order, Post() waits for room
+    {
+        SharedPtr<CheckThread> thread(new CheckThread(check, NULL, HelperThread_OnWake));
+        thread->Start();
+
+        check->CloseGate();
+        thread->Post(&HelperThreadCheck::Gate, NULL);
+        const bool gated = check->WaitForGate();
+
+        unsigned numPosted = 0;
+        while (thread->TryPost(&HelperThreadCheck::Record, (void*)(size_t)numPosted))
+        {
+            ++numPosted;
+        }
+        const bool filled = gated && numPosted == CHECK_QUEUE_SIZE && thread->GetNumQueued() == CHECK_QUEUE_SIZE;
+
+        SharedPtr<CheckThread> releaser(new CheckThread(check, &HelperThreadCheck::Release, false));
+        releaser->Start();
+        thread->Post(&HelperThreadCheck::Record, (void*)(size_t)numPosted++);
+        const bool waited = check->released_;
+        releaser = NULL;
+
+        while (numPosted < CHECK_NUM_POSTS)
+        {
+            thread->Post(&HelperThreadCheck::Record, (void*)(size_t)numPosted++);
+        }
+
+        bool ordered = HelperThreadCheck::WaitFor(check->numRecorded_, CHECK_NUM_POSTS) && check->posted_.Size() == CHECK_NUM_POSTS;
+        for ( unsigned i = 0; ordered && i < CHECK_NUM_POSTS; ++i )
+        {
+            ordered = check->posted_[i] == i;
+        }
+
+        PrintLine(ToString("helper thread: queue of %u full %s, post waited %s, %u posts in order %s", CHECK_QUEUE_SIZE,
+                           filled ? "ok" : "FAILED", waited ? "ok" : "FAILED", CHECK_NUM_POSTS, ordered ? "ok" : "FAILED"),
+                  !(filled && waited && ordered));
+        succeeded &= filled && waited && ordered;
+    }
+
+    // the destructor drops what's still queued
+    {
+        check->posted_.Clear();
+        check->numRecorded_ = 0;
+        SharedPtr<CheckThread> thread(new CheckThread(check, NULL, HelperThread_OnWake));
+        thread->Start();
+
+        check->CloseGate();
+        thread->Post(&HelperThreadCheck::Gate, NULL);
+        check->WaitForGate();
+
+        for ( unsigned i = 0; i < CHECK_QUEUE_SIZE; ++i )
+        {
+            thread->Post(&HelperThreadCheck::Record, (void*)(size_t)i);
+        }
+
+        SharedPtr<CheckThread> releaser(new CheckThread(check, &HelperThreadCheck::Release, false));
+        releaser->Start();
+        thread = NULL;
+        releaser = NULL;
+
+        const bool dropped = check->numRecorded_ == 0;
+        PrintLine(ToString("helper thread: destructor dropped %u queued posts %s", CHECK_QUEUE_SIZE, dropped ? "ok" : "FAILED"), !dropped);
+        succeeded &= dropped;
+    }
+
+    return succeeded;
+}
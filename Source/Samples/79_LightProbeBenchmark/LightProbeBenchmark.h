@@ -0,0 +1,52 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Engine/Application.h>
+
+using namespace Urho3D;
+
+//=============================================================================
+// headless microbenchmarks for the light probe runtime, results are printed
+// to stdout. probe index: nearest and radius queries through
+// ProbeSpatialIndex against the linear scan it replaced, over random probes.
+// bake jobs: projecting probe cubes on BakeJobPool against the thread per
+// probe model it replaced. helper thread: checks of the queue and the
+// looping modes HelperThread's users rely on
+//=============================================================================
+class LightProbeBenchmark : public Application
+{
+    URHO3D_OBJECT(LightProbeBenchmark, Application);
+
+public:
+    LightProbeBenchmark(Context* context);
+    ~LightProbeBenchmark();
+
+    virtual void Setup();
+    virtual void Start();
+
+protected:
+    bool RunProbeIndexBenchmark(unsigned numProbes);
+    bool RunBakeJobBenchmark(unsigned numProbes);
+    bool RunHelperThreadCheck();
+};
@@ -0,0 +1,620 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Math/Random.h>
+#include <Urho3D/Resource/JSONFile.h>
+
+#include "SHProjectionBenchmark.h"
+#include "AllocationCounter.h"
+#include "BakeJobPool.h"
+#include "SHTileProjector.h"
+#include "SHFaceDecoder.h"
+#include "SHTableEncoder.h"
+#include "SHProjectionKernel.h"
+#include "CubeTexelTable.h"
+#include "SHBasis.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <Urho3D/DebugNew.h>
+//=============================================================================
+//=============================================================================
+// bumped when a key of the json report changes meaning
+#define REPORT_VERSION      1
+
+// texels projected per timed case, unless -probes is given
+#define CASE_TEXEL_BUDGET   (24 * 1024 * 1024)
+#define MIN_CASE_PROBES     16
+#define MAX_CASE_PROBES     20000
+
+// probes in flight per pool thread, each has its own decoded planes
+#define PROBES_PER_THREAD   4
+
+// analytic checks: max abs coeff error relative to the expected L00. covers
+// the 8 bit quantization of the faces and the texel grid of the smallest face
+#define CHECK_TOLERANCE     0.005f
+
+static const int faceSizes[] = { 16, 32, 64, 128 };
+static const int shOrders[] = { SHOrder_L1, SHOrder_L2, SHOrder_L3 };
+
+// exactly representable in 8 bits, the constant environment projects without quantization error
+static const Vector3 CONSTANT_COLOR(51.0f / 255.0f, 102.0f / 255.0f, 153.0f / 255.0f);
+static const Vector3 LOBE_COLOR(1.0f, 0.6f, 0.2f);
+static const Vector3 LOBE_DIR = Vector3(0.3f, 0.8f, -0.5f).Normalized();
+
+// clamped cosine convolution per band, pi, 2pi/3, pi/4, 0
+static const float LOBE_BAND_SCALE[] = { M_PI, 2.0f * M_PI / 3.0f, M_PI / 4.0f, 0.0f };
+
+// the half float checks scale both environments past 1, as hdr captures are.
+// a power of two keeps the constant exact in half floats too
+static const float HDR_SCALE = 4.0f;
+
+//=============================================================================
+//=============================================================================
+URHO3D_DEFINE_APPLICATION_MAIN(SHProjectionBenchmark)
+
+//=============================================================================
+// a probe's cpu bake, decode then projection, as in LightProbe::RunJob()
+//=============================================================================
+class ProjectionJob : public BakeJob
+{
+public:
+    ProjectionJob()
+        : captured_(NULL), order_(SHOrder_L2), coeffs_(NULL), projector_(NULL)
+    {
+    }
+
+    virtual void RunJob(BakeJobPool *pool, unsigned threadIndex)
+    {
+        const CubeTexelTable *texelTable = CubeTexelTable::Get(captured_->faceSize_);
+        const unsigned texelsPerFace = texelTable->GetTexelsPerFace();
+
+        for ( unsigned face = 0; face < MAX_CUBEMAP_FACES; ++face )
+        {
+            const unsigned faceOffset = face * texelsPerFace;
+            SHFaceDecoder::DecodeFace(*captured_, (CubeMapFace)face, false, &planeR_[faceOffset], &planeG_[faceOffset], &planeB_[faceOffset]);
+        }
+
+        projector_ = new SHTileProjector(order_, texelTable, &planeR_[0], &planeG_[0], &planeB_[0]);
+        projector_->Submit(pool, threadIndex, coeffs_, this);
+    }
+
+    virtual void JobDone()
+    {
+        delete projector_;
+        projector_ = NULL;
+    }
+
+    const SHCubeFaces *captured_;
+    int order_;
+    Vector3 *coeffs_;
+    PODVector<float> planeR_;
+    PODVector<float> planeG_;
+    PODVector<float> planeB_;
+    SHTileProjector *projector_;
+};
+
+static void DecodeAndProject(const SHCubeFaces &faces, int order, Vector3 *coeffs)
+{
+    const CubeTexelTable *texelTable = CubeTexelTable::Get(faces.faceSize_);
+    const unsigned texelsPerFace = texelTable->GetTexelsPerFace();
+    PODVector<float> colR(texelsPerFace * MAX_CUBEMAP_FACES);
+    PODVector<float> colG(texelsPerFace * MAX_CUBEMAP_FACES);
+    PODVector<float> colB(texelsPerFace * MAX_CUBEMAP_FACES);
+
+    for ( unsigned face = 0; face < MAX_CUBEMAP_FACES; ++face )
+    {
+        const unsigned faceOffset = face * texelsPerFace;
+        SHFaceDecoder::DecodeFace(faces, (CubeMapFace)face, false, &colR[faceOffset], &colG[faceOffset], &colB[faceOffset]);
+    }
+
+    SHTileProjector projector(order, texelTable, &colR[0], &colG[0], &colB[0]);
+    projector.Run(1, coeffs);
+}
+
+static unsigned char ToUnorm8(float value)
+{
+    return (unsigned char)(Clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+static Vector3 GetEnvironmentColor(const Vector3 &dir, bool lobe)
+{
+    return lobe ? LOBE_COLOR * Max(dir.DotProduct(LOBE_DIR), 0.0f) : CONSTANT_COLOR;
+}
+
+// max abs coeff error against the analytic sh of the environment times scale,
+// relative to the expected L00. the constant only has L00, the lobe is the
+// clamped cosine's zonal harmonics rotated to its direction
+static float GetAnalyticError(const PODVector<Vector3> &coeffs, int order, bool lobe, float scale)
+{
+    const unsigned numCoeffs = SHNumCoeffs(order);
+
+    float basis[SHBasis<SHOrder_L3>::NumCoeffs];
+    SHBasis<SHOrder_L3>::Evaluate<SHKernel::ScalarOps>(LOBE_DIR.x_, LOBE_DIR.y_, LOBE_DIR.z_, basis);
+
+    PODVector<Vector3> expected(numCoeffs);
+    for ( unsigned i = 0; i < numCoeffs; ++i )
+    {
+        if (lobe)
+        {
+            const unsigned band = (unsigned)sqrtf((float)i);
+            expected[i] = LOBE_COLOR * (scale * LOBE_BAND_SCALE[band] * basis[i]);
+        }
+        else
+        {
+            expected[i] = i == 0 ? CONSTANT_COLOR * (scale * 4.0f * M_PI * SHConst::Y00) : Vector3::ZERO;
+        }
+    }
+
+    const float l00 = Max(Max(expected[0].x_, expected[0].y_), expected[0].z_);
+    float maxError = 0.0f;
+
+    for ( unsigned i = 0; i < numCoeffs; ++i )
+    {
+        const Vector3 diff = coeffs[i] - expected[i];
+        maxError = Max(maxError, Max(Max(Abs(diff.x_), Abs(diff.y_)), Abs(diff.z_)) / l00);
+    }
+
+    return maxError;
+}
+
+//=============================================================================
+//=============================================================================
+SHProjectionBenchmark::SHProjectionBenchmark(Context* context)
+    : Application(context)
+    , numProbes_(0)
+    , maxThreads_(GetNumLogicalCPUs())
+{
+}
+
+SHProjectionBenchmark::~SHProjectionBenchmark()
+{
+}
+
+void SHProjectionBenchmark::Setup()
+{
+    if (!ParseArguments())
+    {
+        PrintUsage();
+        ErrorExit("invalid arguments, see the usage printed to stderr");
+        return;
+    }
+
+    engineParameters_["Headless"]      = true;
+    engineParameters_["LogName"]       = GetSubsystem<FileSystem>()->GetProgramDir() + "shProjectionBenchmark.log";
+    engineParameters_["ResourcePaths"] = "CoreData;";
+}
+
+void SHProjectionBenchmark::Start()
+{
+    const char *kernelName = SHProjection::GetKernelName(SHProjection::GetKernelType());
+    JSONValue cases;
+    JSONValue checks;
+
+    PrintLine(ToString("sh projection: rgba8 decode + projection on BakeJobPool, %s kernel, %u logical cpus",
+                       kernelName, GetNumLogicalCPUs()));
+    PrintLine("     size  order  threads   probes    ns/probe   Mtexels/s  allocs/probe");
+
+    // 1, 2, 4 .. and the max thread count
+    PODVector<unsigned> threadCounts;
+    for ( unsigned numThreads = 1; numThreads < maxThreads_; numThreads *= 2 )
+    {
+        threadCounts.Push(numThreads);
+    }
+    threadCounts.Push(maxThreads_);
+
+    for ( unsigned i = 0; i < sizeof(faceSizes) / sizeof(faceSizes[0]); ++i )
+    {
+        for ( unsigned j = 0; j < sizeof(shOrders) / sizeof(shOrders[0]); ++j )
+        {
+            for ( unsigned k = 0; k < threadCounts.Size(); ++k )
+            {
+                JSONValue result;
+                RunProjectionCase(faceSizes[i], shOrders[j], threadCounts[k], result);
+                cases.Push(result);
+            }
+        }
+    }
+
+    static const SHKernelType kernels[] = { SHKernel_Scalar, SHKernel_SSE2, SHKernel_AVX2 };
+    unsigned numChecks = 0;
+    unsigned numFailed = 0;
+
+    for ( unsigned i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i )
+    {
+        if (!SHProjection::IsKernelSupported(kernels[i]))
+            continue;
+
+        for ( unsigned j = 0; j < sizeof(faceSizes) / sizeof(faceSizes[0]); ++j )
+        {
+            for ( unsigned k = 0; k < sizeof(shOrders) / sizeof(shOrders[0]); ++k )
+            {
+                for ( unsigned lobe = 0; lobe < 2; ++lobe )
+                {
+                    JSONValue result;
+                    if (!RunAnalyticCheck(kernels[i], faceSizes[j], shOrders[k], lobe != 0, result))
+                    {
+                        ++numFailed;
+                    }
+                    checks.Push(result);
+                    ++numChecks;
+                }
+            }
+        }
+    }
+    SHProjection::SetKernelType(SHKernel_Auto);
+
+    for ( unsigned j = 0; j < sizeof(faceSizes) / sizeof(faceSizes[0]); ++j )
+    {
+        for ( unsigned k = 0; k < sizeof(shOrders) / sizeof(shOrders[0]); ++k )
+        {
+            for ( unsigned lobe = 0; lobe < 2; ++lobe )
+            {
+                JSONValue result;
+                if (!RunHalfFloatCheck(faceSizes[j], shOrders[k], lobe != 0, result))
+                {
+                    ++numFailed;
+                }
+                checks.Push(result);
+                ++numChecks;
+            }
+        }
+    }
+
+    PrintLine("");
+    PrintLine(ToString("analytic checks: %u of %u passed, tolerance %g of L00", numChecks - numFailed, numChecks, CHECK_TOLERANCE));
+    const bool succeeded = numFailed == 0;
+
+    if (!WriteReport(cases, checks, succeeded))
+    {
+        ErrorExit("SHProjectionBenchmark: failed to write " + outputFilename_);
+    }
+    else if (!succeeded)
+    {
+        ErrorExit("SHProjectionBenchmark: projection differs from the analytic sh");
+    }
+    else
+    {
+        engine_->Exit();
+    }
+}
+
+bool SHProjectionBenchmark::ParseArguments()
+{
+    const Vector<String> &arguments = GetArguments();
+    FileSystem *fileSystem = GetSubsystem<FileSystem>();
+
+    for ( unsigned i = 0; i < arguments.Size(); ++i )
+    {
+        // accept -option and --option, engine options such as -log pass through
+        String option = arguments[i];
+        while (option.StartsWith("-"))
+        {
+            option = option.Substring(1);
+        }
+        option = option.ToLower();
+
+        const bool hasValue = i + 1 < arguments.Size();
+        const String value = hasValue ? arguments[i + 1] : String::EMPTY;
+
+        if (option == "help" || option == "h")
+        {
+            return false;
+        }
+        else if (option == "output" || option == "probes" || option == "threads")
+        {
+            if (!hasValue)
+            {
+                PrintLine("missing value for -" + option, true);
+                return false;
+            }
+            ++i;
+
+            if (option == "output")
+            {
+                outputFilename_ = IsAbsolutePath(value) ? value : fileSystem->GetCurrentDir() + value;
+            }
+            else if (option == "probes")
+            {
+                numProbes_ = ToUInt(value);
+            }
+            else if (option == "threads")
+            {
+                maxThreads_ = Max(ToUInt(value), 1u);
+            }
+        }
+    }
+
+    if (outputFilename_.Empty())
+    {
+        outputFilename_ = fileSystem->GetProgramDir() + "shProjectionBenchmark.json";
+    }
+
+    return true;
+}
+
+void SHProjectionBenchmark::PrintUsage() const
+{
+    PrintLine("usage: 80_SHProjectionBenchmark [options]\n"
+              "  -output <file.json>  report (default: shProjectionBenchmark.json next to the executable)\n"
+              "  -probes <n>          probes per timed case (default: about 24M texels worth)\n"
+              "  -threads <n>         max pool threads, 1, 2, 4 .. up to it are timed (default: logical cpus)", true);
+}
+
+void SHProjectionBenchmark::RunProjectionCase(int faceSize, int order, unsigned numThreads, JSONValue &result)
+{
+    const unsigned numCoeffs = SHNumCoeffs(order);
+    const unsigned numTexels = (unsigned)(faceSize * faceSize) * MAX_CUBEMAP_FACES;
+    const unsigned numProbes = numProbes_ ? numProbes_ : Clamp(CASE_TEXEL_BUDGET / numTexels, (unsigned)MIN_CASE_PROBES, (unsigned)MAX_CASE_PROBES);
+
+    // one random capture shared by every probe, the cost doesn't depend on the colors
+    SHCubeFaces captured;
+    captured.Allocate(faceSize, SHFace_RGBA8);
+    SetRandomSeed(faceSize);
+
+    for ( unsigned face = 0; face < MAX_CUBEMAP_FACES; ++face )
+    {
+        for ( unsigned i = 0; i < captured.data_[face].Size(); ++i )
+        {
+            captured.data_[face][i] = (unsigned char)Random(256);
+        }
+    }
+
+    // the pool's threads are started before the clock, as in LightProbeCreator
+    SharedPtr<BakeJobPool> pool(new BakeJobPool(numThreads));
+    const unsigned numSlots = numThreads * PROBES_PER_THREAD;
+    Vector<ProjectionJob> jobs(numSlots);
+    PODVector<Vector3> coeffs(numSlots * numCoeffs);
+
+    for ( unsigned i = 0; i < numSlots; ++i )
+    {
+        jobs[i].captured_ = &captured;
+        jobs[i].order_ = order;
+        jobs[i].coeffs_ = &coeffs[i * numCoeffs];
+        jobs[i].planeR_.Resize(numTexels);
+        jobs[i].planeG_.Resize(numTexels);
+        jobs[i].planeB_.Resize(numTexels);
+    }
+
+    // the first batch builds the texel table and wakes the threads, it isn't timed
+    HiresTimer timer;
+    unsigned long long numAllocations = 0;
+
+    for ( unsigned pass = 0; pass < 2; ++pass )
+    {
+        const unsigned passProbes = pass ? numProbes : numSlots;
+
+        timer.Reset();
+        numAllocations = AllocationCounter::GetNumAllocations();
+
+        for ( unsigned numDone = 0; numDone < passProbes; )
+        {
+            const unsigned batchSize = Min(numSlots, passProbes - numDone);
+
+            for ( unsigned i = 0; i < batchSize; ++i )
+            {
+                memset(jobs[i].coeffs_, 0, numCoeffs * sizeof(Vector3));
+                pool->Submit(&jobs[i]);
+            }
+
+            pool->WaitIdle();
+            numDone += pool->ProcessCompleted();
+        }
+    }
+
+    const long long wallUSec = timer.GetUSec(false);
+    numAllocations = AllocationCounter::GetNumAllocations() - numAllocations;
+
+    const double nsPerProbe = (double)wallUSec * 1000.0 / numProbes;
+    const double texelsPerSec = wallUSec ? (double)numTexels * numProbes * 1000000.0 / wallUSec : 0.0;
+    const double allocsPerProbe = (double)numAllocations / numProbes;
+
+    char line[256];
+    sprintf(line, "%9d %6d %8u %8u %11.0f %11.1f %13.2f", faceSize, order, numThreads, numProbes, nsPerProbe,
+            texelsPerSec / 1000000.0, allocsPerProbe);
+    PrintLine(line);
+
+    result["faceSize"]       = faceSize;
+    result["order"]          = order;
+    result["threads"]        = numThreads;
+    result["probes"]         = numProbes;
+    result["wallMSec"]       = (double)wallUSec / 1000.0;
+    result["nsPerProbe"]     = nsPerProbe;
+    result["texelsPerSec"]   = texelsPerSec;
+    result["allocsPerProbe"] = allocsPerProbe;
+}
+
+bool SHProjectionBenchmark::RunAnalyticCheck(SHKernelType kernel, int faceSize, int order, bool lobe, JSONValue &result)
+{
+    const unsigned numCoeffs = SHNumCoeffs(order);
+    const CubeTexelTable *texelTable = CubeTexelTable::Get(faceSize);
+
+    // the environment, captured into rgba8 faces
+    SHCubeFaces captured;
+    captured.Allocate(faceSize, SHFace_RGBA8);
+
+    for ( unsigned face = 0; face < MAX_CUBEMAP_FACES; ++face )
+    {
+        unsigned char *data = &captured.data_[face][0];
+
+        for ( int y = 0; y < faceSize; ++y )
+        {
+            for ( int x = 0; x < faceSize; ++x, data += 4 )
+            {
+                const Vector3 color = GetEnvironmentColor(texelTable->GetDirection((CubeMapFace)face, x, y), lobe);
+
+                data[0] = ToUnorm8(color.x_);
+                data[1] = ToUnorm8(color.y_);
+                data[2] = ToUnorm8(color.z_);
+                data[3] = 255;
+            }
+        }
+    }
+
+    SHProjection::SetKernelType(kernel);
+
+    PODVector<Vector3> coeffs(numCoeffs);
+    memset(&coeffs[0], 0, numCoeffs * sizeof(Vector3));
+    DecodeAndProject(captured, order, &coeffs[0]);
+
+    const float maxError = GetAnalyticError(coeffs, order, lobe, 1.0f);
+    const bool passed = maxError <= CHECK_TOLERANCE;
+    const char *environment = lobe ? "lobe" : "constant";
+
+    if (!passed)
+    {
+        PrintLine(ToString("  %s kernel, %d face, L%d, %s environment: max error %g of L00",
+                           SHProjection::GetKernelName(kernel), faceSize, order, environment, maxError), true);
+    }
+
+    result["kernel"]      = SHProjection::GetKernelName(kernel);
+    result["format"]      = "rgba8";
+    result["faceSize"]    = faceSize;
+    result["order"]       = order;
+    result["environment"] = environment;
+    result["maxError"]    = maxError;
+    result["tolerance"]   = CHECK_TOLERANCE;
+    result["passed"]      = passed;
+
+    return passed;
+}
+
+bool SHProjectionBenchmark::RunHalfFloatCheck(int faceSize, int order, bool lobe, JSONValue &result)
+{
+    const unsigned numCoeffs = SHNumCoeffs(order);
+    const CubeTexelTable *texelTable = CubeTexelTable::Get(faceSize);
+    const unsigned texelsPerFace = texelTable->GetTexelsPerFace();
+
+    // the environment past 1, captured into rgba16f faces
+    SHCubeFaces captured;
+    captured.Allocate(faceSize, SHFace_RGBA16F);
+
+    for ( unsigned face = 0; face < MAX_CUBEMAP_FACES; ++face )
+    {
+        unsigned short *data = reinterpret_cast<unsigned short*>(&captured.data_[face][0]);
+
+        for ( int y = 0; y < faceSize; ++y )
+        {
+            for ( int x = 0; x < faceSize; ++x, data += 4 )
+            {
+                const Vector3 color = GetEnvironmentColor(texelTable->GetDirection((CubeMapFace)face, x, y), lobe) * HDR_SCALE;
+
+                data[0] = SHTableEncoder::FloatToHalf(color.x_);
+                data[1] = SHTableEncoder::FloatToHalf(color.y_);
+                data[2] = SHTableEncoder::FloatToHalf(color.z_);
+                data[3] = SHTableEncoder::FloatToHalf(1.0f);
+            }
+        }
+    }
+
+    // the decode LightProbe uses, f16c when the cpu has it, against the
+    // scalar fallback. both are exact, so they must agree to the bit
+    PODVector<float> planes[3];
+    PODVector<float> scalarPlanes[3];
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        planes[i].Resize(texelsPerFace * MAX_CUBEMAP_FACES);
+        scalarPlanes[i].Resize(texelsPerFace * MAX_CUBEMAP_FACES);
+    }
+
+    for ( unsigned face = 0; face < MAX_CUBEMAP_FACES; ++face )
+    {
+        const unsigned faceOffset = face * texelsPerFace;
+        const unsigned short *data = reinterpret_cast<const unsigned short*>(&captured.data_[face][0]);
+
+        SHFaceDecoder::DecodeRGBA16F(data, texelsPerFace, &planes[0][faceOffset], &planes[1][faceOffset], &planes[2][faceOffset]);
+        SHFaceDecoder::DecodeRGBA16FScalar(data, texelsPerFace, &scalarPlanes[0][faceOffset], &scalarPlanes[1][faceOffset],
+                                           &scalarPlanes[2][faceOffset]);
+    }
+
+    unsigned numMismatches = 0;
+    for ( unsigned i = 0; i < 3; ++i )
+    {
+        if (memcmp(&planes[i][0], &scalarPlanes[i][0], planes[i].Size() * sizeof(float)) != 0)
+        {
+            ++numMismatches;
+        }
+    }
+
+    SHProjection::SetKernelType(SHKernel_Auto);
+
+    PODVector<Vector3> coeffs(numCoeffs);
+    memset(&coeffs[0], 0, numCoeffs * sizeof(Vector3));
+    SHTileProjector projector(order, texelTable, &planes[0][0], &planes[1][0], &planes[2][0]);
+    projector.Run(1, &coeffs[0]);
+
+    const float maxError = GetAnalyticError(coeffs, order, lobe, HDR_SCALE);
+    const bool passed = maxError <= CHECK_TOLERANCE && numMismatches == 0;
+    const char *decoder = SHFaceDecoder::IsF16CSupported() ? "f16c" : "scalar";
+    const char *environment = lobe ? "lobe" : "constant";
+
+    if (!passed)
+    {
+        PrintLine(ToString("  rgba16f %s decode, %d face, L%d, %s environment x%g: max error %g of L00%s",
+                           decoder, faceSize, order, environment, HDR_SCALE, maxError,
+                           numMismatches ? ", differs from the scalar decode" : ""), true);
+    }
+
+    result["kernel"]      = SHProjection::GetKernelName(SHProjection::GetKernelType());
+    result["format"]      = "rgba16f";
+    result["decoder"]     = decoder;
+    result["faceSize"]    = faceSize;
+    result["order"]       = order;
+    result["environment"] = environment;
+    result["scale"]       = HDR_SCALE;
+    result["maxError"]    = maxError;
+    result["decodeMatch"] = numMismatches == 0;
+    result["tolerance"]   = CHECK_TOLERANCE;
+    result["passed"]      = passed;
+
+    return passed;
+}
+
+bool SHProjectionBenchmark::WriteReport(const JSONValue &cases, const JSONValue &checks, bool succeeded)
+{
+    SharedPtr<JSONFile> json(new JSONFile(context_));
+    JSONValue &root = json->GetRoot();
+    root["benchmark"]   = "SHProjectionBenchmark";
+    root["version"]     = REPORT_VERSION;
+    root["kernel"]      = SHProjection::GetKernelName(SHProjection::GetKernelType());
+    root["logicalCpus"] = GetNumLogicalCPUs();
+    root["succeeded"]   = succeeded;
+    root["cases"]       = cases;
+    root["checks"]      = checks;
+
+    File file(context_, outputFilename_, FILE_WRITE);
+    if (!file.IsOpen() || !json->Save(file))
+    {
+        return false;
+    }
+
+    PrintLine("report: " + outputFilename_);
+
+    return true;
+}
@@ -0,0 +1,74 @@
+//
+// Copyright (c) 2008-2017 the Urho3D project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+#include <Urho3D/Engine/Application.h>
+
+#include "SHProjection.h"
+
+using namespace Urho3D;
+namespace Urho3D
+{
+class JSONValue;
+}
+
+struct SHCubeFaces;
+
+//=============================================================================
+// headless benchmark of the probe bake's cpu half: decoding captured rgba8
+// cube faces and projecting them to sh on BakeJobPool, the way LightProbe
+// does it. every face size, sh order and thread count is timed on synthetic
+// faces, and the projection is checked against the analytic sh of a constant
+// and a clamped cosine environment for every kernel the cpu supports. the
+// same environments, brighter than 1, are also checked through RGBA16F faces
+// decoded with f16c and with the scalar fallback.
+//
+// results go to stdout and to a json report with fixed keys, so runs can be
+// compared. exits non-zero if a check fails.
+//
+// usage: 80_SHProjectionBenchmark [-output <file.json>] [-probes <n>] [-threads <n>]
+//=============================================================================
+class SHProjectionBenchmark : public Application
+{
+    URHO3D_OBJECT(SHProjectionBenchmark, Application);
+
+public:
+    SHProjectionBenchmark(Context* context);
+    ~SHProjectionBenchmark();
+
+    virtual void Setup();
+    virtual void Start();
+
+protected:
+    bool ParseArguments();
+    void PrintUsage() const;
+    void RunProjectionCase(int faceSize, int order, unsigned numThreads, JSONValue &result);
+    bool RunAnalyticCheck(SHKernelType kernel, int faceSize, int order, bool lobe, JSONValue &result);
+    bool RunHalfFloatCheck(int faceSize, int order, bool lobe, JSONValue &result);
+    bool WriteReport(const JSONValue &cases, const JSONValue &checks, bool succeeded);
+
+protected:
+    String outputFilename_;
+    unsigned numProbes_;
+    unsigned maxThreads_;
+};
@@ -24,20 +24,60 @@
 #pragma once
 
 #include "../Core/Thread.h"
-#include "../Core/Mutex.h"
+#include "../Core/Timer.h"
 #include "../Container/RefCounted.h"
+#include "../Math/MathDefs.h"
+
+#include <condition_variable>
+#include <mutex>
 
 namespace Urho3D
 {
 
-template<class T>
+//=============================================================================
+// how often a HelperThread calls its ProcessFn
+//=============================================================================
+enum HelperThreadMode
+{
+    // once, then the thread exits (looping=false)
+    HelperThread_Once,
+    // over and over with a Sleep(0) in between until stopped (looping=true)
+    HelperThread_Continuous,
+    // on Start() and after each Wake(), sleeping in between
+    HelperThread_OnWake,
+};
+
+//=============================================================================
+// worker thread calling back into its parent.
+//
+// the looping flag keeps its meaning: true is HelperThread_Continuous, the
+// polling loop existing users rely on. a worker that only has work when told
+// so passes HelperThread_OnWake instead and calls Wake(), it never polls.
+//
+// the looping modes also run calls queued with Post() in order, between the
+// ProcessFn calls, until RequestStop(). the destructor requests a stop and
+// joins, a call already running finishes first, queued calls that haven't
+// started are dropped.
+//
+// **note** Urho's Condition keeps no state on posix, a Set() before the
+// Wait() is lost. the waits here recheck their state under the same lock
+// through std::condition_variable instead
+//=============================================================================
+template<class T, unsigned QueueSize = 64>
 class HelperThread : public Thread, public RefCounted
 {
 public:
     typedef void (T::*ProcessFn)(void *);
 
     HelperThread(T *parent, ProcessFn pFn, bool looping=true, int priority=M_MAX_INT) 
-        : parent_(parent), processFn_(pFn), looping_(looping), priority_(priority), fnExited_(true)
+        : parent_(parent), processFn_(pFn), priority_(priority), mode_(looping ? HelperThread_Continuous : HelperThread_Once)
+        , fnExited_(true), stopRequested_(false), queueHead_(0), queueCount_(0), wakePending_(false)
+    {
+    }
+
+    HelperThread(T *parent, ProcessFn pFn, HelperThreadMode mode, int priority=M_MAX_INT) 
+        : parent_(parent), processFn_(pFn), priority_(priority), mode_(mode)
+        , fnExited_(true), stopRequested_(false), queueHead_(0), queueCount_(0), wakePending_(false)
     {
     }
 
@@ -48,74 +88,201 @@ public:
 
     void Start()
     {
-        Run();
+        // counts as started before the thread runs, so a join right after
+        // doesn't miss it
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            fnExited_ = false;
+            stopRequested_ = false;
+            wakePending_ = processFn_ != NULL;
+        }
+
+        if (!Run())
+        {
+            SetFnExit(true);
+            return;
+        }
         SetPriority(priority_);
     }
 
     virtual void ThreadFunction()
     {
-        SetFnExit(false);
-
-        while (true)
+        if (mode_ == HelperThread_Once)
+        {
+            if (processFn_)
+            {
+                (parent_->*processFn_)(parent_);
+            }
+        }
+        else
         {
-            // process callback
-            (parent_->*processFn_)(parent_);
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            while (!stopRequested_)
+            {
+                ProcessFn fn = NULL;
+                void *data = NULL;
+                bool yield = false;
 
-            if (!IsLooping())
-                break;
+                if (queueCount_)
+                {
+                    fn = queue_[queueHead_].fn_;
+                    data = queue_[queueHead_].data_;
+                    queueHead_ = (queueHead_ + 1) % QueueSize;
+                    --queueCount_;
+                    spaceCond_.notify_one();
+                }
+                else if (wakePending_)
+                {
+                    // a continuous thread stays pending
+                    fn = processFn_;
+                    data = parent_;
+                    wakePending_ = mode_ == HelperThread_Continuous;
+                    yield = mode_ == HelperThread_Continuous;
+                }
+                else
+                {
+                    wakeCond_.wait(lock);
+                    continue;
+                }
 
-            Time::Sleep(0);
+                lock.unlock();
+                (parent_->*fn)(data);
+
+                if (yield)
+                {
+                    Time::Sleep(0);
+                }
+                lock.lock();
+            }
         }
 
         SetFnExit(true);
     }
 
+    // another ProcessFn call on an OnWake thread, wakes it if idle. wakes
+    // that come in before the pending one runs are merged into it
+    void Wake()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wakePending_ = processFn_ != NULL;
+        wakeCond_.notify_one();
+    }
+
+    // queues fn(data) on a looping thread from any thread, false when the
+    // queue is full or the thread is stopping
+    bool TryPost(ProcessFn fn, void *data)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (queueCount_ == QueueSize || mode_ == HelperThread_Once || stopRequested_)
+            return false;
+
+        Push(fn, data);
+        return true;
+    }
+
+    // as TryPost(), but waits for room while the queue is full
+    bool Post(ProcessFn fn, void *data)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        while (queueCount_ == QueueSize && mode_ != HelperThread_Once && !stopRequested_)
+        {
+            spaceCond_.wait(lock);
+        }
+
+        if (mode_ == HelperThread_Once || stopRequested_)
+            return false;
+
+        Push(fn, data);
+        return true;
+    }
+
+    unsigned GetNumQueued()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queueCount_;
+    }
+
+    // stop token, ProcessFn can check it to bail out of long work
+    bool IsStopRequested()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stopRequested_;
+    }
+
+    void RequestStop()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopRequested_ = true;
+        wakeCond_.notify_all();
+        spaceCond_.notify_all();
+    }
+
+    // blocks until the thread has exited
+    void Join()
+    {
+        Stop();
+    }
+
     bool HasFnExited()
     {
-        MutexLock lock(mutexLock_);
+        std::lock_guard<std::mutex> lock(mutex_);
         return fnExited_;
     }
 
 protected:
-    void WaitExit()
+    struct QueueItem
     {
-        SetLooping(false);
+        ProcessFn fn_;
+        void *data_;
+    };
 
-        do 
-        { 
-            Time::Sleep(1); 
-        }
-        while (!HasFnExited());
+    // with mutex_ held and room in the queue
+    void Push(ProcessFn fn, void *data)
+    {
+        QueueItem &item = queue_[(queueHead_ + queueCount_) % QueueSize];
+        item.fn_ = fn;
+        item.data_ = data;
+        ++queueCount_;
+        wakeCond_.notify_one();
     }
 
-    void SetLooping(bool bset)
+    void WaitExit()
     {
-        MutexLock lock(mutexLock_);
-        looping_ = bset;
+        RequestStop();
+        Join();
     }
 
-    bool IsLooping()
+    bool IsLooping() const
     {
-        MutexLock lock(mutexLock_);
-        return looping_;
+        return mode_ != HelperThread_Once;
     }
 
     void SetFnExit(bool bset)
     {
-        MutexLock lock(mutexLock_);
+        std::lock_guard<std::mutex> lock(mutex_);
         fnExited_ = bset;
     }
 
 protected:
     T           *parent_;
     ProcessFn   processFn_;
-    Mutex       mutexLock_;
+    std::mutex  mutex_;
     int         priority_;
 
-    bool        looping_;
+    HelperThreadMode mode_;
     bool        fnExited_;
+    bool        stopRequested_;
+
+    // looping thread
+    std::condition_variable wakeCond_;
+    std::condition_variable spaceCond_;
+    QueueItem   queue_[QueueSize];
+    unsigned    queueHead_;
+    unsigned    queueCount_;
+    bool        wakePending_;
 };
 
 }
-
-
@@ -7,6 +7,60 @@ uniform float cMinProbeDistance;
 uniform float cSHIntensity;
 uniform float cTextureSize;
 
+// SH_TETRA: table slots and barycentric weights of the probes at the corners
+// of the tetrahedron around the object, see ProbeTetraMesh
+uniform vec4 cProbeIndices;
+uniform vec4 cProbeWeights;
+
+// SH_VOLUME: maps world positions to volume texel units, grid point i sits at
+// i + 0.5. size is the grid points per axis in xyz and the slabs in w, see
+// SHIrradianceVolume
+uniform vec3 cSHVolumeScale;
+uniform vec3 cSHVolumeOffset;
+uniform vec4 cSHVolumeSize;
+
+// the volume and the uniforms keep the coeffs irradiance needs, their rgb
+// triples flattened four scalars per vec4
+#ifdef SH_L1
+    #define SH_PACKED_COEFFS 4
+#else
+    #define SH_PACKED_COEFFS 9
+#endif
+#define SH_PACKED_VEC4S ((SH_PACKED_COEFFS*3 + 3)/4)
+#define SH_PACKED_SCALAR(v, k) SelectChannel(v[(k)/4], (k) - ((k)/4)*4)
+
+// SH_UNIFORMS: the object's irradiance coeffs decoded, and blended under
+// SH_TETRA, on the cpu. packed like the volume slabs, see
+// ProbeLighting::ApplyEntry()
+uniform vec4 cSHCoeffs[SH_PACKED_VEC4S];
+
+// probe GetSH() reads
+float shProbeIndex;
+
+// sh table layout, set from the <shprobe> order written by LightProbeCreator
+#if defined(SH_L1)
+    #define SH_NUM_COEFFS 4
+#elif defined(SH_L3)
+    #define SH_NUM_COEFFS 16
+#else
+    #define SH_NUM_COEFFS 9
+#endif
+
+// texels per probe for the table encoding, see SHTableEncoder
+#if defined(SH_ENC_RGBA16F)
+    #define SH_PROBE_TEXELS ((SH_NUM_COEFFS*3 + 1)/2)
+#elif defined(SH_ENC_SCALEBIAS)
+    #define SH_PROBE_TEXELS (1 + (SH_NUM_COEFFS*3 + 3)/4)
+#else
+    #define SH_PROBE_TEXELS SH_NUM_COEFFS
+#endif
+#define SH_RGB9E5_EXP_BIAS 20.0
+
+// no 3d textures on gles2
+#if defined(SH_VOLUME) && defined(GL_ES)
+    #undef SH_VOLUME
+#endif
+
 #line 1000
 //=============================================================================
 // Based on: An Efficient Representation for Irradiance Environment Maps.  
@@ -53,20 +107,141 @@ vec3 IrradCoeffs(vec3 L00, vec3 L1_1, vec3 L10, vec3 L11,
 	return col;
 }
 
-vec3 GetSH(int i)
+// L1 only has the constant and linear terms of equation 13
+vec3 IrradCoeffsL1(vec3 L00, vec3 L1_1, vec3 L10, vec3 L11, vec3 n)
+{
+	const float c2 = 0.511664 ;
+	const float c4 = 0.886227 ;
+
+	return c4*L00 + 2*c2*(L11*n.x + L1_1*n.y + L10*n.z) ;
+}
+
+// table texel t of the current probe
+vec4 GetSHTexel(int t)
 {
     #ifdef GL_ES
-    vec3 sh = texture2D(sEnvMap, vec2(float(cProbeIndex*9 + i), 0)/cTextureSize).xyz;
+    return texture2D(sEnvMap, vec2((shProbeIndex*float(SH_PROBE_TEXELS) + float(t) + 0.5)/cTextureSize, 0.5));
     #else
-    vec3 sh = texelFetch(sEnvMap, ivec2(cProbeIndex*9 + i, 0), 0).xyz;
+    return texelFetch(sEnvMap, ivec2(int(shProbeIndex)*SH_PROBE_TEXELS + t, 0), 0);
     #endif
-    sh = (sh - vec3(0.5, 0.5, 0.5)) * 10.0f;
+}
+
+// raw byte values of a texel, used by the packed encodings
+vec4 GetSHBytes(int t)
+{
+    return floor(GetSHTexel(t) * 255.0 + 0.5);
+}
+
+float SelectChannel(vec4 v, int c)
+{
+    return dot(v, vec4(float(c == 0), float(c == 1), float(c == 2), float(c == 3)));
+}
+
+// half float from its low and high byte, inf/nan are never written
+float HalfToFloat(float lo, float hi)
+{
+    float e = mod(floor(hi / 4.0), 32.0);
+    float m = mod(hi, 4.0) * 256.0 + lo;
+    float mag = (e == 0.0) ? m * exp2(-24.0) : (1.0 + m / 1024.0) * exp2(e - 15.0);
+    return (hi >= 128.0) ? -mag : mag;
+}
+
+#if defined(SH_ENC_RGBA16F)
+// scalar k, two halves per texel
+float GetSHScalar(int k)
+{
+    int t = k / 2;
+    vec4 b = GetSHBytes(t);
+    return (k == t * 2) ? HalfToFloat(b.r, b.g) : HalfToFloat(b.b, b.a);
+}
+
+vec3 GetSH(int i)
+{
+    return vec3(GetSHScalar(i*3), GetSHScalar(i*3 + 1), GetSHScalar(i*3 + 2));
+}
+#elif defined(SH_ENC_RGB9E5)
+vec3 GetSH(int i)
+{
+    // rgb magnitudes, a = sign bits << 5 | shared exponent
+    vec4 b = GetSHBytes(i);
+    float signs = floor(b.a / 32.0);
+    vec3 neg = vec3(mod(signs, 2.0), mod(floor(signs / 2.0), 2.0), floor(signs / 4.0));
+    return b.rgb * (vec3(1.0, 1.0, 1.0) - 2.0 * neg) * exp2(mod(b.a, 32.0) - SH_RGB9E5_EXP_BIAS);
+}
+#elif defined(SH_ENC_SCALEBIAS)
+// scalar k, texel 0 holds the probe's half float scale and bias
+float GetSHScalar(int k, vec2 scaleBias)
+{
+    int t = k / 4;
+    return SelectChannel(GetSHTexel(1 + t), k - t * 4) * scaleBias.x + scaleBias.y;
+}
+
+vec3 GetSH(int i)
+{
+    vec4 b = GetSHBytes(0);
+    vec2 scaleBias = vec2(HalfToFloat(b.r, b.g), HalfToFloat(b.b, b.a));
+    return vec3(GetSHScalar(i*3, scaleBias), GetSHScalar(i*3 + 1, scaleBias), GetSHScalar(i*3 + 2, scaleBias));
+}
+#else
+vec3 GetSH(int i)
+{
+    vec3 sh = GetSHTexel(i).xyz;
+    sh = (sh - vec3(0.5, 0.5, 0.5)) * 10.0;
     return sh;
 }
+#endif
+
+#ifdef SH_VOLUME
+vec4 shVolumeSlabs[SH_PACKED_VEC4S];
+
+// reads every slab of the grid cell around worldPos once per pixel. x is
+// clamped to the slab's outer texel centers, so filtering stays inside it
+void FetchSHVolume(vec3 worldPos)
+{
+    vec3 f = clamp(worldPos * cSHVolumeScale + cSHVolumeOffset, vec3(0.5, 0.5, 0.5), cSHVolumeSize.xyz - vec3(0.5, 0.5, 0.5));
+    vec3 uvw = vec3(f.x / (cSHVolumeSize.x * cSHVolumeSize.w), f.y / cSHVolumeSize.y, f.z / cSHVolumeSize.z);
+
+    for (int s = 0; s < SH_PACKED_VEC4S; ++s)
+    {
+        shVolumeSlabs[s] = texture3D(sVolumeMap, uvw);
+        uvw.x += 1.0 / cSHVolumeSize.w;
+    }
+}
+#endif
+
+// coeff i of the object's probe, its tetrahedron's probes blended, the
+// volume around the pixel or the coeffs the cpu uploaded
+vec3 GetProbeSH(int i)
+{
+#if defined(SH_VOLUME)
+    return vec3(SH_PACKED_SCALAR(shVolumeSlabs, i*3), SH_PACKED_SCALAR(shVolumeSlabs, i*3 + 1), SH_PACKED_SCALAR(shVolumeSlabs, i*3 + 2));
+#elif defined(SH_UNIFORMS)
+    return vec3(SH_PACKED_SCALAR(cSHCoeffs, i*3), SH_PACKED_SCALAR(cSHCoeffs, i*3 + 1), SH_PACKED_SCALAR(cSHCoeffs, i*3 + 2));
+#elif defined(SH_TETRA)
+    vec3 sh = vec3(0.0, 0.0, 0.0);
+    for (int j = 0; j < 4; ++j)
+    {
+        shProbeIndex = cProbeIndices[j];
+        sh += GetSH(i) * cProbeWeights[j];
+    }
+    return sh;
+#else
+    shProbeIndex = cProbeIndex;
+    return GetSH(i);
+#endif
+}
 
 #line 2000
 vec3 SHDiffuse(vec3 normal, vec3 worldPos)
 {
+#if defined(SH_VOLUME)
+    // the volume is already interpolated between probes, no falloff
+    FetchSHVolume(worldPos);
+    float scale = cSHIntensity;
+#elif defined(SH_TETRA)
+    // the weights sum to one and blend smoothly between probes, no falloff
+    float scale = cSHIntensity;
+#else
     // world pos
     float dist = max(0.75, length(cProbePosition - worldPos));
     const float falloffDist = 1.5;
@@ -82,15 +257,29 @@ vec3 SHDiffuse(vec3 normal, vec3 worldPos)
         dist = cMinProbeDistance + pow(0.5 + (dist - cMinProbeDistance), 4);
     }
 
-    // read sh
+    // linear decay 
+    float scale = cSHIntensity/dist;
+#endif
+
+#ifdef SH_L1
+    vec3 sh[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        sh[i] = GetProbeSH(i);
+    }
+
+    return IrradCoeffsL1(sh[0], sh[1], sh[2], sh[3], normal) * scale;
+#else
+    // read sh, band 3 of the clamped cosine is zero so L3 tables
+    // only need their first 9 coeffs for irradiance
     vec3 sh[9];
     for (int i = 0; i < 9; ++i)
     {
-        sh[i] = GetSH(i);
+        sh[i] = GetProbeSH(i);
     }
 
-    // linear decay 
-    return IrradCoeffs(sh[0], sh[1], sh[2], sh[3], sh[4], sh[5], sh[6], sh[7], sh[8], normal) * cSHIntensity/dist;
+    return IrradCoeffs(sh[0], sh[1], sh[2], sh[3], sh[4], sh[5], sh[6], sh[7], sh[8], normal) * scale;
+#endif
 }
 
 #endif //COMPILEPS
@@ -7,6 +7,63 @@ uniform float cMinProbeDistance;
 uniform float cSHIntensity;
 uniform float cTextureSize;
 
+// SH_TETRA: table slots and barycentric weights of the probes at the corners
+// of the tetrahedron around the object, see ProbeTetraMesh
+uniform float4 cProbeIndices;
+uniform float4 cProbeWeights;
+
+// SH_VOLUME: maps world positions to volume texel units, grid point i sits at
+// i + 0.5. size is the grid points per axis in xyz and the slabs in w, see
+// SHIrradianceVolume
+uniform float3 cSHVolumeScale;
+uniform float3 cSHVolumeOffset;
+uniform float4 cSHVolumeSize;
+
+// the volume and the uniforms keep the coeffs irradiance needs, their rgb
+// triples flattened four scalars per vec4
+#ifdef SH_L1
+    #define SH_PACKED_COEFFS 4
+#else
+    #define SH_PACKED_COEFFS 9
+#endif
+#define SH_PACKED_VEC4S ((SH_PACKED_COEFFS*3 + 3)/4)
+#define SH_PACKED_SCALAR(v, k) SelectChannel(v[(k)/4], (k) - ((k)/4)*4)
+
+// SH_UNIFORMS: the object's irradiance coeffs decoded, and blended under
+// SH_TETRA, on the cpu. packed like the volume slabs, see
+// ProbeLighting::ApplyEntry()
+uniform float4 cSHCoeffs[SH_PACKED_VEC4S];
+
+// probe GetSH() reads
+static float shProbeIndex;
+
+// sh table layout, set from the <shprobe> order written by LightProbeCreator
+#if defined(SH_L1)
+    #define SH_NUM_COEFFS 4
+#elif defined(SH_L3)
+    #define SH_NUM_COEFFS 16
+#else
+    #define SH_NUM_COEFFS 9
+#endif
+
+// texels per probe for the table encoding, see SHTableEncoder
+#if defined(SH_ENC_RGBA16F)
+    #define SH_PROBE_TEXELS ((SH_NUM_COEFFS*3 + 1)/2)
+#elif defined(SH_ENC_SCALEBIAS)
+    #define SH_PROBE_TEXELS (1 + (SH_NUM_COEFFS*3 + 3)/4)
+#else
+    #define SH_PROBE_TEXELS SH_NUM_COEFFS
+#endif
+#define SH_RGB9E5_EXP_BIAS 20.0
+
+#ifndef Sample3D
+    #ifdef D3D11
+        #define Sample3D(tex, uvw) t##tex.Sample(s##tex, uvw)
+    #else
+        #define Sample3D(tex, uvw) tex3D(s##tex, uvw)
+    #endif
+#endif
+
 #line 1000
 //=============================================================================
 // Based on: An Efficient Representation for Irradiance Environment Maps.  
@@ -53,18 +110,141 @@ float3 IrradCoeffs(float3 L00, float3 L1_1, float3 L10, float3 L11,
 	return col;
 }
 
+// L1 only has the constant and linear terms of equation 13
+float3 IrradCoeffsL1(float3 L00, float3 L1_1, float3 L10, float3 L11, float3 n)
+{
+	const float c2 = 0.511664 ;
+	const float c4 = 0.886227 ;
+
+	return c4*L00 + 2*c2*(L11*n.x + L1_1*n.y + L10*n.z) ;
+}
+
+// table texel t of the current probe
+float4 GetSHTexel(int t)
+{
+    float2 tex2 = float2((shProbeIndex*SH_PROBE_TEXELS + t + 0.5)/cTextureSize, 0.5);
+    return Sample2D(EnvMap, tex2);
+}
+
+// raw byte values of a texel, used by the packed encodings
+float4 GetSHBytes(int t)
+{
+    return floor(GetSHTexel(t) * 255.0 + 0.5);
+}
+
+float SelectChannel(float4 v, int c)
+{
+    return dot(v, float4(c == 0, c == 1, c == 2, c == 3));
+}
+
+// half float from its low and high byte, inf/nan are never written
+float HalfToFloat(float lo, float hi)
+{
+    float e = fmod(floor(hi / 4.0), 32.0);
+    float m = fmod(hi, 4.0) * 256.0 + lo;
+    float mag = (e == 0.0) ? m * exp2(-24.0) : (1.0 + m / 1024.0) * exp2(e - 15.0);
+    return (hi >= 128.0) ? -mag : mag;
+}
+
+#if defined(SH_ENC_RGBA16F)
+// scalar k, two halves per texel
+float GetSHScalar(int k)
+{
+    int t = k / 2;
+    float4 b = GetSHBytes(t);
+    return (k == t * 2) ? HalfToFloat(b.r, b.g) : HalfToFloat(b.b, b.a);
+}
+
+float3 GetSH(int i)
+{
+    return float3(GetSHScalar(i*3), GetSHScalar(i*3 + 1), GetSHScalar(i*3 + 2));
+}
+#elif defined(SH_ENC_RGB9E5)
+float3 GetSH(int i)
+{
+    // rgb magnitudes, a = sign bits << 5 | shared exponent
+    float4 b = GetSHBytes(i);
+    float signs = floor(b.a / 32.0);
+    float3 neg = float3(fmod(signs, 2.0), fmod(floor(signs / 2.0), 2.0), floor(signs / 4.0));
+    return b.rgb * (1.0 - 2.0 * neg) * exp2(fmod(b.a, 32.0) - SH_RGB9E5_EXP_BIAS);
+}
+#elif defined(SH_ENC_SCALEBIAS)
+// scalar k, texel 0 holds the probe's half float scale and bias
+float GetSHScalar(int k, float2 scaleBias)
+{
+    int t = k / 4;
+    return SelectChannel(GetSHTexel(1 + t), k - t * 4) * scaleBias.x + scaleBias.y;
+}
+
 float3 GetSH(int i)
 {
-    float2 tex2 = float2((float)(cProbeIndex*9 + i), 0)/cTextureSize;
-    float3 sh = Sample2D(EnvMap, tex2).xyz;
+    float4 b = GetSHBytes(0);
+    float2 scaleBias = float2(HalfToFloat(b.r, b.g), HalfToFloat(b.b, b.a));
+    return float3(GetSHScalar(i*3, scaleBias), GetSHScalar(i*3 + 1, scaleBias), GetSHScalar(i*3 + 2, scaleBias));
+}
+#else
+float3 GetSH(int i)
+{
+    float3 sh = GetSHTexel(i).xyz;
     sh = (sh - float3(0.5, 0.5, 0.5)) * 10.0f;
     return sh;
 }
+#endif
+
+#ifdef SH_VOLUME
+static float4 shVolumeSlabs[SH_PACKED_VEC4S];
+
+// reads every slab of the grid cell around worldPos once per pixel. x is
+// clamped to the slab's outer texel centers, so filtering stays inside it
+void FetchSHVolume(float3 worldPos)
+{
+    float3 f = clamp(worldPos * cSHVolumeScale + cSHVolumeOffset, 0.5, cSHVolumeSize.xyz - 0.5);
+    float3 uvw = float3(f.x / (cSHVolumeSize.x * cSHVolumeSize.w), f.y / cSHVolumeSize.y, f.z / cSHVolumeSize.z);
+
+    [unroll]
+    for (int s = 0; s < SH_PACKED_VEC4S; ++s)
+    {
+        shVolumeSlabs[s] = Sample3D(VolumeMap, uvw);
+        uvw.x += 1.0 / cSHVolumeSize.w;
+    }
+}
+#endif
+
+// coeff i of the object's probe, its tetrahedron's probes blended, the
+// volume around the pixel or the coeffs the cpu uploaded
+float3 GetProbeSH(int i)
+{
+#if defined(SH_VOLUME)
+    return float3(SH_PACKED_SCALAR(shVolumeSlabs, i*3), SH_PACKED_SCALAR(shVolumeSlabs, i*3 + 1), SH_PACKED_SCALAR(shVolumeSlabs, i*3 + 2));
+#elif defined(SH_UNIFORMS)
+    return float3(SH_PACKED_SCALAR(cSHCoeffs, i*3), SH_PACKED_SCALAR(cSHCoeffs, i*3 + 1), SH_PACKED_SCALAR(cSHCoeffs, i*3 + 2));
+#elif defined(SH_TETRA)
+    float3 sh = float3(0.0, 0.0, 0.0);
+    [unroll]
+    for (int j = 0; j < 4; ++j)
+    {
+        shProbeIndex = cProbeIndices[j];
+        sh += GetSH(i) * cProbeWeights[j];
+    }
+    return sh;
+#else
+    shProbeIndex = cProbeIndex;
+    return GetSH(i);
+#endif
+}
 
 #define MANUAL_UNROLL
 #line 2000
 float3 SHDiffuse(float3 normal, float3 worldPos)
 {
+#if defined(SH_VOLUME)
+    // the volume is already interpolated between probes, no falloff
+    FetchSHVolume(worldPos);
+    float scale = cSHIntensity;
+#elif defined(SH_TETRA)
+    // the weights sum to one and blend smoothly between probes, no falloff
+    float scale = cSHIntensity;
+#else
     // world pos
     float dist = max(0.75, length(cProbePosition - worldPos));
     const float falloffDist = 1.5;
@@ -80,29 +260,43 @@ float3 SHDiffuse(float3 normal, float3 worldPos)
         dist = cMinProbeDistance + pow(0.5 + (dist - cMinProbeDistance), 4);
     }
 
-    // read sh
+    // linear decay 
+    float scale = cSHIntensity/dist;
+#endif
+
+#ifdef SH_L1
+    float3 sh[4];
+    sh[0] = GetProbeSH(0);
+    sh[1] = GetProbeSH(1);
+    sh[2] = GetProbeSH(2);
+    sh[3] = GetProbeSH(3);
+
+    return IrradCoeffsL1(sh[0], sh[1], sh[2], sh[3], normal) * scale;
+#else
+    // read sh, band 3 of the clamped cosine is zero so L3 tables
+    // only need their first 9 coeffs for irradiance
     float3 sh[9];
 
 #ifdef MANUAL_UNROLL
-    sh[0] = GetSH(0);
-    sh[1] = GetSH(1);
-    sh[2] = GetSH(2);
-    sh[3] = GetSH(3);
-    sh[4] = GetSH(4);
-    sh[5] = GetSH(5);
-    sh[6] = GetSH(6);
-    sh[7] = GetSH(7);
-    sh[8] = GetSH(8);
+    sh[0] = GetProbeSH(0);
+    sh[1] = GetProbeSH(1);
+    sh[2] = GetProbeSH(2);
+    sh[3] = GetProbeSH(3);
+    sh[4] = GetProbeSH(4);
+    sh[5] = GetProbeSH(5);
+    sh[6] = GetProbeSH(6);
+    sh[7] = GetProbeSH(7);
+    sh[8] = GetProbeSH(8);
 #else
     [unroll(9)]
     for (int i = 0; i < 9; ++i)
     {
-        sh[i] = GetSH(i);
+        sh[i] = GetProbeSH(i);
     }
 #endif
 
-    // linear decay 
-    return IrradCoeffs(sh[0], sh[1], sh[2], sh[3], sh[4], sh[5], sh[6], sh[7], sh[8], normal) * cSHIntensity/dist;
+    return IrradCoeffs(sh[0], sh[1], sh[2], sh[3], sh[4], sh[5], sh[6], sh[7], sh[8], normal) * scale;
+#endif
 }
 
 #endif //COMPILEPS